@@ -0,0 +1,82 @@
+#include "BlockCache.h"
+#include <algorithm>
+namespace lsm_storage_engine {
+
+/// Rough per-block overhead of the list node, index slot and handle.
+static constexpr size_t kBlockOverhead = 96;
+
+void BlockCache::Shard::evict(LruList::iterator it) {
+  usage -= charge(it->second);
+  index.erase(it->first);
+  lru.erase(it);
+}
+
+BlockCache::BlockCache(size_t capacity_bytes, size_t num_shards)
+    : capacity_(capacity_bytes) {
+  if (!enabled()) {
+    return;
+  }
+  num_shards = std::max<size_t>(num_shards, 1);
+  for (size_t i = 0; i < num_shards; ++i) {
+    shards_.push_back(std::make_unique<Shard>(capacity_bytes / num_shards));
+  }
+}
+
+size_t BlockCache::charge(const BlockHandle &block) {
+  return block.data.size() + kBlockOverhead;
+}
+
+std::optional<BlockHandle> BlockCache::lookup(uint64_t file_id, size_t offset,
+                                              size_t length) {
+  if (!enabled()) {
+    return std::nullopt;
+  }
+  Key key{file_id, offset};
+  auto &s = shard(key);
+  std::lock_guard lock(s.mutex);
+  auto it = s.index.find(key);
+  if (it == s.index.end() || it->second->second.data.size() < length) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  s.lru.splice(s.lru.begin(), s.lru, it->second);
+  const auto &block = it->second->second;
+  return BlockHandle{block.owner, block.data.first(length)};
+}
+
+void BlockCache::insert(uint64_t file_id, size_t offset, BlockHandle block) {
+  if (!enabled()) {
+    return;
+  }
+  Key key{file_id, offset};
+  auto &s = shard(key);
+  auto size = charge(block);
+  std::lock_guard lock(s.mutex);
+  if (size > s.capacity) {
+    return;
+  }
+  if (auto it = s.index.find(key); it != s.index.end()) {
+    s.evict(it->second);
+  }
+  while (s.usage + size > s.capacity) {
+    s.evict(std::prev(s.lru.end()));
+  }
+  s.lru.emplace_front(key, std::move(block));
+  s.index.emplace(key, s.lru.begin());
+  s.usage += size;
+}
+
+BlockCache::Stats BlockCache::stats() const {
+  size_t usage = 0;
+  for (const auto &s : shards_) {
+    std::lock_guard lock(s->mutex);
+    usage += s->usage;
+  }
+  return Stats{
+      .hits = hits_.load(std::memory_order_relaxed),
+      .misses = misses_.load(std::memory_order_relaxed),
+      .usage = usage,
+  };
+}
+} // namespace lsm_storage_engine
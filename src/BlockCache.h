@@ -0,0 +1,120 @@
+#pragma once
+#include "Constants.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Bytes of an SSTable, kept alive for as long as the handle is.
+ *
+ * `owner` is the buffer they were read into, or null when they point into
+ * the table's mapping (which lives as long as the table).
+ */
+struct BlockHandle {
+  std::shared_ptr<const void> owner;
+  std::span<const std::byte> data;
+};
+
+/**
+ * @brief Cache of SSTable data blocks read with pread() or O_DIRECT.
+ *
+ * Tables that aren't mmapped read their blocks into buffers the engine owns
+ * and keep the hot ones here, so their memory is bounded by this budget
+ * rather than by what the page cache decides to keep. Blocks are keyed by
+ * the table's file_id() and file offset; file ids are never reused, so the
+ * blocks of deleted tables just age out.
+ *
+ * Split into shards by key hash, each with its own lock, LRU list and share
+ * of the byte budget. Lookups hand out shared handles, so a block evicted
+ * while being read stays valid for its reader.
+ *
+ * A capacity of 0 disables caching. Thread-safe.
+ */
+class BlockCache {
+public:
+  /**
+   * @param capacity_bytes Budget for cached blocks and bookkeeping.
+   * @param num_shards Number of independently locked shards.
+   */
+  explicit BlockCache(size_t capacity_bytes,
+                      size_t num_shards = lsm_constants::kBlockCacheShards);
+
+  /// Shared between tables, so no copies or moves.
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+
+  bool enabled() const { return capacity_ > 0; }
+
+  /**
+   * @brief The first `length` bytes of the block cached at `offset` of
+   * file `file_id`, if a block at least that long is cached.
+   */
+  std::optional<BlockHandle> lookup(uint64_t file_id, size_t offset,
+                                    size_t length);
+
+  /**
+   * @brief Cache `block` as the bytes at `offset` of file `file_id`,
+   * evicting least recently used blocks to make room.
+   */
+  void insert(uint64_t file_id, size_t offset, BlockHandle block);
+
+  struct Stats {
+    unsigned long hits;
+    unsigned long misses;
+    /// Bytes charged for the cached blocks.
+    size_t usage;
+  };
+
+  Stats stats() const;
+
+private:
+  struct Key {
+    uint64_t file_id;
+    size_t offset;
+    bool operator==(const Key &) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      // Multiplying pushes every input bit into the high bits that pick
+      // the shard.
+      auto hash = ((key.file_id << 40) ^ key.offset) *
+                  0x9E3779B97F4A7C15ULL;
+      return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+  };
+  using LruList = std::list<std::pair<Key, BlockHandle>>;
+
+  struct Shard {
+    explicit Shard(size_t shard_capacity) : capacity(shard_capacity) {}
+
+    std::mutex mutex;
+    size_t capacity;
+    size_t usage{0};
+    /// Blocks, most recently used first.
+    LruList lru;
+    std::unordered_map<Key, LruList::iterator, KeyHash> index;
+
+    void evict(LruList::iterator it);
+  };
+
+  size_t capacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<unsigned long> hits_{0};
+  std::atomic<unsigned long> misses_{0};
+
+  Shard &shard(const Key &key) {
+    return *shards_[(KeyHash{}(key) >> 32) % shards_.size()];
+  }
+
+  /// Bytes charged for one cached block.
+  static size_t charge(const BlockHandle &block);
+};
+} // namespace lsm_storage_engine
@@ -3,11 +3,18 @@
 #include <string>
 namespace lsm_storage_engine {
 void BloomFilter::add(const std::string_view key) {
+  // No bits: the filter is disabled and passes every key.
+  if (bits_.empty()) {
+    return;
+  }
   for (const auto bit : get_hashes(key)) {
     bits_[bit] = true;
   }
 } // namespace lsm_storage_engine
-bool BloomFilter::contains(const std::string_view key) {
+bool BloomFilter::contains(const std::string_view key) const {
+  if (bits_.empty()) {
+    return true;
+  }
   for (const auto bit : get_hashes(key)) {
     if (!bits_[bit])
       return false;
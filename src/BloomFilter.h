@@ -1,22 +1,37 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <string_view>
 #include <vector>
 namespace lsm_storage_engine {
 class BloomFilter {
 public:
+  /// Hash count of filters written before it was stored with them.
+  static constexpr size_t kDefaultHashes = 6;
+
   BloomFilter() {}
-  BloomFilter(size_t num_items) : bits_(num_items * 10, false) {}
-  BloomFilter(std::vector<bool> bits) : bits_{std::move(bits)} {}
+  BloomFilter(size_t num_items, size_t bits_per_key = 10)
+      : bits_(num_items * bits_per_key, false),
+        num_hashes_{optimal_hashes(bits_per_key)} {}
+  BloomFilter(std::vector<bool> bits, size_t num_hashes = kDefaultHashes)
+      : bits_{std::move(bits)}, num_hashes_{num_hashes} {}
 
   void add(const std::string_view key);
-  bool contains(const std::string_view key);
+  bool contains(const std::string_view key) const;
   const std::vector<bool> &bits() const { return bits_; }
+  size_t num_hashes() const { return num_hashes_; }
+
+  /// bits_per_key * ln 2 minimizes false positives.
+  static size_t optimal_hashes(size_t bits_per_key) {
+    auto hashes = static_cast<size_t>(static_cast<double>(bits_per_key) *
+                                      std::log(2));
+    return std::clamp<size_t>(hashes, 1, 30);
+  }
 
 private:
   /// Optimizes down to 1 bit per bool
   std::vector<bool> bits_;
-  size_t num_hashes_{static_cast<size_t>(10 * std::log(2))};
+  size_t num_hashes_{kDefaultHashes};
 
   size_t hash1(const std::string_view data) const;
 
@@ -0,0 +1,300 @@
+#include "ColumnFamilyDb.h"
+#include "utils/FileSync.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+namespace lsm_storage_engine {
+
+/**
+ * Create the database directory, for the WAL opened in it.
+ */
+static std::filesystem::path wal_path(const std::filesystem::path &dir) {
+  std::filesystem::create_directories(dir);
+  return dir / "db.wal";
+}
+
+ColumnFamilyDb::ColumnFamilyDb(DbOptions options)
+    : options_(std::move(options)), wal_(wal_path(options_.dir)) {
+  load_families();
+  for (const auto &name : names_) {
+    auto given = std::ranges::find(options_.families, name,
+                                   &std::pair<std::string, Options>::first);
+    auto family_options =
+        given != options_.families.end() ? given->second : Options{};
+    family_options.dir = options_.dir / name;
+    // The constructor is private to the trees' friends.
+    families_.push_back(
+        std::unique_ptr<LsmTree>(new LsmTree(std::move(family_options),
+                                             false)));
+  }
+  replay();
+}
+
+ColumnFamilyDb::~ColumnFamilyDb() {
+  try {
+    close();
+  } catch (const std::exception &) {
+    // Destructors don't throw. The WAL still has whatever didn't make it:
+    // the next open replays it.
+  }
+}
+
+void ColumnFamilyDb::load_families() {
+  for (const auto &[name, _] : options_.families) {
+    if (name.empty() || name == "." || name == ".." || name.contains('/') ||
+        name.contains('\n')) {
+      throw std::invalid_argument("Bad column family name: " + name);
+    }
+    if (std::ranges::count(options_.families, name,
+                           &std::pair<std::string, Options>::first) > 1) {
+      throw std::invalid_argument("Column family given twice: " + name);
+    }
+  }
+  auto path = options_.dir / "FAMILIES";
+  {
+    std::ifstream file{path};
+    std::string line;
+    while (std::getline(file, line)) {
+      names_.push_back(line);
+    }
+  }
+  auto listed = names_.size();
+  for (const auto &[name, _] : options_.families) {
+    if (std::ranges::find(names_, name) == names_.end()) {
+      names_.push_back(name);
+    }
+  }
+  if (names_.size() == listed) {
+    return;
+  }
+  // Ids are positions in the list, so it is only ever appended to, and
+  // replaced whole so a crash can't leave half a name behind.
+  // Both the file and the rename are synced before any batch naming a new
+  // id reaches the WAL: replay would find it unknown otherwise.
+  auto tmp = options_.dir / "FAMILIES.tmp";
+  std::string contents;
+  for (const auto &name : names_) {
+    contents += name + '\n';
+  }
+  if (!write_file_synced(tmp, contents)) {
+    throw std::runtime_error("Could not write " + tmp.string());
+  }
+  std::filesystem::rename(tmp, path);
+  if (!sync_path(options_.dir)) {
+    throw std::runtime_error("Could not sync " + options_.dir.string());
+  }
+}
+
+void ColumnFamilyDb::replay() {
+  // Each family's writes up to here are in its SSTables.
+  std::vector<SequenceNumber> flushed;
+  for (const auto &family : families_) {
+    flushed.push_back(family->last_sequence());
+    last_sequence_ = std::max(last_sequence_, flushed.back());
+  }
+  auto records = Wal::read(wal_.path());
+  if (!records) {
+    throw std::runtime_error("Could not replay the WAL: " +
+                             records.error().message);
+  }
+  std::vector<std::vector<KeyEntry>> pending(families_.size());
+  for (const auto &[_, record] : *records) {
+    auto batch = record.type == EntryType::Batch
+                     ? WriteBatch::decode(record.value)
+                     : std::nullopt;
+    if (!batch) {
+      throw std::runtime_error("Malformed batch in the WAL!");
+    }
+    auto seq = record.seq;
+    for (const auto &write : batch->writes()) {
+      if (write.family >= families_.size()) {
+        throw std::runtime_error("WAL writes to an unknown column family!");
+      }
+      if (seq > flushed[write.family]) {
+        auto entry = write.entry;
+        entry.seq = seq;
+        pending[write.family].emplace_back(write.key, std::move(entry));
+      }
+      last_sequence_ = std::max(last_sequence_, seq++);
+    }
+  }
+  for (size_t i = 0; i < families_.size(); ++i) {
+    if (!pending[i].empty()) {
+      families_[i]->apply_logged(std::move(pending[i]));
+      families_[i]->flush_logged(false);
+    }
+  }
+  wal_bytes_ = std::filesystem::file_size(wal_.path());
+  // A crash between the last flush and clearing the WAL leaves nothing in
+  // it to replay.
+  maybe_clear_wal();
+}
+
+uint32_t ColumnFamilyDb::id(std::string_view name) const {
+  auto it = std::ranges::find(names_, name);
+  if (it == names_.end()) {
+    throw std::invalid_argument("No column family " + std::string{name});
+  }
+  return static_cast<uint32_t>(it - names_.begin());
+}
+
+void ColumnFamilyDb::write(const WriteBatch &batch) {
+  if (batch.empty()) {
+    return;
+  }
+  std::vector<bool> touched(families_.size());
+  for (const auto &write : batch.writes()) {
+    if (write.family >= families_.size()) {
+      throw std::invalid_argument("Write to an unknown column family!");
+    }
+    if (write.entry.type == EntryType::Merge &&
+        !families_[write.family]->merge_operator_) {
+      throw std::invalid_argument("merge() needs a merge operator!");
+    }
+    touched[write.family] = true;
+  }
+  // Push back before queueing if a family's compaction is behind.
+  for (size_t i = 0; i < families_.size(); ++i) {
+    if (touched[i]) {
+      families_[i]->throttle_write();
+    }
+  }
+
+  uint64_t ticket{0};
+  bool wal_full{false};
+  {
+    std::lock_guard lock(write_mutex_);
+    if (closed_) {
+      throw std::runtime_error("Write to a closed ColumnFamilyDb!");
+    }
+    auto first = last_sequence_ + 1;
+    auto value = batch.encode();
+    wal_bytes_ += value.size();
+    Entry record{EntryType::Batch, std::move(value), {}, first};
+    if (!wal_.write({}, record)) {
+      throw std::runtime_error("Failed to write to WAL!");
+    }
+    last_sequence_ += batch.size();
+    ticket = appended_.fetch_add(1) + 1;
+    wal_full = wal_bytes_ >= options_.max_wal_bytes;
+
+    // Applied in WAL order, since memtables take a key's versions newest
+    // last.
+    std::vector<std::vector<KeyEntry>> per_family(families_.size());
+    auto seq = first;
+    for (const auto &write : batch.writes()) {
+      auto entry = write.entry;
+      entry.seq = seq++;
+      per_family[write.family].emplace_back(write.key, std::move(entry));
+    }
+    for (size_t i = 0; i < families_.size(); ++i) {
+      if (touched[i]) {
+        families_[i]->apply_logged(std::move(per_family[i]));
+      }
+    }
+  }
+  if (options_.sync_mode == SyncMode::EveryWrite) {
+    sync_through(ticket);
+  }
+
+  // Flushes happen outside write_mutex_: writers to other families keep
+  // going meanwhile.
+  bool flushed{false};
+  for (size_t i = 0; i < families_.size(); ++i) {
+    if ((touched[i] || wal_full) && families_[i]->flush_logged(wal_full)) {
+      flushed = true;
+    }
+  }
+  if (flushed) {
+    maybe_clear_wal();
+  }
+  for (size_t i = 0; i < families_.size(); ++i) {
+    if (touched[i]) {
+      families_[i]->compact();
+    }
+  }
+}
+
+void ColumnFamilyDb::put(uint32_t family, const std::string &key,
+                         const std::string &value) {
+  WriteBatch batch;
+  batch.put(family, key, value);
+  write(batch);
+}
+
+void ColumnFamilyDb::rm(uint32_t family, const std::string &key) {
+  WriteBatch batch;
+  batch.rm(family, key);
+  write(batch);
+}
+
+void ColumnFamilyDb::merge(uint32_t family, const std::string &key,
+                           const std::string &operand) {
+  WriteBatch batch;
+  batch.merge(family, key, operand);
+  write(batch);
+}
+
+void ColumnFamilyDb::delete_range(uint32_t family, const std::string &begin,
+                                  const std::string &end) {
+  WriteBatch batch;
+  batch.delete_range(family, begin, end);
+  write(batch);
+}
+
+void ColumnFamilyDb::flush(uint32_t family) {
+  if (families_.at(family)->flush_logged(true)) {
+    maybe_clear_wal();
+  }
+  families_[family]->compact();
+}
+
+void ColumnFamilyDb::sync_through(uint64_t ticket) {
+  std::lock_guard lock(sync_mutex_);
+  if (synced_ >= ticket) {
+    // Another writer's fsync covered this batch while we waited.
+    return;
+  }
+  // Everything appended by now goes down with this fsync.
+  auto target = appended_.load();
+  if (!wal_.sync()) {
+    throw std::runtime_error("Failed to sync WAL!");
+  }
+  synced_ = target;
+  wal_syncs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ColumnFamilyDb::maybe_clear_wal() {
+  std::lock_guard lock(write_mutex_);
+  if (closed_ || wal_bytes_ == 0 ||
+      !std::ranges::all_of(families_,
+                           [](const auto &f) { return f->memtable_empty(); })) {
+    return;
+  }
+  // Every write in it has been flushed and logged to a manifest.
+  if (!wal_.clear()) {
+    throw std::runtime_error("Failed to clear the WAL!");
+  }
+  wal_bytes_ = 0;
+}
+
+void ColumnFamilyDb::close() {
+  std::lock_guard lock(write_mutex_);
+  if (closed_) {
+    return;
+  }
+  for (auto &family : families_) {
+    family->close();
+  }
+  if (!wal_.clear()) {
+    throw std::runtime_error("Failed to clear the WAL!");
+  }
+  wal_bytes_ = 0;
+  closed_ = true;
+}
+
+ColumnFamilyDb::Stats ColumnFamilyDb::stats() const {
+  return {.batches = appended_.load(std::memory_order_relaxed),
+          .wal_syncs = wal_syncs_.load(std::memory_order_relaxed)};
+}
+} // namespace lsm_storage_engine
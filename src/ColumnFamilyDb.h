@@ -0,0 +1,164 @@
+#pragma once
+#include "Constants.h"
+#include "Entry.h"
+#include "LsmTree.h"
+#include "Options.h"
+#include "Wal.h"
+#include "WriteBatch.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Configuration of a ColumnFamilyDb.
+ */
+struct DbOptions {
+  /// Holds the shared WAL, the FAMILIES list and a directory per family.
+  std::filesystem::path dir{"."};
+  /// Family names with their options. Family `name` lives in `dir/name`,
+  /// whatever its options' `dir`.
+  std::vector<std::pair<std::string, Options>> families;
+  /// With EveryWrite, concurrent writers share fsyncs (group commit). The
+  /// families' own sync_mode is unused: they have no WAL of their own.
+  SyncMode sync_mode{SyncMode::None};
+  /// Every family with unflushed writes is flushed once the WAL passes this.
+  size_t max_wal_bytes{lsm_constants::kMaxSharedWalBytes};
+};
+
+/**
+ * @brief Several LsmTrees, the column families, sharing one WAL.
+ *
+ * Each family has its own memtable, SSTables, manifest and options, so
+ * each is flushed and compacted on its own terms. Writes to all of them go
+ * through one WAL: a WriteBatch is a single record there, so after a crash
+ * either all of its writes are replayed or none are, across families.
+ * Replay skips the writes a family had already flushed.
+ *
+ * The WAL is cleared once no family has unflushed writes; past
+ * `max_wal_bytes`, every family is flushed to get there.
+ *
+ * Families are listed in `dir/FAMILIES` by id. Families on disk but not in
+ * the options are opened with default Options, so their writes still
+ * replay. Reads go through family(); writing to it directly throws.
+ * Thread-safe.
+ */
+class ColumnFamilyDb {
+public:
+  /**
+   * @brief Open (or create) the families and replay the WAL.
+   * @throws std::invalid_argument on a bad or repeated family name.
+   */
+  explicit ColumnFamilyDb(DbOptions options);
+
+  ColumnFamilyDb(const ColumnFamilyDb &) = delete;
+  ColumnFamilyDb &operator=(const ColumnFamilyDb &) = delete;
+
+  /// Closes the database (see close()) unless already closed.
+  ~ColumnFamilyDb();
+
+  /**
+   * @brief Id of a family, for WriteBatch and family().
+   * @throws std::invalid_argument if there is no such family.
+   */
+  uint32_t id(std::string_view name) const;
+
+  /// The family's tree, for reads, snapshots and stats.
+  LsmTree &family(uint32_t id) { return *families_.at(id); }
+
+  /**
+   * @brief Log the batch as one WAL record, then apply it to its families.
+   *
+   * A reader of one family sees all of the batch's writes to it or none;
+   * across families, a reader may see the batch land on one before another.
+   * @throws std::invalid_argument on an unknown family, or a merge to a
+   *         family without a merge operator.
+   */
+  void write(const WriteBatch &batch);
+
+  void put(uint32_t family, const std::string &key, const std::string &value);
+  void rm(uint32_t family, const std::string &key);
+  void merge(uint32_t family, const std::string &key,
+             const std::string &operand);
+  void delete_range(uint32_t family, const std::string &begin,
+                    const std::string &end);
+
+  /**
+   * @brief Flush one family's memtable, whatever its size, and clear the WAL
+   * if no family has unflushed writes left.
+   */
+  void flush(uint32_t family);
+
+  /**
+   * @brief Close every family (see LsmTree::close()) and clear the WAL.
+   * Writes afterwards throw.
+   */
+  void close();
+
+  size_t num_families() const { return families_.size(); }
+
+  struct Stats {
+    unsigned long batches;
+    /// fsyncs of the WAL. Under SyncMode::EveryWrite, fewer than batches
+    /// when concurrent writers shared them.
+    unsigned long wal_syncs;
+  };
+  Stats stats() const;
+
+private:
+  DbOptions options_;
+  /// Family names by id.
+  std::vector<std::string> names_;
+  std::vector<std::unique_ptr<LsmTree>> families_;
+  Wal wal_;
+
+  /**
+   * Orders writes: sequence numbers are taken, the WAL appended and the
+   * memtables applied in one order. Taken before any family's lock.
+   */
+  std::mutex write_mutex_;
+  /// Guarded by write_mutex_.
+  SequenceNumber last_sequence_{0};
+  size_t wal_bytes_{0};
+  bool closed_{false};
+
+  /**
+   * Group commit: batches appended so far, and how many of them an fsync
+   * has covered. A writer whose batch is already covered returns without
+   * syncing. synced_ is guarded by sync_mutex_.
+   */
+  std::atomic<uint64_t> appended_{0};
+  uint64_t synced_{0};
+  std::mutex sync_mutex_;
+  std::atomic<unsigned long> wal_syncs_{0};
+
+  /**
+   * @brief Add names not listed in `dir/FAMILIES` to it, and fill names_
+   * with every listed family.
+   */
+  void load_families();
+
+  /**
+   * @brief Apply the WAL's batches that some family hasn't flushed yet.
+   */
+  void replay();
+
+  /**
+   * @brief Make sure the WAL is on disk up to batch `ticket`, sharing the
+   * fsync with every writer that has appended by then.
+   */
+  void sync_through(uint64_t ticket);
+
+  /**
+   * @brief Truncate the WAL if no family has unflushed writes.
+   */
+  void maybe_clear_wal();
+};
+} // namespace lsm_storage_engine
@@ -2,9 +2,60 @@
 #include <cstddef>
 namespace lsm_storage_engine {
 namespace lsm_constants {
-// TODO: Add to configuration.
-constexpr size_t kMemTableFlushThreshold = 1UZ << 19;
 constexpr size_t kMagicNumber = 0xDEADBEEF;
+/// Defaults of the tunable Options (see Options.h).
+constexpr size_t kMemTableFlushThreshold = 1UZ << 19;
 constexpr size_t kIndexSpace = 64;
+constexpr size_t kBloomBitsPerKey = 10;
+/// Flush and compaction outputs are cut into files of about this size.
+constexpr size_t kTargetFileSize = 1UZ << 21;
+/// Level 0 is compacted once it holds this many tables, and each level
+/// below holds kLevelSizeMultiplier times as many.
+constexpr size_t kCompactionTrigger = 4;
+constexpr size_t kLevelSizeMultiplier = 2;
+/// Writes are delayed past the slowdown limits and stopped past the stop
+/// limits until compaction catches up. Level 0's are these many times the
+/// compaction trigger, so compaction always has a level 0 to work on first.
+constexpr size_t kL0SlowdownFactor = 2;
+constexpr size_t kL0StopFactor = 3;
+constexpr size_t kPendingCompactionBytesSlowdown = 1UZ << 28;
+constexpr size_t kPendingCompactionBytesStop = 1UZ << 30;
+constexpr size_t kMaxImmutableMemTables = 2;
+constexpr long long kMaxWriteDelayUs = 1000;
+/// Background (flush + compaction) write budget. 0 means unlimited.
+constexpr size_t kRateLimitBytesPerSec = 0;
+/// Row cache budget for hot keys' values. 0 disables it.
+constexpr size_t kRowCacheBytes = 1UZ << 23;
+constexpr size_t kRowCacheShards = 16;
+/// Block cache budget for tables read with pread() or O_DIRECT. 0 disables
+/// it.
+constexpr size_t kBlockCacheBytes = 1UZ << 25;
+constexpr size_t kBlockCacheShards = 16;
+/// Most SSTables with an open file (descriptors and mapping) at once. 0
+/// means no bound.
+constexpr size_t kTableCacheSize = 512;
+/// Shards of a ShardedLsm unless configured.
+constexpr size_t kDefaultShards = 4;
+/// A ColumnFamilyDb flushes every family once their shared WAL passes this
+/// size, so the log can be cleared.
+constexpr size_t kMaxSharedWalBytes = 1UZ << 26;
+/// Most threads opening SSTables in parallel at startup.
+constexpr size_t kTableOpenThreads = 8;
+/// WAL replay verifies and decodes records on up to this many threads,
+/// one per this many bytes of log.
+constexpr size_t kWalReplayThreads = 8;
+constexpr size_t kWalReplayChunkBytes = 1UZ << 18;
+/// The manifest is rewritten as a snapshot once its log passes this size.
+constexpr size_t kManifestSnapshotBytes = 1UZ << 20;
+/// O_DIRECT reads are aligned to this; covers 512-byte and 4K sectors.
+constexpr size_t kDirectIoAlignment = 4096;
+/// Compaction reads tables that aren't mmapped in chunks of this size.
+constexpr size_t kSequentialReadSize = 1UZ << 20;
+/// Compaction keeps this much of each input on its way in ahead of its
+/// cursor.
+constexpr size_t kCompactionReadahead = 1UZ << 21;
+/// Default readahead of scans. Tables are advised for random access, so
+/// without it a scan would fault its blocks in a page at a time.
+constexpr size_t kScanReadahead = 1UZ << 18;
 } // namespace lsm_constants
 }; // namespace lsm_storage_engine
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Position of a write in the global write order. Every write gets the
+ * next one, so of two entries for a key, the one with the larger number is
+ * newer.
+ */
+using SequenceNumber = uint64_t;
+
+/// Reads at this sequence see every write.
+constexpr SequenceNumber kMaxSequenceNumber =
+    std::numeric_limits<SequenceNumber>::max();
+
+/**
+ * @brief Type tag stored with every record in the WAL and SSTables.
+ */
+enum class EntryType : uint8_t {
+  Put = 0,
+  /// Tombstone: the key was deleted. Carries no value.
+  Delete = 1,
+  /// WAL only: every key in [key, value) was deleted. SSTables keep range
+  /// deletes in their own block (see RangeTombstoneList).
+  RangeDelete = 2,
+  /// Merge operand, combined with older entries by a MergeOperator.
+  Merge = 3,
+  /// WAL only: a WriteBatch of a ColumnFamilyDb, encoded in the value. Its
+  /// writes take the sequence numbers from the record's on.
+  Batch = 4,
+};
+
+/**
+ * @brief The value half of a record: a value, or a deletion marker.
+ */
+struct Entry {
+  EntryType type{EntryType::Put};
+  std::string value;
+  /**
+   * Memtable only: merge operands not yet applied on top of this entry,
+   * oldest first. They are folded in on reads and flush, so SSTables and the
+   * WAL only ever see entries without them.
+   */
+  std::vector<std::string> operands;
+  /**
+   * Sequence number of the write. For a memtable entry with operands, that
+   * of the newest operand.
+   */
+  SequenceNumber seq{0};
+
+  static Entry put(std::string value) {
+    return {EntryType::Put, std::move(value), {}};
+  }
+  static Entry tombstone() { return {EntryType::Delete, {}, {}}; }
+  static Entry merge(std::string operand) {
+    return {EntryType::Merge, std::move(operand), {}};
+  }
+
+  bool is_tombstone() const { return type == EntryType::Delete; }
+};
+
+/// A key and its entry, as stored in SSTables.
+using KeyEntry = std::pair<std::string, Entry>;
+} // namespace lsm_storage_engine
@@ -0,0 +1,103 @@
+#pragma once
+#include "Entry.h"
+#include "RangeTombstones.h"
+#include "StorageError.h"
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Cursor over one sorted source (a memtable snapshot or an SSTable)
+ * that Iterator merges with the others.
+ *
+ * Unlike the public Iterator, it yields raw entries: every version of a key
+ * (newest first), tombstones and merge operands included, range tombstones
+ * exposed on the side.
+ *
+ * Not thread-safe.
+ */
+class InternalIterator {
+public:
+  virtual ~InternalIterator() = default;
+
+  virtual bool valid() const = 0;
+  virtual void seek_to_first() = 0;
+  virtual void seek_to_last() = 0;
+
+  /**
+   * @brief Position at the first entry with a key >= target.
+   */
+  virtual void seek(std::string_view target) = 0;
+
+  virtual void next() = 0;
+  virtual void prev() = 0;
+
+  /// Only while valid().
+  virtual const std::string &key() const = 0;
+  virtual const Entry &entry() const = 0;
+
+  /**
+   * @brief Deleted ranges stored with this source; they hide older sources.
+   */
+  virtual const RangeTombstoneList &range_tombstones() const = 0;
+
+  /**
+   * @brief The I/O error that invalidated the cursor, if any.
+   */
+  virtual const std::optional<StorageError> &error() const = 0;
+
+  /**
+   * @brief Position at the last entry with a key < target.
+   */
+  void seek_before(std::string_view target) {
+    seek(target);
+    if (valid()) {
+      prev();
+    } else if (!error()) {
+      seek_to_last();
+    }
+  }
+};
+
+/**
+ * @brief InternalIterator over an in-memory, sorted copy of entries, used to
+ * scan the memtable without holding its lock.
+ */
+class VectorIterator : public InternalIterator {
+public:
+  VectorIterator(std::vector<KeyEntry> entries, RangeTombstoneList ranges)
+      : entries_(std::move(entries)), ranges_(std::move(ranges)),
+        pos_(entries_.size()) {}
+
+  bool valid() const override { return pos_ < entries_.size(); }
+  void seek_to_first() override { pos_ = 0; }
+  void seek_to_last() override {
+    pos_ = entries_.empty() ? 0 : entries_.size() - 1;
+  }
+  void seek(std::string_view target) override {
+    auto it = std::ranges::lower_bound(entries_, target, std::ranges::less{},
+                                       &KeyEntry::first);
+    pos_ = static_cast<size_t>(it - entries_.begin());
+  }
+  void next() override { ++pos_; }
+  void prev() override {
+    // Stepping back from the first entry invalidates, like next() at the end.
+    pos_ = pos_ == 0 ? entries_.size() : pos_ - 1;
+  }
+  const std::string &key() const override { return entries_[pos_].first; }
+  const Entry &entry() const override { return entries_[pos_].second; }
+  const RangeTombstoneList &range_tombstones() const override {
+    return ranges_;
+  }
+  const std::optional<StorageError> &error() const override { return error_; }
+
+private:
+  std::vector<KeyEntry> entries_;
+  RangeTombstoneList ranges_;
+  size_t pos_;
+  std::optional<StorageError> error_;
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,219 @@
+#include "IoRing.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+namespace lsm_storage_engine {
+
+/// The kernel writes the other side of these concurrently.
+static unsigned load_acquire(unsigned *shared) {
+  return std::atomic_ref<unsigned>{*shared}.load(std::memory_order_acquire);
+}
+static void store_release(unsigned *shared, unsigned value) {
+  std::atomic_ref<unsigned>{*shared}.store(value, std::memory_order_release);
+}
+
+/**
+ * Read all of [offset, offset + length) into `buffer` with pread().
+ * @return Bytes read, or -errno.
+ */
+static int pread_all(int fd, std::span<std::byte> buffer, size_t offset) {
+  size_t done = 0;
+  while (done < buffer.size()) {
+    auto n = ::pread(fd, buffer.data() + done, buffer.size() - done,
+                     static_cast<off_t>(offset + done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return -errno;
+    }
+    if (n == 0) {
+      return -EIO;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return static_cast<int>(done);
+}
+
+IoRing::IoRing(unsigned entries) {
+  io_uring_params params{};
+  auto fd = ::syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) {
+    // No io_uring here: reads fall back to pread().
+    return;
+  }
+  ring_fd_ = static_cast<int>(fd);
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    unmap();
+    return;
+  }
+  cq_ring_ = single_mmap
+                 ? sq_ring_
+                 : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_,
+                          IORING_OFF_CQ_RING);
+  if (cq_ring_ == MAP_FAILED) {
+    cq_ring_ = nullptr;
+    unmap();
+    return;
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    unmap();
+    return;
+  }
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+  auto *sq = static_cast<std::byte *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+
+  auto *cq = static_cast<std::byte *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoRing::~IoRing() { unmap(); }
+
+void IoRing::unmap() {
+  if (sqes_ != nullptr) {
+    ::munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  cq_ring_ = nullptr;
+  if (sq_ring_ != nullptr) {
+    ::munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = nullptr;
+  }
+  if (ring_fd_ >= 0) {
+    ::close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+bool IoRing::Read::await_ready() {
+  if (ring_.uses_io_uring() || buffer_.empty()) {
+    return buffer_.empty();
+  }
+  result_ = pread_all(fd_, buffer_, offset_);
+  return true;
+}
+
+void IoRing::Read::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+  ring_.queue(*this);
+}
+
+IoRing::ReadResult IoRing::Read::await_resume() {
+  if (result_ < 0) {
+    return std::unexpected{-result_};
+  }
+  // Regular files rarely come up short, but finish the job if they do.
+  auto done = static_cast<size_t>(result_);
+  if (done < buffer_.size()) {
+    auto rest = pread_all(fd_, std::span{buffer_}.subspan(done),
+                          offset_ + done);
+    if (rest < 0) {
+      return std::unexpected{-rest};
+    }
+  }
+  return std::move(buffer_);
+}
+
+void IoRing::queue(Read &read) {
+  if (*sq_tail_ - load_acquire(sq_head_) == sq_entries_) {
+    // Full: hand the batch to the kernel to make room. Completions wait for
+    // run() (the kernel buffers any the completion queue can't hold).
+    enter(false);
+  }
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & sq_mask_;
+  auto &sqe = sqes_[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = read.fd_;
+  sqe.addr = reinterpret_cast<uint64_t>(read.buffer_.data());
+  sqe.len = static_cast<uint32_t>(read.buffer_.size());
+  sqe.off = read.offset_;
+  sqe.user_data = reinterpret_cast<uint64_t>(&read);
+  sq_array_[index] = index;
+  store_release(sq_tail_, tail + 1);
+  ++queued_;
+}
+
+void IoRing::enter(bool wait) {
+  while (true) {
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    auto n = ::syscall(__NR_io_uring_enter, ring_fd_, queued_,
+                       wait ? 1 : 0, flags, nullptr, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw std::runtime_error(std::string{"io_uring_enter failed: "} +
+                               std::strerror(errno));
+    }
+    auto consumed = static_cast<unsigned>(n);
+    queued_ -= consumed;
+    submitted_ += consumed;
+    return;
+  }
+}
+
+void IoRing::reap() {
+  std::vector<Read *> completed;
+  unsigned head = *cq_head_;
+  unsigned tail = load_acquire(cq_tail_);
+  for (; head != tail; ++head) {
+    const auto &cqe = cqes_[head & cq_mask_];
+    auto *read = reinterpret_cast<Read *>(cqe.user_data);
+    read->result_ = cqe.res;
+    completed.push_back(read);
+  }
+  store_release(cq_head_, head);
+  submitted_ -= completed.size();
+  // Resumed coroutines may queue more reads, so resume only once the
+  // completion queue is consistent again.
+  for (auto *read : completed) {
+    read->handle_.resume();
+  }
+}
+
+void IoRing::run() {
+  if (!uses_io_uring()) {
+    return;
+  }
+  while (in_flight() > 0) {
+    enter(true);
+    reap();
+  }
+}
+} // namespace lsm_storage_engine
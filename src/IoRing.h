@@ -0,0 +1,122 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <vector>
+struct io_uring_sqe;
+struct io_uring_cqe;
+namespace lsm_storage_engine {
+
+/**
+ * @brief io_uring submission/completion ring that resumes coroutines when
+ * their reads complete.
+ *
+ * A coroutine `co_await`s read(), which queues the read and suspends. run()
+ * submits everything queued in one syscall, waits for completions and
+ * resumes their coroutines, which may queue more reads; it returns once
+ * nothing is in flight. One thread can keep as many reads in flight as
+ * there are suspended coroutines, so a lookup that misses the page cache
+ * no longer stalls the thread.
+ *
+ * Talks to the kernel through the raw syscalls. Where io_uring is missing or
+ * forbidden (old kernels, seccomp), reads fall back to a blocking pread()
+ * without suspending; check uses_io_uring().
+ *
+ * Call run() until nothing is in flight before destroying the ring or the
+ * coroutines waiting on it. Not thread-safe: one ring per thread.
+ */
+class IoRing {
+public:
+  /// @param entries Submission queue size; more reads queue in batches.
+  explicit IoRing(unsigned entries = 256);
+  ~IoRing();
+
+  IoRing(const IoRing &) = delete;
+  IoRing &operator=(const IoRing &) = delete;
+
+  bool uses_io_uring() const { return ring_fd_ >= 0; }
+
+  /// The bytes read, or the errno of a failed read.
+  using ReadResult = std::expected<std::vector<std::byte>, int>;
+
+  /// Awaitable returned by read().
+  class Read {
+  public:
+    Read(IoRing &ring, int fd, size_t offset, size_t length)
+        : ring_(ring), fd_(fd), offset_(offset), buffer_(length) {}
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+    ReadResult await_resume();
+
+  private:
+    friend class IoRing;
+    IoRing &ring_;
+    int fd_;
+    size_t offset_;
+    std::vector<std::byte> buffer_;
+    std::coroutine_handle<> handle_;
+    /// Bytes read, or -errno.
+    int result_{0};
+  };
+
+  /**
+   * @brief `co_await` to read [offset, offset + length) of `fd`.
+   */
+  Read read(int fd, size_t offset, size_t length) {
+    return Read{*this, fd, offset, length};
+  }
+
+  /**
+   * @brief Submit the queued reads and resume their coroutines as they
+   * complete, until no reads are left in flight.
+   */
+  void run();
+
+  /// Reads submitted or queued but not yet completed.
+  size_t in_flight() const { return queued_ + submitted_; }
+
+private:
+  int ring_fd_{-1};
+
+  /// Submission queue ring, shared with the kernel.
+  void *sq_ring_{nullptr};
+  size_t sq_ring_size_{0};
+  unsigned *sq_head_{nullptr};
+  unsigned *sq_tail_{nullptr};
+  unsigned *sq_array_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned sq_entries_{0};
+  io_uring_sqe *sqes_{nullptr};
+  size_t sqes_size_{0};
+
+  /// Completion queue ring; may share the submission ring's mapping.
+  void *cq_ring_{nullptr};
+  size_t cq_ring_size_{0};
+  unsigned *cq_head_{nullptr};
+  unsigned *cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe *cqes_{nullptr};
+
+  /// Reads in the submission queue that the kernel hasn't seen yet.
+  unsigned queued_{0};
+  /// Reads the kernel has but hasn't completed.
+  size_t submitted_{0};
+
+  /// Add the read to the submission queue, submitting first if it's full.
+  void queue(Read &read);
+
+  /**
+   * @brief Hand queued reads to the kernel.
+   * @param wait Also wait for at least one completion.
+   */
+  void enter(bool wait);
+
+  /// Resume the coroutines of completed reads.
+  void reap();
+
+  void unmap();
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,207 @@
+#include "Iterator.h"
+#include "ReadResolver.h"
+#include <algorithm>
+#include <functional>
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+namespace lsm_storage_engine {
+
+Iterator::Iterator(std::vector<std::unique_ptr<InternalIterator>> sources,
+                   std::shared_ptr<const Version> version,
+                   std::shared_ptr<const MergeOperator> merge_operator,
+                   ReadOptions options)
+    : sources_(std::move(sources)), version_(std::move(version)),
+      merge_operator_(std::move(merge_operator)),
+      options_(std::move(options)),
+      sequence_(options_.snapshot ? options_.snapshot->sequence
+                                  : kMaxSequenceNumber) {}
+
+bool Iterator::heap_after(size_t a, size_t b) const {
+  const auto &key_a = sources_[a]->key();
+  const auto &key_b = sources_[b]->key();
+  return direction_ == Direction::Forward ? key_a > key_b : key_a < key_b;
+}
+
+void Iterator::rebuild_heap() {
+  heap_.clear();
+  for (size_t i = 0; i < sources_.size(); ++i) {
+    if (sources_[i]->valid()) {
+      heap_.push_back(i);
+    }
+  }
+  std::ranges::make_heap(
+      heap_, [this](size_t a, size_t b) { return heap_after(a, b); });
+}
+
+bool Iterator::in_bounds(std::string_view key) const {
+  return (!options_.lower_bound || key >= *options_.lower_bound) &&
+         (!options_.upper_bound || key < *options_.upper_bound);
+}
+
+void Iterator::check_errors() const {
+  for (const auto &source : sources_) {
+    if (const auto &error = source->error()) {
+      throw std::runtime_error("Failed to read SSTable during scan: " +
+                               error->message + " " + error->path.string());
+    }
+  }
+}
+
+std::optional<std::string>
+Iterator::resolve(const std::string &key, std::vector<Entry> &versions) const {
+  // The newest range delete over the key hides every older version.
+  std::optional<SequenceNumber> range_seq;
+  for (const auto &source : sources_) {
+    auto seq = source->range_tombstones().covering_seq(key, sequence_);
+    if (seq && (!range_seq || *seq > *range_seq)) {
+      range_seq = seq;
+    }
+  }
+
+  std::ranges::sort(versions, std::ranges::greater{}, &Entry::seq);
+  ReadResolver read;
+  for (auto &version : versions) {
+    if (version.seq > sequence_) {
+      continue;
+    }
+    if ((range_seq && version.seq < *range_seq) ||
+        read.add(std::move(version))) {
+      break;
+    }
+  }
+  if (!read.settled() && range_seq) {
+    read.add(Entry::tombstone());
+  }
+  return read.finish(key, merge_operator_.get());
+}
+
+void Iterator::find_visible() {
+  auto after = [this](size_t a, size_t b) { return heap_after(a, b); };
+  valid_ = false;
+  std::vector<Entry> versions;
+  while (!heap_.empty()) {
+    std::string key = sources_[heap_.front()]->key();
+    if (!in_bounds(key)) {
+      // Sources never start before the bound they're scanning towards, so
+      // this is the far end of the range.
+      break;
+    }
+
+    // Take every version of this key off the heap, stepping each source
+    // past it and putting it back.
+    versions.clear();
+    while (!heap_.empty() && sources_[heap_.front()]->key() == key) {
+      std::ranges::pop_heap(heap_, after);
+      auto i = heap_.back();
+      heap_.pop_back();
+      versions.push_back(sources_[i]->entry());
+      if (direction_ == Direction::Forward) {
+        sources_[i]->next();
+      } else {
+        sources_[i]->prev();
+      }
+      if (sources_[i]->valid()) {
+        heap_.push_back(i);
+        std::ranges::push_heap(heap_, after);
+      }
+    }
+    check_errors();
+
+    if (auto value = resolve(key, versions)) {
+      key_ = std::move(key);
+      value_ = std::move(*value);
+      valid_ = true;
+      return;
+    }
+  }
+  check_errors();
+}
+
+void Iterator::seek_to_first() {
+  if (options_.lower_bound) {
+    seek(*options_.lower_bound);
+    return;
+  }
+  direction_ = Direction::Forward;
+  for (auto &source : sources_) {
+    source->seek_to_first();
+  }
+  rebuild_heap();
+  find_visible();
+}
+
+void Iterator::seek_to_last() {
+  direction_ = Direction::Backward;
+  for (auto &source : sources_) {
+    if (options_.upper_bound) {
+      source->seek_before(*options_.upper_bound);
+    } else {
+      source->seek_to_last();
+    }
+  }
+  rebuild_heap();
+  find_visible();
+}
+
+void Iterator::seek(std::string_view target) {
+  if (options_.lower_bound && target < *options_.lower_bound) {
+    target = *options_.lower_bound;
+  }
+  direction_ = Direction::Forward;
+  for (auto &source : sources_) {
+    source->seek(target);
+  }
+  rebuild_heap();
+  find_visible();
+}
+
+void Iterator::seek_for_prev(std::string_view target) {
+  if (options_.upper_bound && target >= *options_.upper_bound) {
+    seek_to_last();
+    return;
+  }
+  direction_ = Direction::Backward;
+  for (auto &source : sources_) {
+    source->seek(target);
+    if (!source->valid() || source->key() != target) {
+      source->seek_before(target);
+    }
+  }
+  rebuild_heap();
+  find_visible();
+}
+
+void Iterator::next() {
+  if (!valid_) {
+    return;
+  }
+  if (direction_ == Direction::Backward) {
+    // Sources sit before key_; move every one to the first key after it.
+    for (auto &source : sources_) {
+      source->seek(key_);
+      if (source->valid() && source->key() == key_) {
+        source->next();
+      }
+    }
+    direction_ = Direction::Forward;
+    rebuild_heap();
+  }
+  find_visible();
+}
+
+void Iterator::prev() {
+  if (!valid_) {
+    return;
+  }
+  if (direction_ == Direction::Forward) {
+    // Sources sit after key_; move every one to the last key before it.
+    for (auto &source : sources_) {
+      source->seek_before(key_);
+    }
+    direction_ = Direction::Backward;
+    rebuild_heap();
+  }
+  find_visible();
+}
+} // namespace lsm_storage_engine
@@ -0,0 +1,118 @@
+#pragma once
+#include "Constants.h"
+#include "InternalIterator.h"
+#include "MergeOperator.h"
+#include "Snapshot.h"
+#include "Version.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Options for a range scan.
+ */
+struct ReadOptions {
+  /// Inclusive lower key bound. Unset to start at the first key.
+  std::optional<std::string> lower_bound;
+  /// Exclusive upper key bound. Unset to run to the last key.
+  std::optional<std::string> upper_bound;
+  /// Bytes of SSTable data to prefetch ahead of the scan; 0 for none.
+  size_t readahead_size{lsm_constants::kScanReadahead};
+  /// Read as of this snapshot. Unset to read the latest data (for a scan,
+  /// as of the iterator's creation).
+  std::optional<Snapshot> snapshot;
+};
+
+/**
+ * @brief Ordered, bidirectional view over the memtable and every SSTable.
+ *
+ * Sources are merged through a heap keyed on each source's current key, so
+ * a step costs O(log sources). When several sources hold the same key the
+ * newest (by sequence number) wins: tombstones and range tombstones hide the
+ * key, and merge operands are folded into the value beneath them. Only live
+ * keys inside the bounds are ever returned.
+ *
+ * The iterator sees the data as of its creation: it holds a copy of the
+ * memtable's entries in range and a reference to the SSTable version, so
+ * later writes and compactions don't affect it.
+ *
+ * Not thread-safe. Throws std::runtime_error if an SSTable read fails.
+ */
+class Iterator {
+public:
+  /**
+   * @param sources Cursors over each source, newest first.
+   * @param version Keeps the SSTables behind `sources` alive.
+   * @param merge_operator Folds merge operands; may be null if there are
+   *        none.
+   * @param options Bounds and snapshot for the scan.
+   */
+  Iterator(std::vector<std::unique_ptr<InternalIterator>> sources,
+           std::shared_ptr<const Version> version,
+           std::shared_ptr<const MergeOperator> merge_operator,
+           ReadOptions options);
+
+  bool valid() const { return valid_; }
+
+  /// Position at the first key in range.
+  void seek_to_first();
+  /// Position at the last key in range.
+  void seek_to_last();
+  /// Position at the first key >= target.
+  void seek(std::string_view target);
+  /// Position at the last key <= target.
+  void seek_for_prev(std::string_view target);
+  void next();
+  void prev();
+
+  /// Only while valid().
+  const std::string &key() const { return key_; }
+  const std::string &value() const { return value_; }
+
+private:
+  enum class Direction { Forward, Backward };
+
+  std::vector<std::unique_ptr<InternalIterator>> sources_;
+  std::shared_ptr<const Version> version_;
+  std::shared_ptr<const MergeOperator> merge_operator_;
+  ReadOptions options_;
+  /// Versions newer than this are invisible to the scan.
+  SequenceNumber sequence_;
+
+  /// Indices into sources_ of the valid ones, as a heap on their keys:
+  /// smallest on top going forward, largest going backward.
+  std::vector<size_t> heap_;
+  Direction direction_{Direction::Forward};
+
+  bool valid_{false};
+  std::string key_;
+  std::string value_;
+
+  /// Heap order for the current direction (std heaps keep the max on top).
+  bool heap_after(size_t a, size_t b) const;
+  void rebuild_heap();
+
+  /**
+   * @brief Step to the next live key in the current direction, starting
+   * from the sources' current positions.
+   */
+  void find_visible();
+
+  /**
+   * @brief Newest-wins resolution of `key` across all sources, as of the
+   * scan's sequence.
+   * @param versions Every source's versions of `key`, in any order.
+   * @return The value, or std::nullopt if the key is deleted.
+   */
+  std::optional<std::string> resolve(const std::string &key,
+                                     std::vector<Entry> &versions) const;
+
+  bool in_bounds(std::string_view key) const;
+
+  /// Throw if any source hit an I/O error.
+  void check_errors() const;
+};
+} // namespace lsm_storage_engine
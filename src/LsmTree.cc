@@ -3,104 +3,722 @@
 #include "MemTable.h"
 #include "SSTable.h"
 #include "StorageError.h"
+#include "RangeTombstones.h"
+#include "ReadResolver.h"
+#include "SSTableIterator.h"
+#include "Snapshot.h"
+#include "utils/FileSync.h"
+#include "utils/Partition.h"
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <expected>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <linux/fs.h>
+#include <memory>
 #include <mutex>
+#include <numeric>
 #include <optional>
 #include <ranges>
 #include <shared_mutex>
 #include <stdexcept>
+#include <sys/ioctl.h>
+#include <thread>
 #include <unistd.h>
+#include <utility>
 namespace lsm_storage_engine {
-std::optional<std::string> LsmTree::get(const std::string_view key) {
+
+/**
+ * Copy the table at `from` to a new file at `to`, as a reflink sharing its
+ * blocks where the filesystem supports that.
+ */
+static std::expected<void, StorageError>
+copy_table(const std::filesystem::path &from, const std::filesystem::path &to) {
+  int in = ::open(from.c_str(), O_RDONLY);
+  if (in == -1) {
+    return std::unexpected(StorageError::file_open(from));
+  }
+  int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (out == -1) {
+    ::close(in);
+    return std::unexpected(StorageError::file_open(to));
+  }
+  bool cloned = ::ioctl(out, FICLONE, in) == 0;
+  ::close(in);
+  ::close(out);
+  if (!cloned) {
+    std::error_code error;
+    std::filesystem::copy_file(
+        from, to, std::filesystem::copy_options::overwrite_existing, error);
+    if (error) {
+      return std::unexpected(StorageError::file_write(to));
+    }
+  }
+  return {};
+}
+
+/**
+ * What the manifest records about `sst` at `level`.
+ */
+static FileMeta file_meta(const SSTable &sst, int level) {
+  return FileMeta{
+      .name = sst.path().filename().string(),
+      .level = level,
+      .min_key = sst.header().min_key,
+      .max_key = sst.header().max_key,
+      .max_sequence = sst.header().max_sequence,
+      .file_size = sst.file_size(),
+  };
+}
+
+/**
+ * Feed a table's versions of a key that a read at `snapshot` can see to
+ * `read`, newest first, until one settles the key. `lookup(snapshot)` looks
+ * the key up in the table. Merge operands lower `snapshot` past themselves,
+ * so the next lookup finds what's beneath. Like a missing key, a table that
+ * can't be read doesn't hold the key.
+ */
+template <typename Lookup>
+static void read_versions(Lookup lookup, SequenceNumber &snapshot,
+                          ReadResolver &read) {
+  while (!read.settled()) {
+    auto res = lookup(snapshot);
+    // Check the expected and the optional!!!
+    if (!res || !res->has_value()) {
+      return;
+    }
+    auto seq = (*res)->seq;
+    if (read.add(std::move(**res)) || seq == 0) {
+      return;
+    }
+    snapshot = seq - 1;
+  }
+}
+
+std::shared_ptr<const Version>
+LsmTree::read_memtable(std::string_view key, SequenceNumber snapshot,
+                       ReadResolver &read, uint64_t &generation) {
+  // Only the memtable needs the lock; the version is immutable.
+  std::shared_lock lock(rwlock_);
+  auto entry = mem_table_.lookup(key, snapshot);
+  if (entry && read.add(std::move(*entry))) {
+    return nullptr;
+  }
+  generation = row_cache_.generation();
+  return version_.load();
+}
+
+void LsmTree::add_table_result(std::string_view key, ReadResolver &tables,
+                               uint64_t generation, ReadResolver &read) {
+  auto value = tables.finish(key, merge_operator_.get());
+  if (value) {
+    row_cache_.insert(key, *value, generation);
+  }
+  read.add(value ? Entry::put(std::move(*value)) : Entry::tombstone());
+}
+
+std::optional<std::string> LsmTree::get(const std::string_view key,
+                                        const ReadOptions &options) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  SequenceNumber snapshot =
+      options.snapshot ? options.snapshot->sequence : kMaxSequenceNumber;
+  // The row cache holds the latest values, so snapshot reads skip it.
+  bool use_cache = !options.snapshot && row_cache_.enabled();
+  ReadResolver read;
+  uint64_t generation{0};
+  auto version = read_memtable(key, snapshot, read, generation);
+  std::optional<std::string> stored;
+  if (version && use_cache) {
+    stored = row_cache_.lookup(key);
+  }
+  if (stored) {
+    read.add(Entry::put(std::move(*stored)));
+  } else if (version) {
+    // With the cache, resolve the tables on their own, so it holds their
+    // value and not one with the memtable's merge operands folded in.
+    ReadResolver tables;
+    auto &target = use_cache ? tables : read;
+    // The newest entry wins; a tombstone means the key was deleted, so older
+    // tables don't count.
+    for (auto &sst : version->tables | std::views::reverse) {
+      read_versions(
+          [&](SequenceNumber at) { return sst->lookup(key, at); }, snapshot,
+          target);
+      if (target.settled()) {
+        break;
+      }
+    }
+    if (use_cache) {
+      add_table_result(key, tables, generation, read);
+    }
+  }
+  auto result = read.finish(key, merge_operator_.get());
+
+  auto end = std::chrono::high_resolution_clock::now();
+  record_get_latency(
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+          .count(),
+      1);
+  return result;
+}
+
+Task<std::optional<std::string>>
+LsmTree::async_get(std::string key, IoRing &ring, ReadOptions options) {
   auto start = std::chrono::high_resolution_clock::now();
 
-  std::optional<std::string> result;
+  // Same steps as get(), except that each table's blocks are read through
+  // the ring. No lock is held across a suspension.
+  SequenceNumber snapshot =
+      options.snapshot ? options.snapshot->sequence : kMaxSequenceNumber;
+  bool use_cache = !options.snapshot && row_cache_.enabled();
+  ReadResolver read;
+  uint64_t generation{0};
+  auto version = read_memtable(key, snapshot, read, generation);
+  std::optional<std::string> stored;
+  if (version && use_cache) {
+    stored = row_cache_.lookup(key);
+  }
+  if (stored) {
+    read.add(Entry::put(std::move(*stored)));
+  } else if (version) {
+    ReadResolver tables;
+    auto &target = use_cache ? tables : read;
+    for (auto &sst : version->tables | std::views::reverse) {
+      // Filter and index are in memory; only the data blocks need I/O.
+      std::vector<std::byte> block;
+      if (auto range = sst->lookup_range(key); range && range->length > 0) {
+        // Held across the read, so the table cache can't close it meanwhile.
+        auto file = sst->pin();
+        if (!file) {
+          continue;
+        }
+        auto bytes =
+            co_await ring.read((*file)->fd, range->offset, range->length);
+        if (!bytes) {
+          continue;
+        }
+        block = std::move(*bytes);
+      }
+      read_versions(
+          [&](SequenceNumber at) { return sst->lookup_in(key, at, block); },
+          snapshot, target);
+      if (target.settled()) {
+        break;
+      }
+    }
+    if (use_cache) {
+      add_table_result(key, tables, generation, read);
+    }
+  }
+  auto result = read.finish(key, merge_operator_.get());
+
+  auto end = std::chrono::high_resolution_clock::now();
+  record_get_latency(
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+          .count(),
+      1);
+  co_return result;
+}
+
+std::vector<std::optional<std::string>>
+LsmTree::multi_get(std::span<const std::string_view> keys,
+                   const ReadOptions &options) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  // Probe in key order, so each table's index and data are walked forward
+  // once for the whole batch.
+  std::vector<size_t> order(keys.size());
+  std::iota(order.begin(), order.end(), size_t{0});
+  std::ranges::sort(order, {}, [&keys](size_t i) { return keys[i]; });
+
+  std::vector<ReadResolver> reads(keys.size());
+  std::shared_ptr<const Version> version;
+  SequenceNumber snapshot{0};
   {
-    // Reads don't block other reads, but block writes.
     std::shared_lock lock(rwlock_);
-    if (auto val = mem_table_.get(key)) {
-      result = *val;
-    } else {
-      for (auto &sst : ss_tables_ | std::views::reverse) {
-        auto res = sst.get(key);
+    // Without a snapshot, read the whole batch as of now, so it is
+    // consistent even if writes land meanwhile.
+    snapshot = options.snapshot ? options.snapshot->sequence : last_sequence_;
+    for (size_t i : order) {
+      if (auto entry = mem_table_.lookup(keys[i], snapshot)) {
+        reads[i].add(std::move(*entry));
+      }
+    }
+    version = version_.load();
+  }
 
-        // Check the expected and the optional!!!
-        if (res && res->has_value()) {
-          result = res.value();
-          break;
-        }
+  // Keys still unsettled, in key order, and where their results go.
+  std::vector<std::string_view> batch;
+  std::vector<size_t> batch_index;
+  for (auto &sst : version->tables | std::views::reverse) {
+    batch.clear();
+    batch_index.clear();
+    for (size_t i : order) {
+      if (!reads[i].settled()) {
+        batch.push_back(keys[i]);
+        batch_index.push_back(i);
       }
     }
+    if (batch.empty()) {
+      break;
+    }
+    // Like get(), a table that can't be read counts as not holding the keys.
+    auto found = sst->multi_lookup(batch, snapshot);
+    if (!found) {
+      continue;
+    }
+    for (size_t j = 0; j < batch.size(); ++j) {
+      auto &entry = (*found)[j];
+      if (!entry) {
+        continue;
+      }
+      auto &read = reads[batch_index[j]];
+      auto seq = entry->seq;
+      if (!read.add(std::move(*entry)) && seq > 0) {
+        // A merge operand; what's beneath may be in the same table.
+        auto beneath = seq - 1;
+        read_versions(
+            [&](SequenceNumber at) { return sst->lookup(batch[j], at); },
+            beneath, read);
+      }
+    }
+  }
+
+  std::vector<std::optional<std::string>> results;
+  results.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    results.push_back(reads[i].finish(keys[i], merge_operator_.get()));
   }
 
   auto end = std::chrono::high_resolution_clock::now();
-  auto duration_us =
+  record_get_latency(
       std::chrono::duration_cast<std::chrono::microseconds>(end - start)
-          .count();
+          .count(),
+      keys.size());
+  return results;
+}
+
+void LsmTree::record_get_latency(long long duration_us, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  // A batch counts as `count` gets of the average latency, so stats and the
+  // rate limiter's latency feedback stay per key.
+  auto n = static_cast<long long>(count);
+  auto per_key_us = duration_us / n;
+  rate_limiter_->record_foreground_latency(per_key_us);
   total_get_time_us_.fetch_add(duration_us, std::memory_order_relaxed);
-  get_count_.fetch_add(1, std::memory_order_relaxed);
+  get_count_.fetch_add(count, std::memory_order_relaxed);
   auto max = max_get_time_us_.load(std::memory_order_relaxed);
-  while (duration_us > max) {
-    if (max_get_time_us_.compare_exchange_weak(max, duration_us,
+  while (per_key_us > max) {
+    if (max_get_time_us_.compare_exchange_weak(max, per_key_us,
                                                std::memory_order_relaxed,
                                                std::memory_order_relaxed))
       break;
   }
+}
 
-  return result;
+Iterator LsmTree::new_iterator(const ReadOptions &options) {
+  std::vector<std::unique_ptr<InternalIterator>> sources;
+  std::shared_ptr<const Version> version;
+  ReadOptions scan_options = options;
+  {
+    // Copy the memtable's slice so the scan doesn't block writers.
+    std::shared_lock lock(rwlock_);
+    if (!scan_options.snapshot) {
+      scan_options.snapshot = Snapshot{last_sequence_};
+    }
+    sources.push_back(std::make_unique<VectorIterator>(
+        mem_table_.scan(options.lower_bound, options.upper_bound,
+                        scan_options.snapshot->sequence),
+        mem_table_.range_tombstones().clip(options.lower_bound.value_or(""),
+                                           options.upper_bound)));
+    version = version_.load();
+  }
+  for (const auto &sst : version->tables | std::views::reverse) {
+    const auto &header = sst->header();
+    if ((options.upper_bound && header.min_key >= *options.upper_bound) ||
+        (options.lower_bound && header.max_key < *options.lower_bound)) {
+      continue;
+    }
+    sources.push_back(std::make_unique<SSTableIterator>(
+        *sst, options.lower_bound, options.upper_bound,
+        options.readahead_size));
+  }
+  return Iterator(std::move(sources), std::move(version), merge_operator_,
+                  std::move(scan_options));
+}
+
+Snapshot LsmTree::get_snapshot() {
+  // The shared lock keeps last_sequence_ still; writers can't have a newer
+  // write half applied.
+  std::shared_lock lock(rwlock_);
+  std::lock_guard snapshot_lock(snapshot_mutex_);
+  snapshots_.insert(last_sequence_);
+  return Snapshot{last_sequence_};
+}
+
+void LsmTree::release_snapshot(const Snapshot &snapshot) {
+  std::lock_guard lock(snapshot_mutex_);
+  if (auto it = snapshots_.find(snapshot.sequence); it != snapshots_.end()) {
+    snapshots_.erase(it);
+  }
+}
+
+std::optional<SequenceNumber> LsmTree::newest_snapshot() const {
+  std::lock_guard lock(snapshot_mutex_);
+  if (snapshots_.empty()) {
+    return std::nullopt;
+  }
+  return *snapshots_.rbegin();
+}
+
+SnapshotList LsmTree::live_snapshots() const {
+  std::lock_guard lock(snapshot_mutex_);
+  return SnapshotList{{snapshots_.begin(), snapshots_.end()}};
 }
 
 std::expected<void, StorageError> LsmTree::flush_memtable() {
+  auto current = version_.load();
+  auto new_table = [&] {
+    return create_table().transform([&](SSTable sst) {
+      // Flushes run under rwlock_, so waiting on the limiter would stall
+      // readers too. They only charge it, and compactions wait in their
+      // place.
+      sst.set_rate_limiter(rate_limiter_.get(), RateLimiter::Priority::Flush,
+                           false);
+      return sst;
+    });
+  };
   auto result =
-      SSTable::create()
-          .and_then([&](SSTable sst) {
-            return update_meta(sst).transform([&] { return std::move(sst); });
-          })
-          .and_then([&](SSTable sst) -> std::expected<SSTable, StorageError> {
-            if (!mem_table_.flush_to_sst(sst)) {
-              return std::unexpected(StorageError::file_write(sst.path()));
+      mem_table_
+          .flush_to_ssts(new_table, options_.load()->target_file_size,
+                         level_boundaries(*current, 1))
+          .and_then([&](std::vector<SSTable> ssts)
+                        -> std::expected<void, StorageError> {
+            auto version = std::make_shared<Version>(*current);
+            // New tables go after the newest, in the manifest as in the
+            // version.
+            VersionEdit edit;
+            edit.last_sequence = last_sequence_;
+            std::string after;
+            if (!current->tables.empty()) {
+              after = current->tables.back()->path().filename().string();
+            }
+            for (auto &sst : ssts) {
+              if (!sst.ensure_mapped()) {
+                return std::unexpected(StorageError::file_write(sst.path()));
+              }
+              if (auto res = sync_path(sst.path()); !res) {
+                return res;
+              }
+              auto meta = file_meta(sst, 0);
+              edit.added.push_back({std::exchange(after, meta.name), meta});
+              version->add(std::make_shared<SSTable>(std::move(sst)), 0);
+            }
+            // The WAL may only go once the manifest lists the tables, and
+            // the manifest may only list them once their names are durable.
+            if (auto res = sync_path(options_.load()->dir); !res) {
+              return res;
+            }
+            if (auto res = manifest_.log(std::move(edit)); !res) {
+              return res;
+            }
+            // The flushed values now shadow what the cache holds.
+            row_cache_.bump_generation();
+            if (mem_table_.range_tombstones().empty()) {
+              mem_table_.for_each_key(
+                  [&](std::string_view key) { row_cache_.erase(key); });
+            } else {
+              row_cache_.clear();
             }
-            return sst;
-          })
-          .and_then([&](SSTable sst) -> std::expected<void, StorageError> {
             mem_table_.clear();
-            if (!wal_.clear()) {
-              return std::unexpected(StorageError::file_write(wal_.path()));
+            if (wal_ && !wal_->clear()) {
+              return std::unexpected(StorageError::file_write(wal_->path()));
             }
-            ss_tables_.push_back(std::move(sst));
+            update_write_debt(*version);
+            version_.store(std::move(version));
             return {};
           });
   return result;
 }
 void LsmTree::put(const std::string &key, const std::string &value) {
-  auto start = std::chrono::high_resolution_clock::now();
+  write(key, Entry::put(value));
+}
 
-  {
+void LsmTree::rm(const std::string &key) { write(key, Entry::tombstone()); }
+
+void LsmTree::delete_range(const std::string &begin, const std::string &end) {
+  if (begin >= end) {
+    return;
+  }
+  write(begin, Entry{EntryType::RangeDelete, end, {}});
+}
+
+void LsmTree::merge(const std::string &key, const std::string &operand) {
+  if (!merge_operator_) {
+    throw std::runtime_error("merge() needs a merge operator!");
+  }
+  write(key, Entry::merge(operand));
+}
+
+void LsmTree::compact() {
+  auto compact_result = maybe_compact();
+  if (!compact_result) {
+    throw std::runtime_error(
+        "Failed to compact SSTs: " + compact_result.error().message + ": " +
+        compact_result.error().path.string());
+  }
+}
+
+void LsmTree::throttle_write() {
+  // A stopped writer helps compact in case nobody else is.
+  write_controller_.wait_while_stopped([this] { compact(); });
+  write_controller_.delay_write();
+}
+
+bool LsmTree::flush_if_full() {
+  if (!mem_table_.should_flush()) {
+    return false;
+  }
+  auto flush_result = flush_memtable();
+  if (!flush_result) {
+    throw std::runtime_error(
+        "Failed to create SST! Error: " + flush_result.error().message + " " +
+        flush_result.error().path.string());
+  }
+  return true;
+}
+
+int LsmTree::ingest_level(const Version &version,
+                          const SSTable::Header &header) {
+  int deepest = 0;
+  for (int l : version.levels) {
+    deepest = std::max(deepest, l);
+  }
+  int level = 0;
+  for (int l = 0; l <= deepest; ++l) {
+    bool overlaps = false;
+    for (size_t i = 0; i < version.tables.size(); ++i) {
+      const auto &table = version.tables[i]->header();
+      overlaps = overlaps ||
+                 (version.levels[i] == l && table.min_key <= header.max_key &&
+                  header.min_key <= table.max_key);
+    }
+    if (overlaps) {
+      break;
+    }
+    level = l;
+  }
+  return level;
+}
+
+void LsmTree::ingest_files(std::span<const std::filesystem::path> files) {
+  if (!wal_) {
+    throw std::runtime_error(
+        "Write to a column family outside its ColumnFamilyDb!");
+  }
+  // Check every file before touching the tree.
+  std::vector<std::pair<std::filesystem::path, SSTable::Header>> inputs;
+  for (const auto &path : files) {
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(path, error)) {
+      throw std::runtime_error("Could not open " + path.string() +
+                               ": not a file");
+    }
+    auto sst = SSTable::open(path);
+    if (!sst) {
+      throw std::runtime_error("Could not open " + path.string() + ": " +
+                               sst.error().message);
+    }
+    if (sst->header().max_sequence != 0) {
+      throw std::invalid_argument(path.string() +
+                                  " wasn't written by an SSTableWriter!");
+    }
+    inputs.emplace_back(path, sst->header());
+  }
+  std::ranges::sort(inputs, {}, [](const auto &input) {
+    return std::string_view{input.second.min_key};
+  });
+  if (std::ranges::adjacent_find(inputs, [](const auto &a, const auto &b) {
+        return b.second.min_key <= a.second.max_key;
+      }) != inputs.end()) {
+    throw std::invalid_argument("Ingested files overlap!");
+  }
 
-    // Lock to ensure these two operations are atomic.
+  auto fail = [](const StorageError &error) {
+    throw std::runtime_error("Failed to ingest files: " + error.message +
+                             " " + error.path.string());
+  };
+  {
+    // No compaction may swap tables out from under the new version, and
+    // no write may be between the WAL and the memtable.
+    std::lock_guard compaction_lock(compaction_mutex_);
+    std::lock_guard queue(wal_mutex_);
+    wait_for_commit(last_assigned_);
     std::unique_lock lock(rwlock_);
-    if (!wal_.write(key, value)) {
-      throw std::runtime_error("Failed to write to WAL!");
+    if (closed_) {
+      throw std::runtime_error("Write to a closed LsmTree!");
     }
-    mem_table_.put(key, value);
-    if (mem_table_.should_flush()) {
-      auto flush_result = flush_memtable();
-      if (!flush_result) {
-        throw std::runtime_error(
-            "Failed to create SST! Error: " + flush_result.error().message +
-            " " + flush_result.error().path.string());
+    // Older writes to the files' keys may not shadow them from the
+    // memtable.
+    if (mem_table_.max_sequence() > 0) {
+      if (auto res = flush_memtable(); !res) {
+        fail(res.error());
       }
     }
-    auto compact_result = maybe_compact();
-    if (!compact_result) {
-      throw std::runtime_error(
-          "Failed to compact SSTs: " + compact_result.error().message + ": " +
-          compact_result.error().path.string());
+    auto seq = ++last_assigned_;
+    last_sequence_ = seq;
+    commit(seq);
+    auto dir = options_.load()->dir;
+    auto current = version_.load();
+    auto version = std::make_shared<Version>(*current);
+    VersionEdit edit;
+    edit.last_sequence = last_sequence_;
+    for (const auto &[source, header] : inputs) {
+      auto path = dir / Manifest::table_name(manifest_.new_file_number());
+      // The tree's copy gets stamped, not the caller's file: no hard link.
+      if (auto res = copy_table(source, path); !res) {
+        fail(res.error());
+      }
+      if (auto res = SSTable::assign_sequence(path, seq); !res) {
+        fail(res.error());
+      }
+      if (auto res = sync_path(path); !res) {
+        fail(res.error());
+      }
+      auto sst = SSTable::open(path, table_options());
+      if (!sst) {
+        fail(sst.error());
+      }
+      // Levels only go down from the oldest table to the newest, and a
+      // compaction's output takes its older input's place. So a file below
+      // level 0 goes after the deeper tables, which it may shadow, and
+      // before the rest, which it doesn't overlap. At the newest place
+      // instead, a pair around it would be merged behind it, and its values
+      // would shadow the pair's newer ones. Level 0 may overlap it, so
+      // there it goes last.
+      auto level = ingest_level(*current, header);
+      auto pos = version->tables.size();
+      if (level > 0) {
+        pos = static_cast<size_t>(
+            std::ranges::find_if(version->levels,
+                                 [&](int l) { return l <= level; }) -
+            version->levels.begin());
+      }
+      auto meta = file_meta(*sst, level);
+      std::string after;
+      if (pos > 0) {
+        after = version->tables[pos - 1]->path().filename().string();
+      }
+      edit.added.push_back({std::move(after), meta});
+      version->insert(pos, std::make_shared<SSTable>(std::move(*sst)), level);
+    }
+    if (auto res = sync_path(dir); !res) {
+      fail(res.error());
+    }
+    if (auto res = manifest_.log(std::move(edit)); !res) {
+      fail(res.error());
     }
+    // The cache holds values the new tables may shadow.
+    row_cache_.bump_generation();
+    row_cache_.clear();
+    update_write_debt(*version);
+    version_.store(std::move(version));
+  }
+  compact();
+}
+
+void LsmTree::wait_for_commit(SequenceNumber seq) {
+  std::unique_lock order(commit_mutex_);
+  commit_cv_.wait(order, [&] { return committed_ >= seq; });
+}
+
+void LsmTree::commit(SequenceNumber seq) {
+  {
+    std::lock_guard order(commit_mutex_);
+    committed_ = seq;
+  }
+  commit_cv_.notify_all();
+}
+
+void LsmTree::flush_when_full() {
+  // Hold new writers back until the ones in flight have reached the
+  // memtable: the flush clears the WAL, so it may hold nothing else.
+  std::lock_guard queue(wal_mutex_);
+  wait_for_commit(last_assigned_);
+  std::unique_lock lock(rwlock_);
+  // Another writer may have flushed first.
+  flush_if_full();
+}
+
+void LsmTree::write(const std::string &key, Entry entry) {
+  if (!wal_) {
+    throw std::runtime_error(
+        "Write to a column family outside its ColumnFamilyDb!");
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+
+  {
+    // Push back before queueing if compaction is behind.
+    throttle_write();
+    // The writer queue: sequence numbers are handed out in WAL order, and
+    // the WAL I/O happens outside rwlock_, so readers never wait on it.
+    {
+      std::lock_guard queue(wal_mutex_);
+      if (closed_) {
+        throw std::runtime_error("Write to a closed LsmTree!");
+      }
+      bool sync = options_.load()->sync_mode == SyncMode::EveryWrite;
+      // Where to cut the log back to if the sync fails. A failed write
+      // cuts itself off (see Wal::write()).
+      std::expected<size_t, StorageError> offset{0};
+      if (sync) {
+        offset = wal_->size();
+      }
+      entry.seq = last_assigned_ + 1;
+      if (!offset || !wal_->write(key, entry)) {
+        throw std::runtime_error("Failed to write to WAL!");
+      }
+      if (sync && !wal_->sync()) {
+        // The caller is told the write failed, so it may neither become
+        // visible nor come back on replay. No sequence number was taken.
+        if (!wal_->truncate(*offset)) {
+          throw std::runtime_error("Failed to sync WAL or undo the write!");
+        }
+        throw std::runtime_error("Failed to sync WAL!");
+      }
+      last_assigned_ = entry.seq;
+    }
+    // The next writer appends meanwhile. Memtables take a key's versions
+    // in sequence order, so wait for the writes before this one.
+    auto seq = entry.seq;
+    wait_for_commit(seq - 1);
+    bool full{false};
+    {
+      // Commits even if applying throws, or every writer queued behind
+      // this one (and flushes and close()) would wait for it forever.
+      struct CommitOnExit {
+        LsmTree &tree;
+        SequenceNumber seq;
+        ~CommitOnExit() { tree.commit(seq); }
+      } committer{*this, seq};
+      std::unique_lock lock(rwlock_);
+      mem_table_.apply(key, std::move(entry), newest_snapshot());
+      // Publish: readers and snapshots see the write from here on.
+      last_sequence_ = seq;
+      full = mem_table_.should_flush();
+    }
+    if (full) {
+      flush_when_full();
+    }
+    // Compaction merges off-lock, so other readers and writers keep going.
+    compact();
   }
 
   auto end = std::chrono::high_resolution_clock::now();
@@ -117,28 +735,144 @@ void LsmTree::put(const std::string &key, const std::string &value) {
       break;
   }
 }
-std::expected<void, StorageError> LsmTree::load_ssts() {
-  if (std::filesystem::exists("lsm.meta")) {
-    std::ifstream metafile{"lsm.meta"};
+void LsmTree::apply_logged(std::vector<KeyEntry> writes) {
+  std::unique_lock lock(rwlock_);
+  if (closed_) {
+    throw std::runtime_error("Write to a closed LsmTree!");
+  }
+  for (auto &[key, entry] : writes) {
+    last_sequence_ = std::max(last_sequence_, entry.seq);
+    mem_table_.apply(std::move(key), std::move(entry), newest_snapshot());
+  }
+}
+
+bool LsmTree::flush_logged(bool force) {
+  std::unique_lock lock(rwlock_);
+  if (!force || mem_table_.max_sequence() == 0) {
+    return flush_if_full();
+  }
+  if (auto res = flush_memtable(); !res) {
+    throw std::runtime_error("Failed to create SST! Error: " +
+                             res.error().message + " " +
+                             res.error().path.string());
+  }
+  return true;
+}
+
+bool LsmTree::memtable_empty() {
+  std::shared_lock lock(rwlock_);
+  return mem_table_.max_sequence() == 0;
+}
+
+SequenceNumber LsmTree::last_sequence() {
+  std::shared_lock lock(rwlock_);
+  return last_sequence_;
+}
+
+std::expected<void, StorageError> LsmTree::migrate_meta() {
+  auto dir = options_.load()->dir;
+  auto meta_path = dir / "lsm.meta";
+  std::vector<FileMeta> files;
+  if (std::filesystem::exists(meta_path)) {
+    // One table file name per line, oldest first, all on level 0.
+    std::ifstream metafile{meta_path};
     std::string line;
     while (std::getline(metafile, line)) {
       if (line.contains(".sst")) {
-        auto result =
-            SSTable::open(std::string(line))
-                .and_then(
-                    [&](SSTable table) -> std::expected<void, StorageError> {
-                      ss_tables_.emplace_back(std::move(table));
-                      return {};
-                    });
-        if (!result) {
-          return std::unexpected{result.error()};
+        auto sst = SSTable::open(dir / line, table_options());
+        if (!sst) {
+          return std::unexpected{sst.error()};
+        }
+        // lsm.meta was never synced, so neither may its tables have been.
+        if (auto res = sync_path(dir / line); !res) {
+          return res;
         }
+        files.push_back(file_meta(*sst, 0));
       }
     }
   }
+  // No clean shutdown is recorded: the WAL is replayed as it always was.
+  if (auto res = manifest_.create(std::move(files), 0); !res) {
+    return res;
+  }
+  std::error_code ec;
+  std::filesystem::remove(meta_path, ec);
   return {};
 }
 
+std::expected<void, StorageError> LsmTree::load_ssts() {
+  auto recovered = manifest_.recover();
+  if (!recovered) {
+    return std::unexpected{recovered.error()};
+  }
+  if (!*recovered) {
+    if (auto res = migrate_meta(); !res) {
+      return res;
+    }
+  }
+  const auto &listed = manifest_.files();
+  auto dir = options_.load()->dir;
+
+  // Opening reads only each table's header and footer, but that's still a
+  // few syscalls and page faults per table: spread them over threads.
+  std::vector<std::expected<SSTable, StorageError>> opened(listed.size());
+  std::atomic<size_t> next{0};
+  auto open_tables = [&] {
+    for (size_t i; (i = next.fetch_add(1)) < listed.size();) {
+      opened[i] = SSTable::open(dir / listed[i].name, table_options());
+    }
+  };
+  size_t threads = std::min<size_t>(
+      {listed.size(), lsm_constants::kTableOpenThreads,
+       std::max(std::thread::hardware_concurrency(), 1U)});
+  {
+    std::vector<std::jthread> pool;
+    for (size_t t = 1; t < threads; ++t) {
+      pool.emplace_back(open_tables);
+    }
+    open_tables();
+  }
+
+  auto version = std::make_shared<Version>();
+  for (size_t i = 0; i < listed.size(); ++i) {
+    if (!opened[i]) {
+      return std::unexpected{opened[i].error()};
+    }
+    version->add(std::make_shared<SSTable>(std::move(*opened[i])),
+                 listed[i].level);
+  }
+  update_write_debt(*version);
+  version_.store(std::move(version));
+  return {};
+}
+
+void LsmTree::update_write_debt(const Version &version) {
+  // No immutable memtables yet: flushes run inline under rwlock_.
+  auto options = options_.load();
+  WriteController::Debt debt{};
+  std::vector<size_t> level_tables;
+  std::vector<size_t> level_bytes;
+  for (size_t i = 0; i < version.tables.size(); ++i) {
+    auto level = static_cast<size_t>(version.levels[i]);
+    if (level >= level_tables.size()) {
+      level_tables.resize(level + 1);
+      level_bytes.resize(level + 1);
+    }
+    ++level_tables[level];
+    level_bytes[level] += version.tables[i]->file_size();
+  }
+  if (!level_tables.empty()) {
+    debt.l0_files = level_tables[0];
+  }
+  for (size_t level = 0; level < level_tables.size(); ++level) {
+    if (level_tables[level] >=
+        level_capacity(static_cast<int>(level), *options)) {
+      debt.pending_compaction_bytes += level_bytes[level];
+    }
+  }
+  write_controller_.update(debt);
+}
+
 LsmTree::Stats LsmTree::stats() const {
   auto get_count = get_count_.load(std::memory_order_relaxed);
   auto put_count = put_count_.load(std::memory_order_relaxed);
@@ -158,139 +892,528 @@ LsmTree::Stats LsmTree::stats() const {
                                        : 0.0,
       .max_put_time_us_ = max_put_us,
       .max_get_time_us_ = max_get_us,
+      .compaction_count = compaction_count_.load(std::memory_order_relaxed),
+      .trivial_move_count = trivial_move_count_.load(std::memory_order_relaxed),
+      .tombstones_dropped = tombstones_dropped_.load(std::memory_order_relaxed),
+      .covered_files_skipped =
+          covered_files_skipped_.load(std::memory_order_relaxed),
+      .startup_time_us = startup_time_us_,
+      .clean_startup = clean_startup_,
   };
 }
-std::expected<void, StorageError> LsmTree::update_meta(SSTable &sstable) {
-  std::ofstream metafile("lsm.meta", std::ios::app);
-  if (!metafile.is_open()) {
-    return std::unexpected(StorageError::file_open("lsm.meta"));
+std::expected<SSTable, StorageError> LsmTree::create_table() {
+  auto sst = SSTable::create(options_.load()->dir /
+                             Manifest::table_name(manifest_.new_file_number()));
+  if (sst) {
+    sst->set_options(table_options());
+  }
+  return sst;
+}
+
+// What do I even name a WAL?
+LsmTree::LsmTree(Options options, bool owns_wal)
+    : options_(prepare(std::move(options))),
+      wal_(owns_wal ? std::make_optional<Wal>(options_.load()->dir / "lsm.wal")
+                    : std::nullopt),
+      merge_operator_(options_.load()->merge_operator),
+      table_cache_(options_.load()->table_cache),
+      manifest_(options_.load()->dir),
+      rate_limiter_(options_.load()->rate_limiter),
+      write_controller_(WriteController::default_limits(
+          options_.load()->compaction_trigger)),
+      row_cache_(options_.load()->row_cache_bytes),
+      read_mode_(options_.load()->read_mode),
+      block_cache_(options_.load()->block_cache) {
+  auto start = std::chrono::steady_clock::now();
+  mem_table_.set_merge_operator(merge_operator_.get());
+  mem_table_.set_flush_threshold(options_.load()->memtable_bytes);
+  if (!load_ssts()) {
+    throw std::runtime_error("Could not load SSTables!");
   }
-  metafile << sstable.path().filename().string() << '\n';
-  if (!metafile.good()) {
-    return std::unexpected(StorageError::file_write("lsm.meta"));
+  // After a clean shutdown everything is in the SSTables. The WAL check
+  // is a guard against a marker left behind by mistake. A column family's
+  // writes are replayed by its ColumnFamilyDb instead.
+  clean_startup_ = manifest_.clean_shutdown() &&
+                   (!wal_ || std::filesystem::file_size(wal_->path()) == 0);
+  if (!clean_startup_ && wal_) {
+    // Restore the memtable from WAL on startup.
+    auto result = mem_table_.restore_from_wal(wal_->path());
+    if (!result) {
+      std::println("{}", result.error().message);
+      throw std::runtime_error("Could not restore state from WAL!");
+    }
+    // Fold replayed operands now, so a missing merge operator shows up
+    // here rather than on some later read.
+    if (!mem_table_.fold_merges()) {
+      throw std::runtime_error(
+          "WAL has merge operands but no merge operator!");
+    }
+  }
+  // Writes are about to go to the WAL again: a crash from here on must
+  // replay it.
+  if (manifest_.clean_shutdown() && !manifest_.log({})) {
+    throw std::runtime_error("Could not write the manifest!");
+  }
+  // Continue the write order from the newest write on disk.
+  last_sequence_ =
+      std::max(mem_table_.max_sequence(), manifest_.last_sequence());
+  for (const auto &sst : version_.load()->tables) {
+    last_sequence_ = std::max(last_sequence_, sst->header().max_sequence);
+  }
+  last_assigned_ = last_sequence_;
+  committed_ = last_sequence_;
+  startup_time_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  //    std::println("LSM constructed! Memtable size: {}B, Num SSTs: {}",
+  //                mem_table_.size(), ss_tables_.size());
+}
+
+LsmTree::~LsmTree() {
+  try {
+    close();
+  } catch (const std::exception &) {
+    // Destructors don't throw. The WAL still has whatever didn't make it and
+    // no clean shutdown is logged, so the next open replays it.
   }
-  return {};
 }
 
-static void cleanup_sst_files(std::vector<SSTable> &ss_tables) {
-  for (auto &sst : ss_tables) {
-    if (sst.marked_for_delete_) {
-      std::filesystem::remove(sst.path());
+void LsmTree::close() {
+  // No compaction may be logging to the manifest after the marker, nor
+  // any write be on its way to the memtable.
+  std::lock_guard compaction_lock(compaction_mutex_);
+  std::lock_guard queue(wal_mutex_);
+  wait_for_commit(last_assigned_);
+  std::unique_lock lock(rwlock_);
+  if (closed_) {
+    return;
+  }
+  auto fail = [](const StorageError &error) {
+    throw std::runtime_error("Failed to close LsmTree: " + error.message +
+                             " " + error.path.string());
+  };
+  if (mem_table_.max_sequence() > 0) {
+    if (auto res = flush_memtable(); !res) {
+      fail(res.error());
     }
   }
+  // Tables are synced before the manifest lists them, so only the WAL is
+  // left to sync before the marker says it isn't needed.
+  if (wal_) {
+    if (auto res = wal_->sync(); !res) {
+      fail(res.error());
+    }
+  }
+  VersionEdit shutdown;
+  shutdown.last_sequence = last_sequence_;
+  shutdown.clean_shutdown = true;
+  if (auto res = manifest_.log(std::move(shutdown)); !res) {
+    fail(res.error());
+  }
+  closed_ = true;
 }
 
-std::expected<void, StorageError> LsmTree::maybe_compact() {
-  // some random number for testing
-  // TODO: come up with a real compaction trigger
-  if (ss_tables_.size() < 4) {
-    return {};
+size_t LsmTree::level_capacity(int level, const Options &options) {
+  auto capacity = std::max<size_t>(options.compaction_trigger, 1);
+  auto multiplier = std::max<size_t>(options.level_size_multiplier, 1);
+  for (int l = 0; l < level; ++l) {
+    // Saturate rather than wrap on deep levels.
+    if (capacity > std::numeric_limits<size_t>::max() / multiplier) {
+      return std::numeric_limits<size_t>::max();
+    }
+    capacity *= multiplier;
+  }
+  return capacity;
+}
+
+std::shared_ptr<const Options> LsmTree::prepare(Options options) {
+  std::filesystem::create_directories(options.dir);
+  options.create_shared();
+  return std::make_shared<const Options>(std::move(options));
+}
+
+void LsmTree::set_options(const Options &options) {
+  auto current = options_.load();
+  if (options.dir != current->dir ||
+      options.merge_operator != current->merge_operator ||
+      options.read_mode != current->read_mode ||
+      options.block_cache != current->block_cache ||
+      options.table_cache != current->table_cache ||
+      options.rate_limiter != current->rate_limiter ||
+      options.row_cache_bytes != current->row_cache_bytes) {
+    throw std::invalid_argument(
+        "Only tuning options can change on an open LsmTree!");
+  }
+  std::unique_lock lock(rwlock_);
+  mem_table_.set_flush_threshold(options.memtable_bytes);
+  options_.store(std::make_shared<const Options>(options));
+  // Level 0 may now be allowed more tables before compacting: writers must
+  // not be stopped short of it.
+  write_controller_.set_limits(
+      WriteController::default_limits(options.compaction_trigger));
+}
+
+/**
+ * Two tables overlap if their [min_key, max_key] ranges intersect.
+ */
+static bool overlaps(const SSTable &a, const SSTable &b) {
+  return !(a.header().max_key < b.header().min_key ||
+           b.header().max_key < a.header().min_key);
+}
+
+std::vector<std::string> LsmTree::level_boundaries(const Version &version,
+                                                   int level) {
+  std::vector<std::string> boundaries;
+  for (size_t i = 0; i < version.tables.size(); ++i) {
+    if (version.levels[i] == level) {
+      boundaries.push_back(version.tables[i]->header().max_key);
+    }
+  }
+  std::ranges::sort(boundaries);
+  return boundaries;
+}
+
+std::expected<std::vector<SSTable>, StorageError>
+LsmTree::merge_tables(SSTable &left_table, SSTable &right_table,
+                      const std::vector<std::shared_ptr<SSTable>> &older,
+                      const SnapshotList &snapshots,
+                      const std::vector<std::string> &boundaries) {
+  for (const auto *table : {&left_table, &right_table}) {
+    if (auto res = table->load_metadata(); !res) {
+      return std::unexpected{res.error()};
+    }
   }
-  std::vector<SSTable> new_ssts;
-  for (size_t i = 0; i + 1 < ss_tables_.size(); i += 2) {
-    // Make a new sst
-    auto sst = SSTable::create();
+  const auto &left_ranges = left_table.range_tombstones();
+  const auto &right_ranges = right_table.range_tombstones();
+  // Every key in the older table was deleted by the newer one, as every
+  // reader sees it: don't even read it.
+  bool skip_left =
+      right_ranges.covers(left_table.header().min_key,
+                          left_table.header().max_key, snapshots.oldest());
+  if (skip_left) {
+    covered_files_skipped_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Range tombstones carry over while an older table may still hold keys in
+  // their range, or while a snapshot may still read what they hide. Without
+  // snapshots, only the newest delete over a fragment matters.
+  RangeTombstoneList ranges;
+  for (const auto *list : {skip_left ? nullptr : &left_ranges, &right_ranges}) {
+    if (list == nullptr) {
+      continue;
+    }
+    for (const auto &[begin, end, seqs] : list->fragments()) {
+      if (!snapshots.empty()) {
+        for (auto seq : seqs) {
+          ranges.add(begin, end, seq);
+        }
+      } else if (std::ranges::any_of(older, [&](const auto &sst) {
+                   return !(sst->header().max_key < begin) &&
+                          sst->header().min_key < end;
+                 })) {
+        ranges.add(begin, end, seqs.front());
+      }
+    }
+  }
+
+  bool missing_merge_operator = false;
+  // Stack a merge operand on top of an older version of the same key.
+  auto merge_onto = [&](const std::string &key, Entry &newer,
+                        const Entry &beneath) {
+    if (!merge_operator_) {
+      missing_merge_operator = true;
+      return;
+    }
+    newer = apply_merge(*merge_operator_, key, beneath, newer);
+  };
+  auto nothing_older = [&](const std::string &key) {
+    return std::ranges::none_of(
+        older, [&](const auto &sst) { return sst->may_contain(key); });
+  };
+
+  std::vector<KeyEntry> all_entries;
+  std::vector<Entry> kept;
+  // Keep the newest of a key's versions in each snapshot stripe; no reader
+  // can tell the older ones apart from it. Range deletes over the key take
+  // part as versions of their own, so they hide what's beneath them.
+  auto emit = [&](const std::string &key, std::vector<Entry> &versions) {
+    for (const auto *list :
+         {skip_left ? nullptr : &left_ranges, &right_ranges}) {
+      if (list == nullptr) {
+        continue;
+      }
+      for (auto seq : list->covering(key)) {
+        versions.push_back(Entry{EntryType::RangeDelete, {}, {}, seq});
+      }
+    }
+    std::ranges::stable_sort(versions, std::ranges::greater{}, &Entry::seq);
+
+    kept.clear();
+    for (auto &version : versions) {
+      if (kept.empty() ||
+          snapshots.stripe(version.seq) != snapshots.stripe(kept.back().seq)) {
+        kept.push_back(std::move(version));
+      } else if (kept.back().type == EntryType::Merge) {
+        merge_onto(key, kept.back(), version);
+      }
+    }
+    // A tombstone only has to outlive the values it shadows. Once no older
+    // table can hold the key, drop it along with the value it replaced.
+    // Likewise a merge operand with nothing beneath becomes a plain value.
+    if (nothing_older(key)) {
+      while (!kept.empty()) {
+        auto &oldest = kept.back();
+        if (oldest.type == EntryType::Merge) {
+          merge_onto(key, oldest, Entry::tombstone());
+          break;
+        }
+        if (!oldest.is_tombstone() && oldest.type != EntryType::RangeDelete) {
+          break;
+        }
+        if (oldest.is_tombstone()) {
+          tombstones_dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        kept.pop_back();
+      }
+    }
+    for (auto &version : kept) {
+      if (version.type != EntryType::RangeDelete) {
+        all_entries.emplace_back(key, std::move(version));
+      }
+    }
+  };
+
+  left_table.rewind();
+  right_table.rewind();
+  // Both inputs are read front to back once; lookups keep reading them
+  // until the result is installed, so they go back to random afterwards.
+  left_table.advise(SSTable::Access::Sequential);
+  right_table.advise(SSTable::Access::Sequential);
+  std::expected<std::optional<KeyEntry>, StorageError> lhs = std::nullopt;
+  if (!skip_left) {
+    lhs = left_table.next();
+  }
+  auto rhs = right_table.next();
+  std::vector<Entry> versions;
+  while ((lhs && rhs) && (lhs->has_value() || rhs->has_value())) {
+    std::string key;
+    if (!lhs->has_value()) {
+      key = rhs->value().first;
+    } else if (!rhs->has_value()) {
+      key = lhs->value().first;
+    } else {
+      key = std::min(lhs->value().first, rhs->value().first);
+    }
+    // Every version of the key, newer table first.
+    versions.clear();
+    while (rhs && rhs->has_value() && rhs->value().first == key) {
+      versions.push_back(std::move(rhs->value().second));
+      rhs = right_table.next();
+    }
+    while (lhs && lhs->has_value() && lhs->value().first == key) {
+      versions.push_back(std::move(lhs->value().second));
+      lhs = left_table.next();
+    }
+    emit(key, versions);
+  }
+  left_table.advise(SSTable::Access::Random);
+  right_table.advise(SSTable::Access::Random);
+  if (!lhs) {
+    return std::unexpected{lhs.error()};
+  }
+  if (!rhs) {
+    return std::unexpected{rhs.error()};
+  }
+  if (missing_merge_operator) {
+    return std::unexpected{StorageError::missing_merge_operator()};
+  }
+
+  if (all_entries.empty() && ranges.empty()) {
+    // Everything was deleted.
+    return std::vector<SSTable>{};
+  }
+
+  // Cut the merged run into files of about target_file_size, so a later
+  // compaction of a small key range doesn't have to rewrite a huge table.
+  auto cuts =
+      partition_entries(all_entries.cbegin(), all_entries.cend(),
+                        options_.load()->target_file_size, boundaries);
+  cuts.push_back(all_entries.cend());
+
+  std::vector<SSTable> outputs;
+  auto first = all_entries.cbegin();
+  for (auto last : cuts) {
+    auto sst = create_table();
     if (!sst) {
       return std::unexpected(sst.error());
     }
-    SSTable &left_table = ss_tables_[i];
-    SSTable &right_table = ss_tables_[i + 1];
-    auto min_key = left_table.header().min_key < right_table.header().min_key
-                       ? left_table.header().min_key
-                       : right_table.header().min_key;
-    auto max_key = left_table.header().max_key > right_table.header().max_key
-                       ? left_table.header().max_key
-                       : right_table.header().max_key;
-    SSTable::Header header{min_key, max_key};
-    if (auto res = sst.value().write_header(std::move(header)); !res) {
+    sst->set_rate_limiter(rate_limiter_.get(),
+                          RateLimiter::Priority::Compaction);
+    // Each output carries the range tombstones between its first key and the
+    // next output's.
+    std::string_view lower =
+        outputs.empty() ? "" : std::string_view{first->first};
+    std::optional<std::string_view> upper;
+    if (last != all_entries.cend()) {
+      upper = last->first;
+    }
+    if (auto res = sst->write_sorted(first, last, ranges.clip(lower, upper));
+        !res) {
+      return std::unexpected{res.error()};
+    }
+    if (auto res = sst->ensure_mapped(); !res) {
       return std::unexpected{res.error()};
     }
-    size_t bytes_written{sst->header().size};
-
-    // First pass: collect all keys for the bloom filter and count entries
-    std::vector<std::pair<std::string, std::string>> all_entries;
-    auto lhs = left_table.next();
-    auto rhs = right_table.next();
-    while ((lhs && rhs) && (lhs->has_value() || rhs->has_value())) {
-      if (!lhs->has_value() && rhs->has_value()) {
-        all_entries.emplace_back(rhs->value());
-        rhs = right_table.next();
-      } else if (!rhs->has_value() && lhs->has_value()) {
-        all_entries.emplace_back(lhs->value());
-        lhs = left_table.next();
-      } else if (lhs->value().first < rhs->value().first) {
-        all_entries.emplace_back(lhs->value());
-        lhs = left_table.next();
-      } else if (rhs->value().first < lhs->value().first) {
-        all_entries.emplace_back(rhs->value());
-        rhs = right_table.next();
-      } else {
-        // Keys are equal - keep the newer value (rhs)
-        all_entries.emplace_back(rhs->value());
-        lhs = left_table.next();
-        rhs = right_table.next();
-      }
-    }
-
-    size_t bf_size = all_entries.size();
-    BloomFilter bloom_filter{bf_size};
-    for (const auto &[key, val] : all_entries) {
-      bloom_filter.add(std::string_view{key});
-    }
-    auto bf_res = sst->write_bloom_filter(std::move(bloom_filter));
-    if (!bf_res) {
-      return std::unexpected{bf_res.error()};
-    }
-    bytes_written += bf_res.value();
-
-    // Second pass: write all entries
-    size_t entry_count{0};
-    for (const auto &[key, val] : all_entries) {
-      auto write_res = sst->write_entry(key, val);
-      if (!write_res) {
-        return std::unexpected{write_res.error()};
-      }
-      if (entry_count % lsm_constants::kIndexSpace == 0) {
-        sst->index().emplace_back(std::string{key}, bytes_written);
-      }
-      bytes_written += write_res.value();
-      entry_count++;
-    }
-    left_table.marked_for_delete_ = true;
-    right_table.marked_for_delete_ = true;
-
-    SSTable::Footer footer;
-    footer.index_offset = bytes_written;
-    auto idx_res = sst->write_index();
-    if (!idx_res) {
-      return std::unexpected{idx_res.error()};
-    }
-    footer.index_size = idx_res.value();
-    footer.num_index_entries = sst->index().size();
-
-    if (auto res = sst.value().write_footer(footer); !res) {
+    if (auto res = sync_path(sst->path()); !res) {
       return std::unexpected{res.error()};
     }
-    new_ssts.push_back(std::move(sst.value()));
+    outputs.push_back(std::move(sst.value()));
+    first = last;
   }
-  if (ss_tables_.size() % 2 == 1) {
-    new_ssts.push_back(std::move(ss_tables_.back()));
-    ss_tables_.pop_back();
+  return outputs;
+}
+
+std::expected<void, StorageError> LsmTree::maybe_compact() {
+  // One compaction at a time. A writer that finds one running just moves on;
+  // the running compaction loops until every level is under capacity.
+  std::unique_lock compaction_lock(compaction_mutex_, std::try_to_lock);
+  if (!compaction_lock.owns_lock()) {
+    return {};
   }
-  cleanup_sst_files(ss_tables_);
-  ss_tables_ = std::move(new_ssts);
+  // Compacting one level can fill up the next, so keep going until every
+  // level is under capacity.
+  for (int level = 0;; ++level) {
+    // Only this thread replaces tables, so the picked ones stay live even if
+    // flushes install newer versions meanwhile.
+    auto base = version_.load();
+    auto options = options_.load();
+    std::vector<std::shared_ptr<SSTable>> picked;
+    int max_level = 0;
+    for (size_t i = 0; i < base->tables.size(); ++i) {
+      max_level = std::max(max_level, base->levels[i]);
+      if (base->levels[i] == level) {
+        picked.push_back(base->tables[i]);
+      }
+    }
+    if (level > max_level) {
+      break;
+    }
+    // Deeper levels hold more tables, so trivially moved tables (which don't
+    // shrink the table count) can't cascade all the way down.
+    if (picked.size() < level_capacity(level, *options)) {
+      continue;
+    }
 
-  std::filesystem::resize_file("lsm.meta", 0);
+    // Tables in a level are ordered oldest to newest. Pair them up and push
+    // each pair one level down; an odd table out (the newest) stays put.
+    auto boundaries = level_boundaries(*base, level + 1);
+    // A snapshot taken from here on sees the newest version of every key,
+    // which compaction always keeps.
+    auto snapshots = live_snapshots();
+    std::vector<CompactionEdit> edits;
+    for (size_t p = 0; p + 1 < picked.size(); p += 2) {
+      auto &left_table = picked[p];
+      auto &right_table = picked[p + 1];
+      if (!overlaps(*left_table, *right_table)) {
+        // Trivial move: disjoint key ranges means the merge would just
+        // concatenate the two files, so only their level changes.
+        edits.push_back({.inputs = {left_table, right_table},
+                         .outputs = {left_table, right_table}});
+        trivial_move_count_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
 
-  for (auto &sst : ss_tables_) {
-    auto res = update_meta(sst);
-    if (!res) {
+      // Everything positioned before the newer input may hold older data
+      // for its keys, which its tombstones must keep shadowing.
+      std::vector<std::shared_ptr<SSTable>> older;
+      for (const auto &sst : base->tables) {
+        if (sst == right_table) {
+          break;
+        }
+        if (sst != left_table) {
+          older.push_back(sst);
+        }
+      }
+      auto merged = merge_tables(*left_table, *right_table, older,
+                                 snapshots, boundaries);
+      if (!merged) {
+        return std::unexpected(merged.error());
+      }
+      CompactionEdit edit{.inputs = {left_table, right_table}, .outputs = {}};
+      for (auto &sst : merged.value()) {
+        edit.outputs.push_back(std::make_shared<SSTable>(std::move(sst)));
+      }
+      edits.push_back(std::move(edit));
+      compaction_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (auto res = install_compaction(edits, level + 1); !res) {
       return std::unexpected(res.error());
     }
   }
   return {};
 }
 
-// TODO
-void LsmTree::rm(const std::string &) {}
+std::expected<void, StorageError>
+LsmTree::install_compaction(const std::vector<CompactionEdit> &edits,
+                            int output_level) {
+  std::unique_lock lock(rwlock_);
+  // Rebuild from the latest version, not the compaction's base: flushes may
+  // have appended tables since. Outputs take the place of their inputs.
+  auto current = version_.load();
+  std::vector<FileMeta> before;
+  for (size_t i = 0; i < current->tables.size(); ++i) {
+    before.push_back(file_meta(*current->tables[i], current->levels[i]));
+  }
+  auto version = std::make_shared<Version>();
+  for (size_t i = 0; i < current->tables.size(); ++i) {
+    const auto &sst = current->tables[i];
+    auto edit = std::ranges::find_if(edits, [&](const CompactionEdit &e) {
+      return std::ranges::find(e.inputs, sst) != e.inputs.end();
+    });
+    if (edit == edits.end()) {
+      version->add(sst, current->levels[i]);
+    } else if (edit->inputs.front() == sst) {
+      // A moved table keeps its level in `current`, which readers and
+      // compaction may still be walking.
+      for (const auto &out : edit->outputs) {
+        version->add(out, output_level);
+      }
+    }
+  }
+  std::vector<FileMeta> after;
+  for (size_t i = 0; i < version->tables.size(); ++i) {
+    after.push_back(file_meta(*version->tables[i], version->levels[i]));
+  }
+
+  // Make the swap durable before anyone sees it: the outputs' names have to
+  // be on disk before the manifest lists them, and the inputs may only go
+  // once it no longer does. Until then the tree stays on `current`.
+  auto logged = sync_path(options_.load()->dir);
+  if (logged) {
+    logged = manifest_.log(VersionEdit::diff(before, after));
+  }
+  if (!logged) {
+    for (const auto &edit : edits) {
+      for (const auto &out : edit.outputs) {
+        if (std::ranges::find(edit.inputs, out) == edit.inputs.end()) {
+          out->mark_obsolete();
+        }
+      }
+    }
+    return logged;
+  }
+  for (const auto &edit : edits) {
+    for (const auto &in : edit.inputs) {
+      if (std::ranges::find(edit.outputs, in) == edit.outputs.end()) {
+        // Deleted once the last reader drops its version. Until then its
+        // pages would only push hot data out of the page cache.
+        in->mark_obsolete();
+        in->release(0, in->file_size());
+      }
+    }
+  }
+  update_write_debt(*version);
+  version_.store(std::move(version));
+  return {};
+}
 } // namespace lsm_storage_engine
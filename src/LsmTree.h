@@ -1,12 +1,33 @@
 #pragma once
+#include "BlockCache.h"
+#include "Entry.h"
+#include "IoRing.h"
+#include "Iterator.h"
+#include "Manifest.h"
 #include "MemTable.h"
+#include "MergeOperator.h"
+#include "Options.h"
+#include "RateLimiter.h"
+#include "ReadResolver.h"
+#include "RowCache.h"
 #include "SSTable.h"
+#include "Snapshot.h"
+#include "TableCache.h"
+#include "Task.h"
+#include "Version.h"
 #include "Wal.h"
+#include "WriteController.h"
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <print>
+#include <set>
 #include <shared_mutex>
+#include <span>
 #include <stdexcept>
 #include <string_view>
 #include <vector>
@@ -18,27 +39,42 @@ namespace lsm_storage_engine {
  * Design:
  *  - Write to WAL first so writes are durable
  *  - One memtable (could add another to double-buffer later)
- *  - Vector of SSTables (no compaction algorithm yet)
+ *  - Live SSTables published as an immutable, ref-counted Version
  *
  * Write path: WAL -> MemTable -> SSTable (when flushed)
- * Read path: MemTable -> SSTables (newest to oldest)
+ * Read path: MemTable -> RowCache -> SSTables (newest to oldest)
+ * Scan path: heap merge of MemTable and SSTable cursors (see Iterator)
+ *
+ * Compaction merges tables without holding rwlock_ and installs the result
+ * with a single version swap, so it doesn't stall readers or writers.
+ *
+ * Writes are pipelined: a writer takes its sequence number and appends to
+ * the WAL in a queue outside rwlock_, then holds it only to insert into
+ * the memtable, in sequence order, and publish the write. One writer's WAL
+ * I/O overlaps the next one's insert, and readers never wait on the WAL.
  */
 class LsmTree {
 public:
-  // What do I even name a WAL?
-  LsmTree() : wal_(std::filesystem::path("lsm.wal")) {
-    // Restore the memtable from WAL on startup.
-    auto result = mem_table_.restore_from_wal(wal_.path());
-    if (!result) {
-      std::println("{}", result.error().message);
-      throw std::runtime_error("Could not restore state from WAL!");
-    }
-    if (!load_ssts()) {
-      throw std::runtime_error("Could not load SSTables!");
-    }
-    //    std::println("LSM constructed! Memtable size: {}B, Num SSTs: {}",
-    //                mem_table_.size(), ss_tables_.size());
-  }
+  LsmTree() : LsmTree(Options{}) {}
+
+  /**
+   * @brief A tree in the current directory with default tuning.
+   * @param merge_operator See Options::merge_operator.
+   * @param read_mode See Options::read_mode.
+   */
+  explicit LsmTree(std::shared_ptr<const MergeOperator> merge_operator,
+                   ReadMode read_mode = ReadMode::Mmap)
+      : LsmTree([&] {
+          Options options;
+          options.merge_operator = std::move(merge_operator);
+          options.read_mode = read_mode;
+          return options;
+        }()) {}
+
+  /**
+   * @brief Open (or create) the tree in `options.dir`.
+   */
+  explicit LsmTree(Options options) : LsmTree(std::move(options), true) {}
 
   /// Prevent the object from being copied
   LsmTree(const LsmTree &) = delete;
@@ -48,12 +84,58 @@ public:
   LsmTree(LsmTree &&) noexcept = delete;
   LsmTree &operator=(LsmTree &&) noexcept = delete;
 
+  /// Closes the tree (see close()) unless already closed.
+  ~LsmTree();
+
+  /**
+   * @brief Shut down cleanly: flush the memtable, sync the WAL and log a
+   * clean shutdown to the manifest, so the next open skips WAL replay.
+   *
+   * Waits for writers and compaction to finish. Writes after close() throw;
+   * reads still work. Calling it again does nothing.
+   */
+  void close();
+
   /**
    * @brief Retrieve the value of a key
    * @param key The key to look up
+   * @param options Set `snapshot` to read as of a snapshot; the bounds and
+   *        readahead only apply to scans
+   * @return The value if found, std::nullopt otherwise
+   */
+  std::optional<std::string> get(const std::string_view key,
+                                 const ReadOptions &options = {});
+
+  /**
+   * @brief get() as a coroutine that reads SSTable blocks through `ring`.
+   *
+   * The memtable, row cache, filters and indexes are checked inline; each
+   * table's data blocks are read with io_uring, suspending until they
+   * arrive. Start many of these on one thread and drive them with
+   * IoRing::run() to keep that many lookups in flight.
+   * @param key The key to look up
+   * @param ring The ring the reads go through; run it until they're done
+   * @param options As for get()
    * @return The value if found, std::nullopt otherwise
    */
-  std::optional<std::string> get(const std::string_view key);
+  Task<std::optional<std::string>> async_get(std::string key, IoRing &ring,
+                                             ReadOptions options = {});
+
+  /**
+   * @brief Retrieve the values of a batch of keys
+   *
+   * Cheaper than a get() per key: the keys are sorted, the memtable is
+   * checked for all of them under one lock, and each SSTable is probed once
+   * for every key still unresolved.
+   * The batch is read as of one sequence number, so it is consistent even
+   * while writes land.
+   * @param keys The keys to look up, in any order
+   * @param options Set `snapshot` to read as of a snapshot
+   * @return One result per key, in the same order as `keys`
+   */
+  std::vector<std::optional<std::string>>
+  multi_get(std::span<const std::string_view> keys,
+            const ReadOptions &options = {});
 
   /**
    * @brief Insert or update a key-value pair
@@ -64,10 +146,80 @@ public:
 
   /**
    * @brief Remove a key-value pair
+   *
+   * Writes a tombstone that hides older values of the key until compaction
+   * drops both.
    * @param key Key to remove
    */
   void rm(const std::string &key);
 
+  /**
+   * @brief Remove every key in [begin, end) with a single range tombstone.
+   *
+   * Costs one write however many keys the range holds. Keys written after
+   * the call are not affected. An empty range is a no-op.
+   * @param begin First key to remove
+   * @param end Exclusive end of the range
+   */
+  void delete_range(const std::string &begin, const std::string &end);
+
+  /**
+   * @brief Apply the merge operator to a key's value without reading it
+   *
+   * The operand is stored like a put() and combined with the value on reads,
+   * flushes and compactions. Requires a merge operator.
+   * @param key Key to update
+   * @param operand Operand to apply
+   */
+  void merge(const std::string &key, const std::string &operand);
+
+  /**
+   * @brief Add tables built by an SSTableWriter to the tree, without
+   * rewriting them or going through the WAL and memtable.
+   *
+   * The files are copied into the tree's directory (as reflinks where the
+   * filesystem supports them) and the copies all take one new sequence
+   * number, stamped into their headers, so they shadow every older write.
+   * The memtable is flushed first if it holds anything. Each file goes to
+   * the deepest level that no table at its level or above overlaps (below
+   * level 0, ahead of the shallower tables, so compaction can't move their
+   * newer values behind it), and all of them are logged to the manifest in
+   * one edit: after a crash, either all are in or none.
+   * @param files Tables whose key ranges don't overlap each other, in any
+   *        order. Left as they are.
+   * @throws std::invalid_argument if the files overlap each other or
+   *         weren't written by an SSTableWriter.
+   * @throws std::runtime_error if a file is missing or isn't a whole
+   *         SSTable; the tree is left untouched.
+   */
+  void ingest_files(std::span<const std::filesystem::path> files);
+
+  /**
+   * @brief Create an iterator for ordered scans over the whole tree
+   *
+   * The iterator sees the tree as of this call and isn't positioned yet:
+   * call one of its seek functions first.
+   * @param options Key bounds and readahead for the scan
+   * @return The iterator
+   */
+  Iterator new_iterator(const ReadOptions &options = {});
+
+  /**
+   * @brief Take a snapshot of the tree as of now
+   *
+   * Reads given the snapshot (see ReadOptions) see exactly the writes made
+   * before this call. Compaction keeps every version a live snapshot can
+   * see, so release it once done.
+   * @return The snapshot
+   */
+  Snapshot get_snapshot();
+
+  /**
+   * @brief Release a snapshot taken with get_snapshot()
+   * @param snapshot The snapshot; must not be used for reads afterwards
+   */
+  void release_snapshot(const Snapshot &snapshot);
+
   struct Stats {
     unsigned long get_count;
     unsigned long put_count;
@@ -75,6 +227,19 @@ public:
     double avg_put_time_us;
     long long max_put_time_us_;
     long long max_get_time_us_;
+    /// Pairs merged by rewriting their entries.
+    unsigned long compaction_count;
+    /// Pairs promoted a level without rewriting (disjoint key ranges).
+    unsigned long trivial_move_count;
+    /// Tombstones discarded by compaction, with the values they shadowed.
+    unsigned long tombstones_dropped;
+    /// Compaction inputs skipped because a range tombstone covered them.
+    unsigned long covered_files_skipped;
+    /// Time the constructor took to replay the WAL and open the SSTables,
+    /// i.e. until the tree accepted reads.
+    long long startup_time_us;
+    /// Whether the last shutdown was clean, so the WAL wasn't replayed.
+    bool clean_startup;
   };
 
   /**
@@ -83,37 +248,342 @@ public:
    */
   Stats stats() const;
 
+  /**
+   * @brief The limiter shared by all flush and compaction writers.
+   *
+   * Use it to change the background I/O budget at runtime, enable
+   * auto-tuning, or read throttling statistics.
+   */
+  RateLimiter &rate_limiter() { return *rate_limiter_; }
+
+  /**
+   * @brief The controller that delays or stops writers when compaction falls
+   * behind. Exposes stall counters and durations.
+   */
+  WriteController &write_controller() { return write_controller_; }
+
+  /**
+   * @brief The cache of hot keys' SSTable values in front of get(). Exposes
+   * hit, miss and admission counters.
+   */
+  RowCache &row_cache() { return row_cache_; }
+
+  /**
+   * @brief The cache of SSTable data blocks, used unless tables are read with
+   * mmap. Exposes hit and miss counters.
+   */
+  BlockCache &block_cache() { return *block_cache_; }
+
+  /**
+   * @brief Bounds how many SSTables keep their file open. Exposes open,
+   * hit and eviction counters; the capacity can be changed at runtime.
+   */
+  TableCache &table_cache() { return *table_cache_; }
+
+  /// The tree's current options.
+  Options options() const { return *options_.load(); }
+
+  /**
+   * @brief Change the tuning of an open tree (see Options). Writes, flushes
+   * and compactions from here on use the new values.
+   * @throws std::invalid_argument if anything above the tuning fields
+   *         differs from the tree's (start from options()).
+   */
+  void set_options(const Options &options);
+
 private:
+  /// Opens its families with a WAL of its own, and writes through the
+  /// *_logged() functions.
+  friend class ColumnFamilyDb;
+
+  /**
+   * @brief Open the tree; without `owns_wal`, as a column family whose
+   * writes its ColumnFamilyDb logs and replays.
+   */
+  LsmTree(Options options, bool owns_wal);
+
+  /**
+   * Replaced as a whole by set_options(), so a flush or compaction reads
+   * one consistent set of values however long it runs.
+   */
+  std::atomic<std::shared_ptr<const Options>> options_;
+
+  /**
+   * @brief Create `options.dir` if it doesn't exist and the caches and
+   * limiter not shared in (Options::create_shared()), for the constructor.
+   */
+  static std::shared_ptr<const Options> prepare(Options options);
+
   MemTable mem_table_;
-  Wal wal_;
+  /// Null for a column family: its ColumnFamilyDb logs its writes.
+  std::optional<Wal> wal_;
+
+  /// Folds merge operands. May be null if merge() is never used.
+  std::shared_ptr<const MergeOperator> merge_operator_;
+
+  /// Closes the files of cold SSTables. Outlives every table (and Version).
+  std::shared_ptr<TableCache> table_cache_;
 
   /**
-   * SSTables ordered oldest to newest (new SSTables are pushed to back).
-   * Will have to revisit once I get to compaction.
+   * Current set of SSTables. Readers load it atomically; it is only replaced
+   * (never modified) while holding rwlock_ exclusively.
    */
-  std::vector<SSTable> ss_tables_;
+  std::atomic<std::shared_ptr<const Version>> version_;
+
+  /// Durable record of version_'s tables. Written under rwlock_.
+  Manifest manifest_;
+
+  /// Throttles SSTable writes from flushes and compactions.
+  std::shared_ptr<RateLimiter> rate_limiter_;
+
+  /// Slows down writers based on compaction debt.
+  WriteController write_controller_;
+
+  /**
+   * Values of hot keys as the SSTables hold them. The memtable shadows it, so
+   * a key is only erased when a flush moves its newer value to an SSTable.
+   */
+  RowCache row_cache_;
+
+  /// How SSTables read their data blocks.
+  ReadMode read_mode_;
+
+  /// Data blocks of tables not read with mmap.
+  std::shared_ptr<BlockCache> block_cache_;
+
+  /// How new and reopened SSTables read and write their files.
+  TableOptions table_options() {
+    auto options = options_.load();
+    return {.read_mode = read_mode_,
+            .block_cache = block_cache_.get(),
+            .table_cache = table_cache_.get(),
+            .index_interval = options->index_interval,
+            .bloom_bits_per_key = options->bloom_bits_per_key};
+  }
 
   /// Basic RWLock for multithreaded access.
   std::shared_mutex rwlock_;
 
+  /// Serializes compactions. Never held while waiting on rwlock_ readers.
+  std::mutex compaction_mutex_;
+
+  /**
+   * Sequence number of the last write readers can see, i.e. the last one
+   * applied to the memtable. Guarded by rwlock_.
+   */
+  SequenceNumber last_sequence_{0};
+
+  /**
+   * The writer queue: hands out sequence numbers and appends to the WAL in
+   * that order, outside rwlock_. Taken before rwlock_, after
+   * compaction_mutex_.
+   */
+  std::mutex wal_mutex_;
+  /// Sequence number of the last write in the WAL. Guarded by wal_mutex_.
+  SequenceNumber last_assigned_{0};
+
+  /// Last write applied to the memtable, by which writes apply in sequence
+  /// order. Guarded by commit_mutex_.
+  SequenceNumber committed_{0};
+  std::mutex commit_mutex_;
+  std::condition_variable commit_cv_;
+
+  /// Sequences of the live snapshots. Guarded by snapshot_mutex_.
+  std::multiset<SequenceNumber> snapshots_;
+  mutable std::mutex snapshot_mutex_;
+
   /**
-   * @brief Load SSTables associated with this LSM-tree into the ss_tables_
-   * vector.
+   * @brief Sequence of the newest live snapshot, if any.
+   */
+  std::optional<SequenceNumber> newest_snapshot() const;
+
+  /**
+   * @brief Copy of the live snapshots, for a compaction.
+   */
+  SnapshotList live_snapshots() const;
+
+  /**
+   * @brief Recover the manifest and open the SSTables it lists into
+   * version_. A tree written before the manifest has its lsm.meta migrated.
    * @return void on success, StorageError on failure.
    */
   std::expected<void, StorageError> load_ssts();
 
   /**
-   * @brief Update the LSM-tree meta file with SSTable to add it to the
-   * database.
+   * @brief Start the manifest from the tables listed in a legacy lsm.meta,
+   * if there is one, and remove it.
    * @return void on success, StorageError on failure.
    */
-  std::expected<void, StorageError> update_meta(SSTable &sstable);
+  std::expected<void, StorageError> migrate_meta();
+
+  /**
+   * @brief Create a new SSTable named by the next file number.
+   */
+  std::expected<SSTable, StorageError> create_table();
+
+  /**
+   * @brief Number of tables a level may hold before it is compacted:
+   * compaction_trigger on level 0, times level_size_multiplier for each
+   * level below.
+   */
+  static size_t level_capacity(int level, const Options &options);
 
+  /**
+   * @brief Compact every level that has reached its capacity.
+   *
+   * Tables in a level are paired oldest first. Pairs whose key ranges overlap
+   * are merged into one table on the next level; disjoint pairs are moved to
+   * the next level as-is.
+   * @return void on success, StorageError on failure.
+   */
   std::expected<void, StorageError> maybe_compact();
 
+  /**
+   * @brief Merge two tables into new tables of about kTargetFileSize each,
+   * keeping only the versions some reader can still see.
+   *
+   * Of the versions of a key between two snapshots, only the newest is kept
+   * (see SnapshotList); with no snapshots, that is just the newest version.
+   * Range tombstones count as versions that hide older ones. Tombstones at
+   * the bottom are dropped when none of the `older` tables can hold the key.
+   * If the newer table's range tombstones hide the older table's whole key
+   * range from every reader, it isn't read at all. Merge operands are folded
+   * into the version beneath them, or into a plain value once nothing older
+   * can hold the key.
+   * @param left_table The older table.
+   * @param right_table The newer table.
+   * @param older Other tables that may hold older values for the same keys.
+   * @param snapshots The live snapshots.
+   * @param boundaries Sorted max keys of the output level's tables; output
+   *        files are cut on them where possible.
+   * @return The merged SSTables on success, StorageError on failure.
+   */
+  std::expected<std::vector<SSTable>, StorageError>
+  merge_tables(SSTable &left_table, SSTable &right_table,
+               const std::vector<std::shared_ptr<SSTable>> &older,
+               const SnapshotList &snapshots,
+               const std::vector<std::string> &boundaries);
+
+  /**
+   * @brief Level for a table ingested into `version`: the deepest one that
+   * no table at that level or above overlaps, or 0.
+   */
+  static int ingest_level(const Version &version,
+                          const SSTable::Header &header);
+
+  /**
+   * @brief Sorted max keys of the tables on `level`.
+   */
+  static std::vector<std::string> level_boundaries(const Version &version,
+                                                   int level);
+
+  /// Tables replaced by compaction and the tables that replace them.
+  struct CompactionEdit {
+    std::vector<std::shared_ptr<SSTable>> inputs;
+    std::vector<std::shared_ptr<SSTable>> outputs;
+  };
+
+  /**
+   * @brief Log compaction results to the manifest, then swap them into a
+   * new version.
+   * @param edits Input/output table groups, in level order.
+   * @param output_level Level assigned to every output table.
+   * @return void on success, StorageError on failure. On failure the
+   *         current version stays and the new outputs are deleted.
+   */
+  std::expected<void, StorageError>
+  install_compaction(const std::vector<CompactionEdit> &edits,
+                     int output_level);
+
+  /**
+   * @brief Add a read of `count` keys that took `duration_us` to the get
+   * stats and the rate limiter's latency feedback.
+   */
+  void record_get_latency(long long duration_us, size_t count);
+
+  /**
+   * @brief The memtable part of a point read, under the read lock.
+   * @param generation Set to the row cache generation, for a later insert.
+   * @return The version to read the SSTables from, or null if the memtable
+   *         settled the key.
+   */
+  std::shared_ptr<const Version> read_memtable(std::string_view key,
+                                               SequenceNumber snapshot,
+                                               ReadResolver &read,
+                                               uint64_t &generation);
+
+  /**
+   * @brief Cache the SSTables' value of `key`, resolved in `tables`, and
+   * feed it to `read` beneath the memtable's entries.
+   */
+  void add_table_result(std::string_view key, ReadResolver &tables,
+                        uint64_t generation, ReadResolver &read);
+
   std::expected<void, StorageError> flush_memtable();
 
+  /**
+   * @brief Shared write path for put(), rm(), delete_range() and merge():
+   * WAL, then memtable, with write stalls, flushing and compaction.
+   */
+  void write(const std::string &key, Entry entry);
+
+  /**
+   * @brief Wait until every write up to `seq` is in the memtable.
+   */
+  void wait_for_commit(SequenceNumber seq);
+
+  /**
+   * @brief Mark the write `seq` as in the memtable, letting the next one
+   * apply.
+   */
+  void commit(SequenceNumber seq);
+
+  /**
+   * @brief Flush the memtable if it is still full, once the writes already
+   * in the WAL have reached it.
+   */
+  void flush_when_full();
+
+  /**
+   * @brief Run maybe_compact(), throwing on failure.
+   */
+  void compact();
+
+  /**
+   * @brief Delay or stop the calling writer if compaction is behind.
+   */
+  void throttle_write();
+
+  /**
+   * @brief Flush the memtable if it has reached its threshold, throwing on
+   * failure. Call under rwlock_.
+   * @return Whether it flushed.
+   */
+  bool flush_if_full();
+
+  /**
+   * @brief Apply writes a ColumnFamilyDb has logged, with the sequence
+   * numbers it gave them, under one lock. Flushing is left to
+   * flush_logged(), so the caller can apply the next batch meanwhile.
+   */
+  void apply_logged(std::vector<KeyEntry> writes);
+
+  /**
+   * @brief Flush the memtable if it is full, or with `force` if it holds
+   * anything at all.
+   * @return Whether it flushed.
+   */
+  bool flush_logged(bool force);
+
+  bool memtable_empty();
+  SequenceNumber last_sequence();
+
+  /**
+   * @brief Report the compaction debt of a newly installed version to the
+   * write controller.
+   */
+  void update_write_debt(const Version &version);
+
   // Timing stats - using atomics for thread-safe updates without holding the
   // main lock
   std::atomic<unsigned long> get_count_{0};
@@ -122,5 +592,15 @@ private:
   std::atomic<long long> total_put_time_us_{0};
   std::atomic<long long> max_put_time_us_{0};
   std::atomic<long long> max_get_time_us_{0};
+  std::atomic<unsigned long> compaction_count_{0};
+  std::atomic<unsigned long> trivial_move_count_{0};
+  std::atomic<unsigned long> tombstones_dropped_{0};
+  std::atomic<unsigned long> covered_files_skipped_{0};
+  /// Set once by the constructor.
+  long long startup_time_us_{0};
+  bool clean_startup_{false};
+  /// Set by close(). Guarded by rwlock_ and wal_mutex_: holding either
+  /// is enough to read it.
+  bool closed_{false};
 };
 } // namespace lsm_storage_engine
@@ -0,0 +1,392 @@
+#include "Manifest.h"
+#include "utils/CheckSum.h"
+#include "utils/FileSync.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+namespace lsm_storage_engine {
+
+/// Field tags inside an encoded VersionEdit.
+enum class EditTag : uint8_t {
+  Deleted = 1,
+  Added = 2,
+  NextFileNumber = 3,
+  LastSequence = 4,
+  CleanShutdown = 5,
+};
+
+/// Record header: [length:4][checksum:4].
+static constexpr size_t kRecordHeader = 2 * sizeof(uint32_t);
+
+/**
+ * Zero-padded so names sort by number.
+ */
+static std::string padded(uint64_t number) {
+  auto digits = std::to_string(number);
+  if (digits.size() < 6) {
+    digits.insert(0, 6 - digits.size(), '0');
+  }
+  return digits;
+}
+
+std::string Manifest::table_name(uint64_t number) {
+  return padded(number) + ".sst";
+}
+
+/**
+ * Appends fixed-size fields and length-prefixed strings to a buffer.
+ */
+struct EditWriter {
+  std::vector<std::byte> &out;
+
+  template <typename T> void put(const T &value) {
+    auto bytes = reinterpret_cast<const std::byte *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+  void put_string(std::string_view s) {
+    put(static_cast<uint32_t>(s.size()));
+    auto bytes = reinterpret_cast<const std::byte *>(s.data());
+    out.insert(out.end(), bytes, bytes + s.size());
+  }
+};
+
+/**
+ * Bounds-checked reads of what EditWriter wrote. Reads past the end fail
+ * and leave `ok` false.
+ */
+struct EditReader {
+  std::span<const std::byte> in;
+  bool ok{true};
+
+  template <typename T> T get() {
+    T value{};
+    if (in.size() < sizeof(T)) {
+      ok = false;
+      return value;
+    }
+    ::memcpy(&value, in.data(), sizeof(T));
+    in = in.subspan(sizeof(T));
+    return value;
+  }
+  std::string get_string() {
+    auto len = get<uint32_t>();
+    if (!ok || in.size() < len) {
+      ok = false;
+      return {};
+    }
+    std::string s(reinterpret_cast<const char *>(in.data()), len);
+    in = in.subspan(len);
+    return s;
+  }
+};
+
+/**
+ * A VersionEdit as one manifest record, header included.
+ */
+static std::vector<std::byte> encode_record(const VersionEdit &edit) {
+  std::vector<std::byte> record(kRecordHeader);
+  EditWriter w{record};
+  for (const auto &name : edit.deleted) {
+    w.put(EditTag::Deleted);
+    w.put_string(name);
+  }
+  for (const auto &[after, file] : edit.added) {
+    w.put(EditTag::Added);
+    w.put_string(after);
+    w.put_string(file.name);
+    w.put(static_cast<int32_t>(file.level));
+    w.put_string(file.min_key);
+    w.put_string(file.max_key);
+    w.put(file.max_sequence);
+    w.put(file.file_size);
+  }
+  if (edit.next_file_number) {
+    w.put(EditTag::NextFileNumber);
+    w.put(*edit.next_file_number);
+  }
+  if (edit.last_sequence) {
+    w.put(EditTag::LastSequence);
+    w.put(*edit.last_sequence);
+  }
+  if (edit.clean_shutdown) {
+    w.put(EditTag::CleanShutdown);
+  }
+  auto length = static_cast<uint32_t>(record.size() - kRecordHeader);
+  auto checksum =
+      hash32({reinterpret_cast<const char *>(record.data() + kRecordHeader),
+              length});
+  ::memcpy(record.data(), &length, sizeof(length));
+  ::memcpy(record.data() + sizeof(length), &checksum, sizeof(checksum));
+  return record;
+}
+
+static std::optional<VersionEdit>
+decode_edit(std::span<const std::byte> payload) {
+  VersionEdit edit;
+  EditReader r{payload};
+  while (r.ok && !r.in.empty()) {
+    switch (r.get<EditTag>()) {
+    case EditTag::Deleted:
+      edit.deleted.push_back(r.get_string());
+      break;
+    case EditTag::Added: {
+      VersionEdit::AddedFile added;
+      added.after = r.get_string();
+      added.file.name = r.get_string();
+      added.file.level = r.get<int32_t>();
+      added.file.min_key = r.get_string();
+      added.file.max_key = r.get_string();
+      added.file.max_sequence = r.get<SequenceNumber>();
+      added.file.file_size = r.get<uint64_t>();
+      edit.added.push_back(std::move(added));
+      break;
+    }
+    case EditTag::NextFileNumber:
+      edit.next_file_number = r.get<uint64_t>();
+      break;
+    case EditTag::LastSequence:
+      edit.last_sequence = r.get<SequenceNumber>();
+      break;
+    case EditTag::CleanShutdown:
+      edit.clean_shutdown = true;
+      break;
+    default:
+      return std::nullopt;
+    }
+  }
+  if (!r.ok) {
+    return std::nullopt;
+  }
+  return edit;
+}
+
+VersionEdit VersionEdit::diff(const std::vector<FileMeta> &before,
+                              const std::vector<FileMeta> &after) {
+  std::unordered_map<std::string_view, int> old_levels;
+  for (const auto &file : before) {
+    old_levels.emplace(file.name, file.level);
+  }
+  // Tables still at their level keep their place; everything else is
+  // (re)inserted after its predecessor in the new order.
+  std::unordered_set<std::string_view> kept;
+  for (const auto &file : after) {
+    auto it = old_levels.find(file.name);
+    if (it != old_levels.end() && it->second == file.level) {
+      kept.insert(file.name);
+    }
+  }
+  VersionEdit edit;
+  for (const auto &file : before) {
+    if (!kept.contains(file.name)) {
+      edit.deleted.push_back(file.name);
+    }
+  }
+  for (size_t i = 0; i < after.size(); ++i) {
+    if (!kept.contains(after[i].name)) {
+      edit.added.push_back({i == 0 ? "" : after[i - 1].name, after[i]});
+    }
+  }
+  return edit;
+}
+
+Manifest::Manifest(std::filesystem::path dir, size_t snapshot_bytes)
+    : dir_(std::move(dir)), snapshot_bytes_(snapshot_bytes) {}
+
+Manifest::~Manifest() { close_file(); }
+
+void Manifest::close_file() {
+  if (fd_ != -1) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void Manifest::apply(const VersionEdit &edit) {
+  for (const auto &name : edit.deleted) {
+    std::erase_if(files_, [&](const FileMeta &f) { return f.name == name; });
+  }
+  for (const auto &[after, file] : edit.added) {
+    auto pos = files_.begin();
+    if (!after.empty()) {
+      pos = std::ranges::find(files_, after, &FileMeta::name);
+      if (pos != files_.end()) {
+        ++pos;
+      }
+    }
+    files_.insert(pos, file);
+  }
+  if (edit.next_file_number) {
+    auto next = next_file_number_.load(std::memory_order_relaxed);
+    next_file_number_.store(std::max(next, *edit.next_file_number),
+                            std::memory_order_relaxed);
+  }
+  if (edit.last_sequence) {
+    last_sequence_ = std::max(last_sequence_, *edit.last_sequence);
+  }
+  clean_shutdown_ = edit.clean_shutdown;
+}
+
+std::expected<bool, StorageError> Manifest::recover() {
+  auto current = dir_ / "CURRENT";
+  if (!std::filesystem::exists(current)) {
+    return false;
+  }
+  std::string name;
+  {
+    std::ifstream file{current};
+    std::getline(file, name);
+  }
+  if (!name.starts_with("MANIFEST-")) {
+    return std::unexpected(StorageError{
+        .kind = StorageError::Kind::Corruption,
+        .message = "CURRENT doesn't name a manifest",
+        .path = current,
+    });
+  }
+  auto path = dir_ / name;
+  std::vector<std::byte> log;
+  {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+      return std::unexpected(StorageError::file_open(path));
+    }
+    std::vector<char> chars{std::istreambuf_iterator<char>{file}, {}};
+    log.resize(chars.size());
+    ::memcpy(log.data(), chars.data(), chars.size());
+  }
+
+  // A record cut short, or failing its checksum, at the end is a write the
+  // crash interrupted: the log ends before it.
+  size_t pos = 0;
+  while (log.size() - pos >= kRecordHeader) {
+    uint32_t length{0};
+    uint32_t checksum{0};
+    ::memcpy(&length, log.data() + pos, sizeof(length));
+    ::memcpy(&checksum, log.data() + pos + sizeof(length), sizeof(checksum));
+    size_t end = pos + kRecordHeader + length;
+    if (end > log.size()) {
+      break;
+    }
+    std::span<const std::byte> payload{log.data() + pos + kRecordHeader,
+                                       length};
+    bool valid = checksum == hash32({reinterpret_cast<const char *>(
+                                         payload.data()),
+                                     payload.size()});
+    if (!valid && end == log.size()) {
+      break;
+    }
+    auto edit = valid ? decode_edit(payload) : std::nullopt;
+    if (!edit) {
+      return std::unexpected(StorageError{
+          .kind = StorageError::Kind::Corruption,
+          .message = "Corrupted manifest record",
+          .path = path,
+      });
+    }
+    apply(*edit);
+    pos = end;
+  }
+  // Clean shutdown or not, whoever recovers is about to change things.
+  clean_shutdown_ = clean_shutdown_ && pos == log.size();
+
+  // Numbers keep going up past the manifest's own.
+  auto number = std::stoull(name.substr(std::strlen("MANIFEST-")));
+  if (next_file_number_.load(std::memory_order_relaxed) <= number) {
+    next_file_number_.store(number + 1, std::memory_order_relaxed);
+  }
+
+  close_file();
+  fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND);
+  if (fd_ == -1) {
+    return std::unexpected(StorageError::file_open(path));
+  }
+  if (pos < log.size() && ::ftruncate(fd_, static_cast<off_t>(pos)) == -1) {
+    return std::unexpected(StorageError::file_write(path));
+  }
+  path_ = std::move(path);
+  size_ = pos;
+  return true;
+}
+
+std::expected<void, StorageError>
+Manifest::create(std::vector<FileMeta> files, SequenceNumber last_sequence) {
+  auto path = dir_ / ("MANIFEST-" + padded(new_file_number()));
+  VersionEdit snapshot;
+  for (size_t i = 0; i < files.size(); ++i) {
+    snapshot.added.push_back({i == 0 ? "" : files[i - 1].name, files[i]});
+  }
+  snapshot.next_file_number = next_file_number_.load(std::memory_order_relaxed);
+  snapshot.last_sequence = last_sequence;
+  auto record = encode_record(snapshot);
+
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd == -1) {
+    return std::unexpected(StorageError::file_open(path));
+  }
+  if (auto res = write_synced(fd, record, path); !res) {
+    ::close(fd);
+    return res;
+  }
+
+  // Point CURRENT at the new manifest: write it aside, then rename over.
+  auto current = dir_ / "CURRENT";
+  auto temp = dir_ / "CURRENT.tmp";
+  if (!write_file_synced(temp, path.filename().string() + "\n") ||
+      ::rename(temp.c_str(), current.c_str()) == -1) {
+    ::close(fd);
+    return std::unexpected(StorageError::file_write(current));
+  }
+  // The rename itself is only durable once the directory is.
+  auto dir_synced = sync_path(dir_);
+
+  // CURRENT names the new manifest either way, so edits go there from now
+  // on. Without the directory synced, a crash may still find the old one:
+  // keep it, and report the switch as failed.
+  auto old = std::exchange(path_, path);
+  close_file();
+  fd_ = fd;
+  size_ = record.size();
+  files_ = std::move(files);
+  last_sequence_ = last_sequence;
+  clean_shutdown_ = false;
+  if (!dir_synced) {
+    return std::unexpected(dir_synced.error());
+  }
+  if (!old.empty()) {
+    std::error_code ec;
+    std::filesystem::remove(old, ec);
+  }
+  return {};
+}
+
+std::expected<void, StorageError> Manifest::append(const VersionEdit &edit) {
+  auto record = encode_record(edit);
+  if (auto res = write_synced(fd_, record, path_); !res) {
+    return res;
+  }
+  size_ += record.size();
+  return {};
+}
+
+std::expected<void, StorageError> Manifest::log(VersionEdit edit) {
+  // Roll over first, so the edit (a clean shutdown, say) stays the last.
+  if (size_ >= snapshot_bytes_) {
+    if (auto res = create(files_, last_sequence_); !res) {
+      return res;
+    }
+  }
+  edit.next_file_number = next_file_number_.load(std::memory_order_relaxed);
+  if (auto res = append(edit); !res) {
+    return res;
+  }
+  apply(edit);
+  return {};
+}
+} // namespace lsm_storage_engine
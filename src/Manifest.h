@@ -0,0 +1,146 @@
+#pragma once
+#include "Constants.h"
+#include "Entry.h"
+#include "StorageError.h"
+#include <atomic>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief What the manifest records about one SSTable.
+ */
+struct FileMeta {
+  /// File name, relative to the manifest's directory.
+  std::string name;
+  int level{0};
+  std::string min_key;
+  std::string max_key;
+  SequenceNumber max_sequence{0};
+  uint64_t file_size{0};
+
+  bool operator==(const FileMeta &) const = default;
+};
+
+/**
+ * @brief One atomic change to the set of live SSTables.
+ *
+ * Replayed by removing `deleted`, then inserting each of `added` right after
+ * the file named by its `after` (first if empty), in order. A table changing
+ * level is deleted and added again.
+ */
+struct VersionEdit {
+  struct AddedFile {
+    std::string after;
+    FileMeta file;
+  };
+
+  std::vector<std::string> deleted;
+  std::vector<AddedFile> added;
+  std::optional<uint64_t> next_file_number;
+  std::optional<SequenceNumber> last_sequence;
+  /// Set by the last edit of a clean shutdown; any later edit clears it.
+  bool clean_shutdown{false};
+
+  /**
+   * @brief The edit turning `before` into `after`, both ordered oldest to
+   * newest. Tables kept at the same level must keep their relative order.
+   */
+  static VersionEdit diff(const std::vector<FileMeta> &before,
+                          const std::vector<FileMeta> &after);
+};
+
+/**
+ * @brief Crash-safe log of version edits, replacing the text lsm.meta.
+ *
+ * Each edit is appended to MANIFEST-<number> as one checksummed record
+ * ([length:4][checksum:4][edit]) and synced, so a flush or compaction only
+ * writes what it changed. Replay stops cleanly at a torn last record.
+ *
+ * Once the log grows past a threshold, the current state is written as a
+ * single edit to a new manifest, and the CURRENT file is switched to it with
+ * rename(), which is atomic: a crash leaves either the old or the new
+ * manifest in place, never neither.
+ *
+ * Also hands out the file numbers that name new SSTables. log() isn't
+ * thread-safe; new_file_number() is.
+ */
+class Manifest {
+public:
+  /**
+   * @param dir Directory holding CURRENT and the manifests.
+   * @param snapshot_bytes Roll over to a new manifest past this size.
+   */
+  explicit Manifest(
+      std::filesystem::path dir,
+      size_t snapshot_bytes = lsm_constants::kManifestSnapshotBytes);
+  ~Manifest();
+
+  Manifest(const Manifest &) = delete;
+  Manifest &operator=(const Manifest &) = delete;
+
+  /**
+   * @brief Replay the manifest CURRENT names, if there is one.
+   * @return Whether a manifest was found, or StorageError if it can't be
+   *         read or a record before the last is corrupt.
+   */
+  std::expected<bool, StorageError> recover();
+
+  /**
+   * @brief Start a new manifest holding exactly `files`, and switch CURRENT
+   * to it. Also used to roll over a long log.
+   * @return void on success, StorageError on failure.
+   */
+  std::expected<void, StorageError> create(std::vector<FileMeta> files,
+                                           SequenceNumber last_sequence);
+
+  /**
+   * @brief Durably append `edit` and apply it, rolling over to a new
+   * manifest if the log got too long.
+   * @return void on success, StorageError on failure.
+   */
+  std::expected<void, StorageError> log(VersionEdit edit);
+
+  /// A number no other file has used, for naming a new SSTable.
+  uint64_t new_file_number() {
+    return next_file_number_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// File name of the SSTable numbered `number`.
+  static std::string table_name(uint64_t number);
+
+  /// The live tables, oldest to newest.
+  const std::vector<FileMeta> &files() const { return files_; }
+
+  SequenceNumber last_sequence() const { return last_sequence_; }
+
+  /// Whether the last edit logged was a clean shutdown.
+  bool clean_shutdown() const { return clean_shutdown_; }
+
+  /// Path of the manifest being appended to, or empty before recover().
+  const std::filesystem::path &path() const { return path_; }
+
+private:
+  std::filesystem::path dir_;
+  size_t snapshot_bytes_;
+  std::filesystem::path path_;
+  int fd_{-1};
+  size_t size_{0};
+  std::vector<FileMeta> files_;
+  std::atomic<uint64_t> next_file_number_{1};
+  SequenceNumber last_sequence_{0};
+  bool clean_shutdown_{false};
+
+  /// Apply a replayed or logged edit to the state.
+  void apply(const VersionEdit &edit);
+
+  /// Append one record to the open manifest and sync it.
+  std::expected<void, StorageError> append(const VersionEdit &edit);
+
+  void close_file();
+};
+} // namespace lsm_storage_engine
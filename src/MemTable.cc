@@ -1,161 +1,282 @@
 #include "MemTable.h"
-#include "Constants.h"
 #include "StorageError.h"
-#include "utils/CheckSum.h"
+#include "Wal.h"
+#include "utils/Partition.h"
+#include <algorithm>
 #include <cassert>
 #include <expected>
 #include <filesystem>
 #include <fstream>
 #include <ios>
 #include <sstream>
-#include <sys/fcntl.h>
-#include <unistd.h>
+#include <vector>
 namespace lsm_storage_engine {
 
-std::optional<std::string> MemTable::get(const std::string_view key) const {
-  auto it = map_.find(std::string(key));
-  if (it != map_.end()) {
-    return it->second;
+/**
+ * Bytes an entry adds to the memtable size, besides its key.
+ */
+static size_t entry_bytes(const Entry &entry) {
+  size_t bytes = entry.value.size();
+  for (const auto &operand : entry.operands) {
+    bytes += operand.size();
   }
-  return std::nullopt;
+  return bytes;
 }
-void MemTable::put(std::string key, std::string value) {
-  if (map_.contains(key)) {
-    const std::string_view oldval = map_.find(key)->second;
 
-    assert(size_ >= oldval.size());
+/**
+ * Whether a snapshot may still read this version once a newer one replaces
+ * it.
+ */
+static bool snapshot_may_read(const Entry &version,
+                              std::optional<SequenceNumber> newest_snapshot) {
+  return newest_snapshot && version.seq <= *newest_snapshot;
+}
 
-    size_ -= oldval.size();
-    size_ += value.size();
-  } else {
-    size_ += (key.size() + value.size());
+std::optional<std::string> MemTable::get(const std::string_view key,
+                                         SequenceNumber snapshot) const {
+  auto entry = lookup(key, snapshot);
+  if (entry && entry->type == EntryType::Put) {
+    return std::move(entry->value);
   }
-  map_.insert_or_assign(std::move(key), std::move(value));
+  return std::nullopt;
 }
-
-std::expected<void, StorageError> MemTable::flush_to_sst(SSTable &sst) {
-  // Handle empty table - write valid SSTable with empty key range
-  std::string min_key;
-  std::string max_key;
-  size_t bytes_written{0};
-
-  if (!map_.empty()) {
-    min_key = map_.begin()->first;
-    max_key = map_.rbegin()->first;
+std::optional<Entry> MemTable::lookup(const std::string_view key,
+                                      SequenceNumber snapshot) const {
+  auto it = map_.find(std::string(key));
+  return resolve(key, it == map_.end() ? nullptr : &it->second, snapshot);
+}
+std::optional<Entry> MemTable::resolve(std::string_view key,
+                                       const std::vector<Entry> *versions,
+                                       SequenceNumber snapshot) const {
+  auto range_seq = range_tombstones_.covering_seq(key, snapshot);
+  // Fold versions newest first until one settles the key.
+  static const std::vector<Entry> kNoVersions;
+  std::optional<Entry> result;
+  for (const auto &version : versions ? *versions : kNoVersions) {
+    if (version.seq > snapshot) {
+      continue;
+    }
+    if (range_seq && version.seq < *range_seq) {
+      // Deleted by a newer range tombstone, like everything older.
+      break;
+    }
+    Entry folded = version;
+    if (!version.operands.empty()) {
+      assert(merge_operator_ != nullptr);
+      folded = fold_operands(*merge_operator_, key, std::move(folded));
+    }
+    if (result) {
+      assert(merge_operator_ != nullptr);
+      result = apply_merge(*merge_operator_, key, folded, *result);
+    } else {
+      result = std::move(folded);
+    }
+    if (result->type != EntryType::Merge) {
+      return result;
+    }
   }
-
-  SSTable::Header header{min_key, max_key};
-  if (auto res = sst.write_header(std::move(header)); !res) {
-    return std::unexpected{res.error()};
+  if (!range_seq) {
+    return result;
   }
-  bytes_written += sst.header().size;
-
-  BloomFilter bloom_filter{map_.size()};
-  for (const auto &[key, val] : map_) {
-    bloom_filter.add(std::string_view{key});
+  if (!result) {
+    auto deleted = Entry::tombstone();
+    deleted.seq = *range_seq;
+    return deleted;
   }
-
-  auto bf_res = sst.write_bloom_filter(std::move(bloom_filter));
-  if (!bf_res) {
-    return std::unexpected{bf_res.error()};
+  // The range delete is the base: the operands apply to a missing key.
+  assert(merge_operator_ != nullptr);
+  return apply_merge(*merge_operator_, key, Entry::tombstone(), *result);
+}
+std::vector<KeyEntry>
+MemTable::scan(const std::optional<std::string> &lower_bound,
+               const std::optional<std::string> &upper_bound,
+               SequenceNumber snapshot) const {
+  std::vector<KeyEntry> entries;
+  if (lower_bound && upper_bound && *lower_bound >= *upper_bound) {
+    return entries;
   }
-  bytes_written += bf_res.value();
-
-  size_t i = 0;
-
-  for (const auto &[key, val] : map_) {
-    auto result = sst.write_entry(key, val);
-    if (!result) {
-      return std::unexpected(result.error());
+  auto first = lower_bound ? map_.lower_bound(*lower_bound) : map_.begin();
+  auto last = upper_bound ? map_.lower_bound(*upper_bound) : map_.end();
+  for (auto it = first; it != last; ++it) {
+    const auto &[key, versions] = *it;
+    if (auto entry = resolve(key, &versions, snapshot)) {
+      entries.emplace_back(key, std::move(*entry));
     }
-
-    if (i % lsm_constants::kIndexSpace == 0) {
-      sst.index().emplace_back(std::string{key}, bytes_written);
+  }
+  return entries;
+}
+void MemTable::insert_range(std::string begin, std::string end,
+                            SequenceNumber seq,
+                            std::optional<SequenceNumber> newest_snapshot) {
+  if (begin >= end) {
+    return;
+  }
+  // Drop the versions only the latest view could see; the range hides them
+  // from now on.
+  auto it = map_.lower_bound(begin);
+  auto last = map_.lower_bound(end);
+  while (it != last) {
+    auto &[key, versions] = *it;
+    std::erase_if(versions, [&](const Entry &version) {
+      if (snapshot_may_read(version, newest_snapshot)) {
+        return false;
+      }
+      assert(size_ >= entry_bytes(version));
+      size_ -= entry_bytes(version);
+      return true;
+    });
+    if (versions.empty()) {
+      assert(size_ >= key.size());
+      size_ -= key.size();
+      it = map_.erase(it);
+    } else {
+      ++it;
     }
-    bytes_written += result.value();
-    i++;
   }
-
-  SSTable::Footer footer;
-  footer.index_offset = bytes_written;
-
-  auto result = sst.write_index();
-  if (!result) {
-    return std::unexpected(result.error());
+  size_ += begin.size() + end.size();
+  range_tombstones_.add(std::move(begin), std::move(end), seq);
+}
+void MemTable::insert_merge(std::string key, Entry operand,
+                            std::optional<SequenceNumber> newest_snapshot) {
+  auto range_seq = range_tombstones_.covering_seq(key);
+  auto [it, inserted] = map_.try_emplace(std::move(key));
+  auto &versions = it->second;
+  if (inserted) {
+    size_ += it->first.size();
+  }
+  size_ += operand.value.size();
+  if (versions.empty() ||
+      snapshot_may_read(versions.front(), newest_snapshot)) {
+    versions.insert(versions.begin(), std::move(operand));
+    return;
   }
-  bytes_written += result.value();
-  footer.index_size = result.value();
-  footer.num_index_entries = sst.index().size();
+  auto &newest = versions.front();
+  if (range_seq && newest.seq < *range_seq) {
+    // A range delete since hides it: the operand applies to a missing key,
+    // which the range tombstone supplies on reads.
+    size_ -= entry_bytes(newest);
+    newest = std::move(operand);
+    return;
+  }
+  newest.operands.push_back(std::move(operand.value));
+  newest.seq = operand.seq;
+}
+void MemTable::apply(std::string key, Entry entry,
+                     std::optional<SequenceNumber> newest_snapshot) {
+  max_sequence_ = std::max(max_sequence_, entry.seq);
+  switch (entry.type) {
+  case EntryType::RangeDelete:
+    insert_range(std::move(key), std::move(entry.value), entry.seq,
+                 newest_snapshot);
+    break;
+  case EntryType::Merge:
+    insert_merge(std::move(key), std::move(entry), newest_snapshot);
+    break;
+  default:
+    insert(std::move(key), std::move(entry), newest_snapshot);
+  }
+}
+void MemTable::insert(std::string key, Entry entry,
+                      std::optional<SequenceNumber> newest_snapshot) {
+  auto [it, inserted] = map_.try_emplace(std::move(key));
+  auto &versions = it->second;
+  if (inserted) {
+    size_ += it->first.size();
+  }
+  size_ += entry_bytes(entry);
+  if (versions.empty() ||
+      snapshot_may_read(versions.front(), newest_snapshot)) {
+    versions.insert(versions.begin(), std::move(entry));
+    return;
+  }
+  assert(size_ >= entry_bytes(versions.front()));
+  size_ -= entry_bytes(versions.front());
+  versions.front() = std::move(entry);
+}
 
-  if (auto res = sst.write_footer(footer); !res) {
-    return std::unexpected{res.error()};
+std::expected<void, StorageError> MemTable::fold_merges() {
+  for (auto &[key, versions] : map_) {
+    for (auto &version : versions) {
+      if (version.operands.empty() && version.type != EntryType::Merge) {
+        continue;
+      }
+      if (merge_operator_ == nullptr) {
+        return std::unexpected(StorageError::missing_merge_operator());
+      }
+      if (version.operands.empty()) {
+        continue;
+      }
+      size_ -= entry_bytes(version);
+      version = fold_operands(*merge_operator_, key, std::move(version));
+      size_ += entry_bytes(version);
+    }
   }
   return {};
 }
-std::expected<void, StorageError>
-MemTable::restore_from_wal(const std::filesystem::path &wal_path) {
-  if (!std::filesystem::exists(wal_path)) {
-    return {};
+
+std::vector<KeyEntry> MemTable::all_versions() const {
+  std::vector<KeyEntry> entries;
+  for (const auto &[key, versions] : map_) {
+    for (const auto &version : versions) {
+      entries.emplace_back(key, version);
+    }
   }
+  return entries;
+}
 
-  int fd = ::open(wal_path.c_str(), O_RDONLY, 0644);
-  if (fd == -1) {
-    return std::unexpected(StorageError::file_open(wal_path));
+std::expected<void, StorageError> MemTable::flush_to_sst(SSTable &sst) {
+  if (auto res = fold_merges(); !res) {
+    return res;
   }
+  auto entries = all_versions();
+  return sst.write_sorted(entries.begin(), entries.end(), range_tombstones_);
+}
 
-  while (true) {
-    uint32_t keylen{0};
-    uint32_t valuelen{0};
-    uint32_t checksum{0};
-    auto bytes_read = ::read(fd, &keylen, sizeof(keylen));
-    if (bytes_read == 0) {
-      break;
-    }
-    if (bytes_read != sizeof(keylen)) {
-      ::close(fd);
-      return std::unexpected(StorageError::file_read(wal_path));
-    }
-    if (::read(fd, &valuelen, sizeof(valuelen)) != sizeof(valuelen)) {
-      ::close(fd);
-      return std::unexpected(StorageError::file_read(wal_path));
-    }
-    std::string key(keylen, '\0');
-    std::string value(valuelen, '\0');
-    if (::read(fd, key.data(), keylen) != static_cast<ssize_t>(keylen)) {
-      ::close(fd);
-      return std::unexpected(StorageError::file_read(wal_path));
+std::expected<std::vector<SSTable>, StorageError> MemTable::flush_to_ssts(
+    const std::function<std::expected<SSTable, StorageError>()> &create_table,
+    size_t target_file_size, const std::vector<std::string> &boundaries) {
+  if (auto res = fold_merges(); !res) {
+    return std::unexpected{res.error()};
+  }
+  auto entries = all_versions();
+  auto cuts = partition_entries(entries.cbegin(), entries.cend(),
+                                target_file_size, boundaries);
+  cuts.push_back(entries.cend());
+
+  std::vector<SSTable> ssts;
+  auto first = entries.cbegin();
+  for (auto last : cuts) {
+    auto sst = create_table();
+    if (!sst) {
+      return std::unexpected{sst.error()};
     }
-    if (::read(fd, value.data(), valuelen) != static_cast<ssize_t>(valuelen)) {
-      ::close(fd);
-      return std::unexpected(StorageError::file_read(wal_path));
+    // Each output carries the part of the range tombstones between its
+    // first key and the next output's.
+    std::string_view lower = ssts.empty() ? "" : std::string_view{first->first};
+    std::optional<std::string_view> upper;
+    if (last != entries.cend()) {
+      upper = last->first;
     }
-    if (::read(fd, &checksum, sizeof(checksum)) != sizeof(checksum)) {
-      ::close(fd);
-      return std::unexpected(StorageError::file_read(wal_path));
-    }
-    std::vector<std::byte> buf;
-    auto append = [&buf](const void *d, size_t len) {
-      auto data = reinterpret_cast<const std::byte *>(d);
-      buf.insert(buf.end(), data, data + len);
-    };
-
-    append(&keylen, sizeof(keylen));
-    append(&valuelen, sizeof(valuelen));
-    append(key.data(), key.size());
-    append(value.data(), value.size());
-
-    auto cs = hash32({reinterpret_cast<const char *>(buf.data()), buf.size()});
-    if (checksum != cs) {
-      ::close(fd);
-      return std::unexpected(
-          StorageError{.kind = StorageError::Kind::Corruption,
-                       .message = "Corrupted WAL entry, checksum mismatch",
-                       .path = wal_path});
+    auto ranges = range_tombstones_.clip(lower, upper);
+    if (auto res = sst->write_sorted(first, last, ranges); !res) {
+      return std::unexpected{res.error()};
     }
+    ssts.push_back(std::move(sst.value()));
+    first = last;
+  }
+  return ssts;
+}
 
-    put(std::move(key), std::move(value));
+std::expected<void, StorageError>
+MemTable::restore_from_wal(const std::filesystem::path &wal_path) {
+  auto records = Wal::read(wal_path);
+  if (!records) {
+    return std::unexpected{records.error()};
+  }
+  // Log order is sequence order.
+  for (auto &[key, entry] : *records) {
+    apply(std::move(key), std::move(entry));
   }
-  ::close(fd);
   return {};
 }
 } // namespace lsm_storage_engine
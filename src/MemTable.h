@@ -1,11 +1,18 @@
 #pragma once
 #include "Constants.h"
+#include "Entry.h"
+#include "MergeOperator.h"
+#include "RangeTombstones.h"
 #include "SSTable.h"
 #include "StorageError.h"
 #include <expected>
 #include <filesystem>
+#include <functional>
 #include <map>
 #include <optional>
+#include <ranges>
+#include <string>
+#include <vector>
 namespace lsm_storage_engine {
 
 /**
@@ -28,21 +35,133 @@ public:
   /**
    * @brief Retrieves the value associated with the given key.
    * @param key The key to look up.
-   * @return The value if found, std::nullopt otherwise.
+   * @param snapshot Ignore writes with larger sequence numbers.
+   * @return The value if found, std::nullopt otherwise. Also std::nullopt
+   *         for merge operands whose base value lives in an older table.
    */
-  std::optional<std::string> get(const std::string_view key) const;
+  std::optional<std::string>
+  get(const std::string_view key,
+      SequenceNumber snapshot = kMaxSequenceNumber) const;
+
+  /**
+   * @brief Like get(), but also reports tombstones and merge operands, so
+   * the caller knows whether to keep looking in older tables.
+   * @param key The key to look up.
+   * @param snapshot Ignore writes with larger sequence numbers.
+   * @return The entry (value, tombstone or folded merge operand) if found,
+   *         std::nullopt otherwise.
+   */
+  std::optional<Entry>
+  lookup(const std::string_view key,
+         SequenceNumber snapshot = kMaxSequenceNumber) const;
 
   /**
    * @brief Inserts or updates a key-value pair.
    * @param key The key to insert or update.
    * @param value The value to associate with the key.
    */
-  void put(std::string key, std::string value);
+  void put(std::string key, std::string value) {
+    put(std::move(key), Entry::put(std::move(value)));
+  }
+
+  /**
+   * @brief Inserts or replaces the entry (value or tombstone) for a key.
+   * @param key The key to insert or update.
+   * @param entry The entry to associate with the key.
+   */
+  void put(std::string key, Entry entry) {
+    apply(std::move(key), std::move(entry));
+  }
+
+  /**
+   * @brief Records a tombstone for the key.
+   * @param key The key to delete.
+   */
+  void remove(std::string key) {
+    put(std::move(key), Entry::tombstone());
+  }
+
+  /**
+   * @brief Deletes every key in [begin, end): drops the entries held here
+   * and records a range tombstone that hides older tables.
+   * @param begin First deleted key.
+   * @param end Exclusive end of the range.
+   */
+  void remove_range(std::string begin, std::string end) {
+    apply(std::move(begin), Entry{EntryType::RangeDelete, std::move(end), {}});
+  }
+
+  /**
+   * @brief Copies the entries with keys in [lower_bound, upper_bound), with
+   * merge operands folded, for a scan that must not hold the memtable lock.
+   * @param lower_bound Inclusive lower bound, or std::nullopt for none.
+   * @param upper_bound Exclusive upper bound, or std::nullopt for none.
+   * @param snapshot Ignore writes with larger sequence numbers.
+   * @return The entries, one per key, sorted by key.
+   */
+  std::vector<KeyEntry>
+  scan(const std::optional<std::string> &lower_bound,
+       const std::optional<std::string> &upper_bound,
+       SequenceNumber snapshot = kMaxSequenceNumber) const;
+
+  /**
+   * @brief Queues a merge operand for the key. Operands are only combined
+   * (by the merge operator) when the key is read or the table is flushed.
+   * @param key The key to update.
+   * @param operand The operand to apply.
+   */
+  void merge(std::string key, std::string operand) {
+    apply(std::move(key), Entry::merge(std::move(operand)));
+  }
+
+  /**
+   * @brief Sets the operator used to fold merge operands.
+   */
+  void set_merge_operator(const MergeOperator *merge_operator) {
+    merge_operator_ = merge_operator;
+  }
+
+  /**
+   * @brief Applies a WAL record: a put, a point delete, a range delete or a
+   * merge.
+   *
+   * A version the write replaces is kept if a snapshot may still read it,
+   * i.e. if its sequence number is at most `newest_snapshot`.
+   * @param key The key, or the start of a deleted range.
+   * @param entry The entry; for a range delete its value is the range end.
+   * @param newest_snapshot Sequence of the newest live snapshot, if any.
+   */
+  void apply(std::string key, Entry entry,
+             std::optional<SequenceNumber> newest_snapshot = std::nullopt);
+
+  /**
+   * @brief Deleted key ranges recorded since the last flush.
+   */
+  const RangeTombstoneList &range_tombstones() const {
+    return range_tombstones_;
+  }
+
+  /**
+   * @brief Calls `fn` on every key held, in order.
+   */
+  void for_each_key(const std::function<void(std::string_view)> &fn) const {
+    for (const auto &key : map_ | std::views::keys) {
+      fn(key);
+    }
+  }
+
+  /**
+   * @brief Largest sequence number applied since the last clear(), or 0.
+   */
+  SequenceNumber max_sequence() const { return max_sequence_; }
 
   /**
    * @brief Restores the MemTable state by replaying a write-ahead log.
+   *
+   * Applies what Wal::read() recovers, in order.
    * @param wal_path Path to the WAL file to replay.
-   * @return void on success, StorageError on failure.
+   * @return void on success, StorageError on failure or if a record before
+   *         the last fails its checksum.
    */
   std::expected<void, StorageError>
   restore_from_wal(const std::filesystem::path &wal_path);
@@ -58,12 +177,16 @@ public:
    */
   bool should_flush() const { return size() > flush_threshold_; }
 
+  void set_flush_threshold(size_t bytes) { flush_threshold_ = bytes; }
+
   /**
    * @brief Removes all entries and resets size to zero.
    */
   void clear() {
     map_.erase(map_.begin(), map_.end());
+    range_tombstones_.clear();
     size_ = 0;
+    max_sequence_ = 0;
   }
 
   /**
@@ -73,9 +196,56 @@ public:
    */
   std::expected<void, StorageError> flush_to_sst(SSTable &sst);
 
+  /**
+   * @brief Persists the MemTable contents as one or more SSTables, cut at
+   * about `target_file_size` bytes and aligned to next-level boundaries
+   * where possible (see partition_entries).
+   * @param create_table Creates each output SSTable.
+   * @param target_file_size Output size target, 0 for a single table.
+   * @param boundaries Sorted max keys of the tables in the next level.
+   * @return The written SSTables on success, StorageError on failure.
+   */
+  std::expected<std::vector<SSTable>, StorageError> flush_to_ssts(
+      const std::function<std::expected<SSTable, StorageError>()> &create_table,
+      size_t target_file_size, const std::vector<std::string> &boundaries);
+
+  /**
+   * @brief Folds every version's pending merge operands, ahead of a flush.
+   * @return void on success, StorageError if there are merge operands but
+   *         no merge operator.
+   */
+  std::expected<void, StorageError> fold_merges();
+
 private:
-  std::map<std::string, std::string> map_;
+  /**
+   * Versions of each key, newest first. A write replaces the newest version
+   * unless a snapshot may still see it.
+   */
+  std::map<std::string, std::vector<Entry>> map_;
+  const MergeOperator *merge_operator_{nullptr};
+  RangeTombstoneList range_tombstones_;
   size_t size_;
   size_t flush_threshold_;
+  SequenceNumber max_sequence_{0};
+
+  void insert(std::string key, Entry entry,
+              std::optional<SequenceNumber> newest_snapshot);
+  void insert_merge(std::string key, Entry operand,
+                    std::optional<SequenceNumber> newest_snapshot);
+  void insert_range(std::string begin, std::string end, SequenceNumber seq,
+                    std::optional<SequenceNumber> newest_snapshot);
+
+  /**
+   * @brief What a read at `snapshot` sees for a key with these versions.
+   */
+  std::optional<Entry> resolve(std::string_view key,
+                               const std::vector<Entry> *versions,
+                               SequenceNumber snapshot) const;
+
+  /**
+   * @brief Every version of every key, sorted by key and newest first, as
+   * an SSTable stores them.
+   */
+  std::vector<KeyEntry> all_versions() const;
 };
 } // namespace lsm_storage_engine
@@ -0,0 +1,40 @@
+#include "MergeOperator.h"
+#include <utility>
+namespace lsm_storage_engine {
+
+Entry apply_merge(const MergeOperator &op, std::string_view key,
+                  const std::optional<Entry> &older, const Entry &operand) {
+  Entry merged;
+  if (!older) {
+    merged = Entry::merge(operand.value);
+  } else {
+    switch (older->type) {
+    case EntryType::Put:
+      merged = Entry::put(op.merge(key, older->value, operand.value));
+      break;
+    case EntryType::Merge:
+      // Associative, so two operands combine into one.
+      merged = Entry::merge(op.merge(key, older->value, operand.value));
+      break;
+    default:
+      merged = Entry::put(op.merge(key, std::nullopt, operand.value));
+      break;
+    }
+  }
+  merged.seq = operand.seq;
+  return merged;
+}
+
+Entry fold_operands(const MergeOperator &op, std::string_view key,
+                    Entry entry) {
+  auto operands = std::exchange(entry.operands, {});
+  auto seq = entry.seq;
+  std::optional<Entry> folded{std::move(entry)};
+  for (auto &operand : operands) {
+    Entry newer = Entry::merge(std::move(operand));
+    newer.seq = seq;
+    folded = apply_merge(op, key, folded, newer);
+  }
+  return std::move(*folded);
+}
+} // namespace lsm_storage_engine
@@ -0,0 +1,57 @@
+#pragma once
+#include "Entry.h"
+#include <optional>
+#include <string>
+#include <string_view>
+namespace lsm_storage_engine {
+
+/**
+ * @brief User-supplied, associative read-modify-write operation.
+ *
+ * LsmTree::merge(key, operand) stores the operand as a blind write. Operands
+ * are combined with each other and with the key's value later, on get(),
+ * flush and compaction, so an update costs as much as a put().
+ *
+ * Because the operation is associative, two operands can be combined into
+ * one before the value they apply to is known: merge(key, a, b) is then a
+ * partial result that still needs to be applied to the value.
+ *
+ * Implementations must be thread-safe: readers call merge() concurrently.
+ */
+class MergeOperator {
+public:
+  virtual ~MergeOperator() = default;
+
+  /**
+   * @brief Apply an operand on top of an existing value or older operand.
+   * @param key The key being updated.
+   * @param existing The current value, an older operand, or std::nullopt if
+   *        the key doesn't exist.
+   * @param operand The newer operand.
+   * @return The combined value (or operand).
+   */
+  virtual std::string merge(std::string_view key,
+                            std::optional<std::string_view> existing,
+                            std::string_view operand) const = 0;
+};
+
+/**
+ * @brief Apply a merge operand on top of an older entry.
+ * @param older The older Put, Delete or Merge entry, or std::nullopt if no
+ *        older entry is known yet.
+ * @param operand The newer Merge entry.
+ * @return A Put when the base value is known (a Put or Delete underneath),
+ *         otherwise a Merge holding the combined operand. Either way it has
+ *         the operand's sequence number.
+ */
+Entry apply_merge(const MergeOperator &op, std::string_view key,
+                  const std::optional<Entry> &older, const Entry &operand);
+
+/**
+ * @brief Fold an entry's pending operands into it (see Entry::operands).
+ * @return An equivalent entry with no pending operands, and the sequence
+ *         number of the newest one.
+ */
+Entry fold_operands(const MergeOperator &op, std::string_view key,
+                    Entry entry);
+} // namespace lsm_storage_engine
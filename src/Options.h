@@ -0,0 +1,88 @@
+#pragma once
+#include "BlockCache.h"
+#include "Constants.h"
+#include "MergeOperator.h"
+#include "RateLimiter.h"
+#include "SSTable.h"
+#include "TableCache.h"
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+namespace lsm_storage_engine {
+
+/**
+ * @brief When writes reach the disk, not just the OS.
+ */
+enum class SyncMode {
+  /// The WAL is synced on flush and close; a machine crash can lose the
+  /// writes since, a process crash can't.
+  None,
+  /// Every write fsyncs the WAL before it returns.
+  EveryWrite,
+};
+
+/**
+ * @brief Configuration of one LsmTree.
+ *
+ * Each tree owns its directory, so trees with different directories can
+ * run side by side in one process. The tuning fields from `memtable_bytes` on
+ * can also be changed on an open tree with LsmTree::set_options(); they apply
+ * to the next write, flush or compaction, and tables already written keep how
+ * they were built.
+ *
+ * The row cache isn't shareable: its entries are keyed by user key alone.
+ */
+struct Options {
+  /// Holds the WAL, manifest and SSTables. Created if missing.
+  std::filesystem::path dir{"."};
+  /// Combines operands written with merge(). Needed to read, flush or
+  /// compact keys that have any.
+  std::shared_ptr<const MergeOperator> merge_operator;
+  /// How SSTable data blocks are read. Pread and Direct read into the block
+  /// cache instead of mapping the files.
+  ReadMode read_mode{ReadMode::Mmap};
+
+  /// Set these to share them with other trees (the shards of a ShardedLsm,
+  /// say); the tree makes its own of any left null.
+  std::shared_ptr<BlockCache> block_cache;
+  std::shared_ptr<TableCache> table_cache;
+  /// One budget for the flushes and compactions of every tree sharing it.
+  std::shared_ptr<RateLimiter> rate_limiter;
+  /// Budget of the tree's own row cache. 0 disables it.
+  size_t row_cache_bytes{lsm_constants::kRowCacheBytes};
+
+  /// The memtable is flushed once it holds this many bytes.
+  size_t memtable_bytes{lsm_constants::kMemTableFlushThreshold};
+  /// SSTables index every this many entries: fewer means a smaller index
+  /// but longer scans within a block.
+  size_t index_interval{lsm_constants::kIndexSpace};
+  /// Bloom filter bits per key. 0 writes tables without a filter.
+  size_t bloom_bits_per_key{lsm_constants::kBloomBitsPerKey};
+  /// Flush and compaction outputs are cut into files of about this size.
+  size_t target_file_size{lsm_constants::kTargetFileSize};
+  /// Level 0 is compacted once it holds this many tables...
+  size_t compaction_trigger{lsm_constants::kCompactionTrigger};
+  /// ...and each level below once it holds this many times the one above.
+  size_t level_size_multiplier{lsm_constants::kLevelSizeMultiplier};
+  SyncMode sync_mode{SyncMode::None};
+
+  /**
+   * @brief Create the caches and rate limiter left null, so every tree
+   * opened with a copy of these options shares them.
+   */
+  void create_shared() {
+    if (!block_cache) {
+      block_cache = std::make_shared<BlockCache>(
+          read_mode == ReadMode::Mmap ? 0 : lsm_constants::kBlockCacheBytes);
+    }
+    if (!table_cache) {
+      table_cache =
+          std::make_shared<TableCache>(lsm_constants::kTableCacheSize);
+    }
+    if (!rate_limiter) {
+      rate_limiter =
+          std::make_shared<RateLimiter>(lsm_constants::kRateLimitBytesPerSec);
+    }
+  }
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,159 @@
+#include "RangeTombstones.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+namespace lsm_storage_engine {
+
+/**
+ * `seqs` (newest first) with `seq` added, unless it is already there.
+ */
+static std::vector<SequenceNumber> with_seq(std::vector<SequenceNumber> seqs,
+                                            SequenceNumber seq) {
+  auto it = std::ranges::lower_bound(seqs, seq, std::ranges::greater{});
+  if (it == seqs.end() || *it != seq) {
+    seqs.insert(it, seq);
+  }
+  return seqs;
+}
+
+void RangeTombstoneList::add(std::string begin, std::string end,
+                             SequenceNumber seq) {
+  if (begin >= end) {
+    return;
+  }
+  // Sweep the fragments left to right, splitting those the new range
+  // crosses. `pos` is where the part of [begin, end) not placed yet starts.
+  std::vector<Fragment> result;
+  result.reserve(fragments_.size() + 3);
+  std::string pos = begin;
+  bool placed = false;
+  for (auto &fragment : fragments_) {
+    if (placed || fragment.end <= pos) {
+      result.push_back(std::move(fragment));
+      continue;
+    }
+    if (fragment.begin >= end) {
+      result.push_back({pos, end, {seq}});
+      placed = true;
+      result.push_back(std::move(fragment));
+      continue;
+    }
+    if (fragment.begin > pos) {
+      // Gap before this fragment.
+      result.push_back({pos, fragment.begin, {seq}});
+      pos = fragment.begin;
+    } else if (fragment.begin < pos) {
+      // Head of the fragment before the new range.
+      result.push_back({fragment.begin, pos, fragment.seqs});
+    }
+    auto overlap_end = std::min(fragment.end, end);
+    result.push_back({pos, overlap_end, with_seq(fragment.seqs, seq)});
+    if (fragment.end > end) {
+      // Tail of the fragment after the new range.
+      result.push_back({end, std::move(fragment.end), fragment.seqs});
+    }
+    pos = std::move(overlap_end);
+    placed = pos == end;
+  }
+  if (!placed) {
+    result.push_back({std::move(pos), std::move(end), {seq}});
+  }
+
+  // Merge touching fragments that ended up with the same deletes.
+  fragments_.clear();
+  for (auto &fragment : result) {
+    if (!fragments_.empty() && fragments_.back().end == fragment.begin &&
+        fragments_.back().seqs == fragment.seqs) {
+      fragments_.back().end = std::move(fragment.end);
+    } else {
+      fragments_.push_back(std::move(fragment));
+    }
+  }
+}
+
+void RangeTombstoneList::add(const RangeTombstoneList &other) {
+  for (const auto &fragment : other.fragments_) {
+    for (auto seq : fragment.seqs) {
+      add(fragment.begin, fragment.end, seq);
+    }
+  }
+}
+
+std::span<const SequenceNumber>
+RangeTombstoneList::covering(std::string_view key) const {
+  // Last fragment starting at or before `key`.
+  auto it = std::ranges::upper_bound(fragments_, key, std::ranges::less{},
+                                     &Fragment::begin);
+  if (it == fragments_.begin() || key >= std::prev(it)->end) {
+    return {};
+  }
+  return std::prev(it)->seqs;
+}
+
+std::optional<SequenceNumber>
+RangeTombstoneList::covering_seq(std::string_view key,
+                                 SequenceNumber snapshot) const {
+  auto seqs = covering(key);
+  auto it = std::ranges::lower_bound(seqs, snapshot, std::ranges::greater{});
+  if (it == seqs.end()) {
+    return std::nullopt;
+  }
+  return *it;
+}
+
+bool RangeTombstoneList::covers(std::string_view first, std::string_view last,
+                                SequenceNumber snapshot) const {
+  auto it = std::ranges::upper_bound(fragments_, first, std::ranges::less{},
+                                     &Fragment::begin);
+  if (it == fragments_.begin()) {
+    return false;
+  }
+  --it;
+  // Walk touching fragments until one reaches past `last`.
+  std::string_view pos = first;
+  for (; it != fragments_.end() && it->begin <= pos && pos < it->end; ++it) {
+    if (it->seqs.back() > snapshot) {
+      return false;
+    }
+    if (last < it->end) {
+      return true;
+    }
+    pos = it->end;
+  }
+  return false;
+}
+
+bool RangeTombstoneList::overlaps(std::string_view first,
+                                  std::string_view last) const {
+  // First fragment ending after `first`; it intersects if it starts in time.
+  auto it = std::ranges::upper_bound(fragments_, first, std::ranges::less{},
+                                     &Fragment::end);
+  return it != fragments_.end() && it->begin <= last;
+}
+
+RangeTombstoneList
+RangeTombstoneList::clip(std::string_view lower,
+                         std::optional<std::string_view> upper) const {
+  RangeTombstoneList clipped;
+  for (const auto &fragment : fragments_) {
+    auto begin = std::max<std::string_view>(fragment.begin, lower);
+    auto end = upper ? std::min<std::string_view>(fragment.end, *upper)
+                     : std::string_view{fragment.end};
+    if (begin < end) {
+      // Input is sorted and disjoint, so appending keeps it that way.
+      clipped.fragments_.push_back(
+          {std::string{begin}, std::string{end}, fragment.seqs});
+    }
+  }
+  return clipped;
+}
+
+SequenceNumber RangeTombstoneList::max_sequence() const {
+  SequenceNumber max{0};
+  for (const auto &fragment : fragments_) {
+    max = std::max(max, fragment.seqs.front());
+  }
+  return max;
+}
+} // namespace lsm_storage_engine
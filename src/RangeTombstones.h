@@ -0,0 +1,102 @@
+#pragma once
+#include "Entry.h"
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Sorted, non-overlapping list of deleted key ranges.
+ *
+ * Each delete_range(begin, end) adds a [begin, end) range at its sequence
+ * number. Overlapping ranges are split where they cross, so the list stays
+ * fragmented (sorted and disjoint), each fragment carrying the sequence
+ * numbers of every delete over it, and a point lookup is a single binary
+ * search. Touching fragments with the same sequence numbers are merged.
+ *
+ * A range tombstone hides the entries for its keys with smaller sequence
+ * numbers, in its own source or older ones. Entries written after it stay
+ * visible.
+ *
+ * Not thread-safe.
+ */
+class RangeTombstoneList {
+public:
+  struct Fragment {
+    std::string begin;
+    /// Exclusive.
+    std::string end;
+    /// Sequence numbers of the deletes covering the fragment, newest first.
+    std::vector<SequenceNumber> seqs;
+  };
+
+  /**
+   * @brief Add the range [begin, end), deleted at `seq`. Empty ranges are
+   * ignored.
+   */
+  void add(std::string begin, std::string end, SequenceNumber seq = 0);
+
+  /**
+   * @brief Add every range of another list.
+   */
+  void add(const RangeTombstoneList &other);
+
+  /**
+   * @brief Sequence numbers of the deletes covering the key, newest first;
+   * empty if none do.
+   */
+  std::span<const SequenceNumber> covering(std::string_view key) const;
+
+  /**
+   * @brief The newest delete covering the key that a read at `snapshot` can
+   * see, if any. Entries for the key older than it are hidden.
+   */
+  std::optional<SequenceNumber>
+  covering_seq(std::string_view key,
+               SequenceNumber snapshot = kMaxSequenceNumber) const;
+
+  /**
+   * @brief Whether the key falls inside a range deleted at or before
+   * `snapshot`.
+   */
+  bool covers(std::string_view key,
+              SequenceNumber snapshot = kMaxSequenceNumber) const {
+    return covering_seq(key, snapshot).has_value();
+  }
+
+  /**
+   * @brief Whether every key in [first, last] (inclusive) falls inside a
+   * range deleted at or before `snapshot`.
+   */
+  bool covers(std::string_view first, std::string_view last,
+              SequenceNumber snapshot = kMaxSequenceNumber) const;
+
+  /**
+   * @brief Whether any deleted range intersects [first, last] (inclusive).
+   */
+  bool overlaps(std::string_view first, std::string_view last) const;
+
+  /**
+   * @brief The ranges intersected with [lower, upper).
+   * @param lower Inclusive lower bound; "" is unbounded.
+   * @param upper Exclusive upper bound, or std::nullopt for unbounded.
+   */
+  RangeTombstoneList clip(std::string_view lower,
+                          std::optional<std::string_view> upper) const;
+
+  /**
+   * @brief The largest sequence number of any delete, or 0 if empty.
+   */
+  SequenceNumber max_sequence() const;
+
+  const std::vector<Fragment> &fragments() const { return fragments_; }
+  bool empty() const { return fragments_.empty(); }
+  void clear() { fragments_.clear(); }
+
+private:
+  /// Sorted by begin; disjoint.
+  std::vector<Fragment> fragments_;
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,149 @@
+#include "RateLimiter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+namespace lsm_storage_engine {
+
+void RateLimiter::request(size_t bytes, Priority priority) {
+  auto pri = static_cast<size_t>(priority);
+  bytes_[pri].fetch_add(bytes, std::memory_order_relaxed);
+  if (bytes_per_second() == 0) {
+    return;
+  }
+
+  auto start = Clock::now();
+  bool throttled = false;
+  {
+    std::unique_lock lock(mu_);
+    ++waiting_[pri];
+    while (true) {
+      auto rate = static_cast<double>(bytes_per_second());
+      if (rate == 0) {
+        break;
+      }
+      refill(Clock::now());
+      // Compaction yields to any waiting flush.
+      bool yield = priority == Priority::Compaction &&
+                   waiting_[static_cast<size_t>(Priority::Flush)] > 0;
+      if (!yield && tokens_ >= 0) {
+        tokens_ -= static_cast<double>(bytes);
+        break;
+      }
+      throttled = true;
+      auto wait = yield ? std::chrono::microseconds(1000)
+                        : std::chrono::microseconds(static_cast<long long>(
+                              -tokens_ / rate * 1e6) + 1);
+      cv_.wait_for(lock, wait);
+    }
+    --waiting_[pri];
+  }
+  cv_.notify_all();
+
+  if (throttled) {
+    auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                      Clock::now() - start)
+                      .count();
+    throttled_count_[pri].fetch_add(1, std::memory_order_relaxed);
+    throttled_time_us_[pri].fetch_add(waited, std::memory_order_relaxed);
+  }
+}
+
+void RateLimiter::charge(size_t bytes, Priority priority) {
+  bytes_[static_cast<size_t>(priority)].fetch_add(bytes,
+                                                  std::memory_order_relaxed);
+  if (bytes_per_second() == 0) {
+    return;
+  }
+  std::lock_guard lock(mu_);
+  refill(Clock::now());
+  tokens_ -= static_cast<double>(bytes);
+}
+
+void RateLimiter::refill(Clock::time_point now) {
+  auto rate = static_cast<double>(bytes_per_second());
+  auto elapsed = std::chrono::duration<double>(now - last_refill_).count();
+  last_refill_ = now;
+  auto capacity = rate * std::chrono::duration<double>(kRefillPeriod).count();
+  tokens_ = std::min(tokens_ + rate * elapsed, capacity);
+}
+
+size_t RateLimiter::max_bytes_per_second() {
+  std::lock_guard lock(mu_);
+  return max_bytes_per_second_;
+}
+
+void RateLimiter::set_bytes_per_second(size_t bytes_per_second) {
+  {
+    std::lock_guard lock(mu_);
+    refill(Clock::now());
+    max_bytes_per_second_ = bytes_per_second;
+    bytes_per_second_.store(bytes_per_second, std::memory_order_relaxed);
+  }
+  cv_.notify_all();
+}
+
+void RateLimiter::set_auto_tune(long long target_latency_us) {
+  target_latency_us_.store(target_latency_us, std::memory_order_relaxed);
+  window_latency_sum_us_.store(0, std::memory_order_relaxed);
+  window_samples_.store(0, std::memory_order_relaxed);
+  if (target_latency_us == 0) {
+    // Tuning off: go back to the configured rate.
+    set_bytes_per_second(max_bytes_per_second());
+  }
+}
+
+void RateLimiter::record_foreground_latency(long long latency_us) {
+  if (target_latency_us_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  auto sum = window_latency_sum_us_.fetch_add(latency_us,
+                                              std::memory_order_relaxed) +
+             latency_us;
+  auto samples = window_samples_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (samples % kTuneWindow == 0) {
+    window_latency_sum_us_.fetch_sub(sum, std::memory_order_relaxed);
+    window_samples_.fetch_sub(samples, std::memory_order_relaxed);
+    tune(sum / samples);
+  }
+}
+
+void RateLimiter::tune(long long avg_latency_us) {
+  {
+    std::lock_guard lock(mu_);
+    if (max_bytes_per_second_ == 0) {
+      return;
+    }
+    auto target = target_latency_us_.load(std::memory_order_relaxed);
+    auto rate = bytes_per_second();
+    auto floor = std::max<size_t>(max_bytes_per_second_ / kTuneMinDivisor, 1);
+    refill(Clock::now());
+    // Multiplicative decrease when reads suffer, gentle recovery otherwise.
+    if (avg_latency_us > target) {
+      rate = std::max(floor, rate / 2);
+    } else {
+      rate = std::min(max_bytes_per_second_, rate + rate / 8 + 1);
+    }
+    bytes_per_second_.store(rate, std::memory_order_relaxed);
+  }
+  cv_.notify_all();
+}
+
+RateLimiter::Stats RateLimiter::stats() const {
+  constexpr auto kFlush = static_cast<size_t>(Priority::Flush);
+  constexpr auto kCompaction = static_cast<size_t>(Priority::Compaction);
+  return Stats{
+      .bytes_per_second = bytes_per_second(),
+      .flush_bytes = bytes_[kFlush].load(std::memory_order_relaxed),
+      .compaction_bytes = bytes_[kCompaction].load(std::memory_order_relaxed),
+      .flush_throttled_count =
+          throttled_count_[kFlush].load(std::memory_order_relaxed),
+      .compaction_throttled_count =
+          throttled_count_[kCompaction].load(std::memory_order_relaxed),
+      .flush_throttled_time_us =
+          throttled_time_us_[kFlush].load(std::memory_order_relaxed),
+      .compaction_throttled_time_us =
+          throttled_time_us_[kCompaction].load(std::memory_order_relaxed),
+  };
+}
+} // namespace lsm_storage_engine
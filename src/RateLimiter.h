@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Token-bucket rate limiter for background (flush/compaction) writes.
+ *
+ * One limiter is shared by every SSTable writer of an LsmTree. Writers call
+ * request() before each write syscall and block until enough tokens have
+ * accumulated, or charge() to take them without waiting. Flush requests are
+ * served before compaction requests, since a stalled flush eventually stalls
+ * foreground writes.
+ *
+ * Optionally auto-tunes: foreground read latencies are fed in through
+ * record_foreground_latency(), and the rate is cut when they exceed the
+ * target and slowly restored when they are back under it.
+ *
+ * A rate of 0 disables limiting (the default). Thread-safe.
+ */
+class RateLimiter {
+public:
+  enum class Priority { Flush = 0, Compaction = 1 };
+
+  explicit RateLimiter(size_t bytes_per_second = 0)
+      : bytes_per_second_(bytes_per_second),
+        max_bytes_per_second_(bytes_per_second),
+        last_refill_(std::chrono::steady_clock::now()) {}
+
+  /// Shared between threads, so no copies or moves.
+  RateLimiter(const RateLimiter &) = delete;
+  RateLimiter &operator=(const RateLimiter &) = delete;
+
+  /**
+   * @brief Block until `bytes` may be written at the given priority.
+   * @param bytes Number of bytes about to be written.
+   * @param priority Flush (high) or Compaction (low).
+   */
+  void request(size_t bytes, Priority priority);
+
+  /**
+   * @brief Count `bytes` against the budget without waiting, for writers
+   * that must not sleep (a flush holding the tree's lock). The requests
+   * after it repay the debt.
+   */
+  void charge(size_t bytes, Priority priority);
+
+  /**
+   * @brief Change the configured rate. 0 disables limiting.
+   *
+   * This is also the ceiling auto-tuning will climb back to.
+   */
+  void set_bytes_per_second(size_t bytes_per_second);
+
+  /**
+   * @brief Enable or disable auto-tuning.
+   * @param target_latency_us Foreground latency the tuner aims to stay under.
+   *        0 disables auto-tuning.
+   */
+  void set_auto_tune(long long target_latency_us);
+
+  /**
+   * @brief Feed one observed foreground operation latency to the auto-tuner.
+   */
+  void record_foreground_latency(long long latency_us);
+
+  /**
+   * @brief Current effective rate in bytes per second (0 = unlimited).
+   */
+  size_t bytes_per_second() const {
+    return bytes_per_second_.load(std::memory_order_relaxed);
+  }
+
+  struct Stats {
+    size_t bytes_per_second;
+    unsigned long flush_bytes;
+    unsigned long compaction_bytes;
+    unsigned long flush_throttled_count;
+    unsigned long compaction_throttled_count;
+    long long flush_throttled_time_us;
+    long long compaction_throttled_time_us;
+  };
+
+  /**
+   * @brief Get throughput and throttling statistics.
+   */
+  Stats stats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /// Bucket holds at most this much time worth of tokens (bounds bursts).
+  static constexpr auto kRefillPeriod = std::chrono::milliseconds(100);
+  /// Number of foreground samples the auto-tuner averages per adjustment.
+  static constexpr long long kTuneWindow = 256;
+  /// Auto-tuning never throttles below max / kTuneMinDivisor.
+  static constexpr size_t kTuneMinDivisor = 20;
+
+  std::atomic<size_t> bytes_per_second_;
+  size_t max_bytes_per_second_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  /// May go negative: a large write is admitted and the debt is repaid later.
+  double tokens_{0};
+  Clock::time_point last_refill_;
+  std::array<int, 2> waiting_{};
+
+  std::atomic<long long> target_latency_us_{0};
+  std::atomic<long long> window_latency_sum_us_{0};
+  std::atomic<long long> window_samples_{0};
+
+  std::array<std::atomic<unsigned long>, 2> bytes_{};
+  std::array<std::atomic<unsigned long>, 2> throttled_count_{};
+  std::array<std::atomic<long long>, 2> throttled_time_us_{};
+
+  /**
+   * @brief Add tokens for the time elapsed since the last refill. Holds mu_.
+   */
+  void refill(Clock::time_point now);
+
+  /**
+   * @brief Adjust the rate from the last window of foreground latencies.
+   */
+  void tune(long long avg_latency_us);
+
+  size_t max_bytes_per_second();
+};
+} // namespace lsm_storage_engine
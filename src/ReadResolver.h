@@ -0,0 +1,65 @@
+#pragma once
+#include "Entry.h"
+#include "MergeOperator.h"
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Newest-first resolution of one key's entries into its value.
+ *
+ * The newest value or tombstone settles the key; merge operands stack up
+ * until one is found. Shared by point reads and scans.
+ */
+class ReadResolver {
+public:
+  /**
+   * @brief Feed the next entry for the key, newest first.
+   * @return Whether the key is settled, i.e. older entries don't matter.
+   */
+  bool add(Entry &&entry) {
+    if (entry.type == EntryType::Merge) {
+      operands_.push_back(std::move(entry.value));
+      return false;
+    }
+    if (entry.type == EntryType::Put) {
+      result_ = std::move(entry.value);
+    }
+    settled_ = true;
+    return true;
+  }
+
+  bool settled() const { return settled_; }
+
+  /**
+   * @brief The key's value, with any merge operands folded in.
+   * @throws std::runtime_error if there are operands but no operator.
+   */
+  std::optional<std::string> finish(std::string_view key,
+                                    const MergeOperator *merge_operator) {
+    if (!operands_.empty()) {
+      if (!merge_operator) {
+        throw std::runtime_error("Found merge operands but no merge operator!");
+      }
+      for (const auto &operand : operands_ | std::views::reverse) {
+        std::optional<std::string_view> existing;
+        if (result_) {
+          existing = *result_;
+        }
+        result_ = merge_operator->merge(key, existing, operand);
+      }
+    }
+    return std::move(result_);
+  }
+
+private:
+  /// Merge operands found so far, newest first, waiting for a base value.
+  std::vector<std::string> operands_;
+  std::optional<std::string> result_;
+  bool settled_{false};
+};
+} // namespace lsm_storage_engine
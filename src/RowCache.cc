@@ -0,0 +1,127 @@
+#include "RowCache.h"
+#include "utils/CheckSum.h"
+namespace lsm_storage_engine {
+
+/// Rough per-key overhead of the list node, index slot and string headers.
+static constexpr size_t kEntryOverhead = 128;
+
+RowCache::Shard::Shard(size_t shard_capacity)
+    : capacity(shard_capacity),
+      // About one counter per cached key, assuming small rows.
+      sketch(shard_capacity / kEntryOverhead) {}
+
+void RowCache::Shard::evict(LruList::iterator it) {
+  usage -= charge(it->first, it->second);
+  index.erase(it->first);
+  lru.erase(it);
+}
+
+RowCache::RowCache(size_t capacity_bytes, size_t num_shards)
+    : capacity_(capacity_bytes) {
+  if (!enabled()) {
+    return;
+  }
+  num_shards = std::max<size_t>(num_shards, 1);
+  for (size_t i = 0; i < num_shards; ++i) {
+    shards_.push_back(std::make_unique<Shard>(capacity_bytes / num_shards));
+  }
+}
+
+size_t RowCache::charge(std::string_view key, std::string_view value) {
+  return key.size() + value.size() + kEntryOverhead;
+}
+
+std::optional<std::string> RowCache::lookup(std::string_view key) {
+  if (!enabled()) {
+    return std::nullopt;
+  }
+  auto hash = xxhash64(key);
+  auto &s = shard(hash);
+  std::lock_guard lock(s.mutex);
+  s.sketch.increment(hash);
+  auto it = s.index.find(key);
+  if (it == s.index.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  s.lru.splice(s.lru.begin(), s.lru, it->second);
+  return it->second->second;
+}
+
+void RowCache::insert(std::string_view key, std::string_view value,
+                      uint64_t generation) {
+  if (!enabled()) {
+    return;
+  }
+  auto hash = xxhash64(key);
+  auto &s = shard(hash);
+  auto size = charge(key, value);
+  std::lock_guard lock(s.mutex);
+  // Checked under the shard lock: an invalidation bumps the generation
+  // before erasing, so either it sees this insert or this sees its bump.
+  if (generation != generation_.load(std::memory_order_acquire) ||
+      size > s.capacity) {
+    return;
+  }
+  if (auto it = s.index.find(key); it != s.index.end()) {
+    s.evict(it->second);
+  }
+
+  // Make room from the LRU end, but only for a key read more often than
+  // every victim: a one-off read can't push out a hot key.
+  auto frequency = s.sketch.estimate(hash);
+  std::vector<LruList::iterator> victims;
+  size_t freed = 0;
+  for (auto it = s.lru.end(); s.usage - freed + size > s.capacity;) {
+    --it;
+    if (s.sketch.estimate(xxhash64(it->first)) >= frequency) {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    freed += charge(it->first, it->second);
+    victims.push_back(it);
+  }
+  for (auto victim : victims) {
+    s.evict(victim);
+  }
+
+  s.lru.emplace_front(std::string{key}, std::string{value});
+  s.index.emplace(s.lru.front().first, s.lru.begin());
+  s.usage += size;
+}
+
+void RowCache::erase(std::string_view key) {
+  if (!enabled()) {
+    return;
+  }
+  auto &s = shard(xxhash64(key));
+  std::lock_guard lock(s.mutex);
+  if (auto it = s.index.find(key); it != s.index.end()) {
+    s.evict(it->second);
+  }
+}
+
+void RowCache::clear() {
+  for (auto &s : shards_) {
+    std::lock_guard lock(s->mutex);
+    s->index.clear();
+    s->lru.clear();
+    s->usage = 0;
+  }
+}
+
+RowCache::Stats RowCache::stats() const {
+  size_t usage = 0;
+  for (const auto &s : shards_) {
+    std::lock_guard lock(s->mutex);
+    usage += s->usage;
+  }
+  return Stats{
+      .hits = hits_.load(std::memory_order_relaxed),
+      .misses = misses_.load(std::memory_order_relaxed),
+      .rejected = rejected_.load(std::memory_order_relaxed),
+      .usage = usage,
+  };
+}
+} // namespace lsm_storage_engine
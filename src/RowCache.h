@@ -0,0 +1,132 @@
+#pragma once
+#include "Constants.h"
+#include "utils/FrequencySketch.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Cache of hot keys' values as read from the SSTables.
+ *
+ * Point reads that miss the memtable check here before walking the
+ * SSTables, so a hot key costs one hash lookup instead of bloom probes,
+ * index searches and an entry decode per table.
+ *
+ * Split into shards by key hash, each with its own lock, LRU list and share
+ * of the byte budget. Admission is TinyLFU: every lookup is counted in a
+ * per-shard FrequencySketch, and a new key only displaces the LRU victims
+ * if it was read more often than each of them. A scan of cold keys can't
+ * flush the hot ones out.
+ *
+ * The owner keeps it coherent: erase() keys before their new values become
+ * visible in the SSTables, and bump the generation at the same time, so
+ * reads that started earlier can't insert what they saw (see insert()).
+ *
+ * A capacity of 0 disables caching. Thread-safe.
+ */
+class RowCache {
+public:
+  /**
+   * @param capacity_bytes Budget for keys, values and bookkeeping.
+   * @param num_shards Number of independently locked shards.
+   */
+  explicit RowCache(size_t capacity_bytes,
+                    size_t num_shards = lsm_constants::kRowCacheShards);
+
+  /// Shared between threads, so no copies or moves.
+  RowCache(const RowCache &) = delete;
+  RowCache &operator=(const RowCache &) = delete;
+
+  bool enabled() const { return capacity_ > 0; }
+
+  /**
+   * @brief The cached value of `key`, if any. Counts as an access for
+   * admission either way.
+   */
+  std::optional<std::string> lookup(std::string_view key);
+
+  /**
+   * @brief Current generation; read it before reading the SSTables for a
+   * later insert().
+   */
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Invalidate every read in flight: their insert() calls are
+   * dropped.
+   */
+  void bump_generation() {
+    generation_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  /**
+   * @brief Cache `value` for `key`, if the admission policy lets it in.
+   * @param generation generation() as of before the SSTables were read; the
+   *        insert is dropped if it has changed since.
+   */
+  void insert(std::string_view key, std::string_view value,
+              uint64_t generation);
+
+  /// Drop `key` from the cache.
+  void erase(std::string_view key);
+
+  /// Drop every key.
+  void clear();
+
+  struct Stats {
+    unsigned long hits;
+    unsigned long misses;
+    /// New keys turned away because their LRU victims were hotter.
+    unsigned long rejected;
+    /// Bytes charged for the cached keys.
+    size_t usage;
+  };
+
+  Stats stats() const;
+
+private:
+  using LruList = std::list<std::pair<std::string, std::string>>;
+
+  struct Shard {
+    explicit Shard(size_t capacity);
+
+    std::mutex mutex;
+    size_t capacity;
+    size_t usage{0};
+    /// Keys and values, most recently used first.
+    LruList lru;
+    /// Keys view the strings in `lru`, which never move.
+    std::unordered_map<std::string_view, LruList::iterator> index;
+    FrequencySketch sketch;
+
+    void evict(LruList::iterator it);
+  };
+
+  size_t capacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<unsigned long> hits_{0};
+  std::atomic<unsigned long> misses_{0};
+  std::atomic<unsigned long> rejected_{0};
+
+  /// High hash bits pick the shard; the sketch uses the low ones.
+  Shard &shard(uint64_t hash) {
+    return *shards_[(hash >> 48) % shards_.size()];
+  }
+
+  /// Bytes charged for one cached key.
+  static size_t charge(std::string_view key, std::string_view value);
+};
+} // namespace lsm_storage_engine
@@ -1,14 +1,18 @@
 #include "SSTable.h"
 #include "Constants.h"
 #include "StorageError.h"
+#include "TableCache.h"
 #include "utils/CheckSum.h"
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <expected>
 #include <fcntl.h>
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <print>
 #include <span>
@@ -20,33 +24,137 @@
 #include <vector>
 namespace lsm_storage_engine {
 
+/**
+ * madvise() the mapped part of [offset, offset + length), widened to start
+ * on a page boundary as madvise wants.
+ */
+static void advise_mapping(std::span<std::byte> mapping, size_t offset,
+                           size_t length, int advice) {
+  static const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  if (mapping.data() == nullptr || offset >= mapping.size() || length == 0) {
+    return;
+  }
+  length = std::min(length, mapping.size() - offset);
+  size_t aligned = offset - offset % page_size;
+  ::madvise(mapping.data() + aligned, length + (offset - aligned), advice);
+}
+
+/**
+ * Apply the readahead policy for `access` to a freshly opened (or already
+ * open) file.
+ */
+static void apply_advice(const TableFile &file, SSTable::Access access,
+                         ReadMode mode) {
+  bool sequential = access == SSTable::Access::Sequential;
+  advise_mapping(file.mapping, 0, file.mapping.size(),
+                 sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  if (mode != ReadMode::Direct) {
+    ::posix_fadvise(file.fd, 0, 0,
+                    sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+  }
+}
+
 SSTable::SSTable(SSTable &&other) noexcept
     : path_{std::move(other.path_)}, fd_{std::exchange(other.fd_, -1)},
       file_pos_{std::exchange(other.file_pos_, 0)},
       mapped_data_{std::exchange(other.mapped_data_, {})},
       file_size_{std::exchange(other.file_size_, 0)},
+      ready_{std::exchange(other.ready_, false)},
       header_{std::move(other.header_)}, footer_{other.footer_},
+      filter_size_{other.filter_size_}, filter_hashes_{other.filter_hashes_},
       index_{std::move(other.index_)},
-      bloom_filter_{std::move(other.bloom_filter_)} {}
+      bloom_filter_{std::move(other.bloom_filter_)},
+      range_tombstones_{std::move(other.range_tombstones_)},
+      metadata_loaded_{other.metadata_loaded_.exchange(true)},
+      metadata_error_{std::exchange(other.metadata_error_, std::nullopt)},
+      rate_limiter_{std::exchange(other.rate_limiter_, nullptr)},
+      io_priority_{other.io_priority_},
+      wait_for_limiter_{other.wait_for_limiter_},
+      obsolete_{other.obsolete_.exchange(false)}, options_{other.options_},
+      file_id_{other.file_id_},
+      sequential_{std::exchange(other.sequential_, {})},
+      sequential_offset_{other.sequential_offset_},
+      access_{other.access_.load()},
+      readahead_until_{other.readahead_until_} {
+  // The cache tracks tables by address; this one signs up on its next read.
+  if (options_.table_cache != nullptr) {
+    options_.table_cache->erase(other);
+  }
+  file_ = std::exchange(other.file_, nullptr);
+}
+
+uint64_t SSTable::next_file_id() {
+  static std::atomic<uint64_t> next{0};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+TableFile::~TableFile() {
+  if (mapping.data() != nullptr) {
+    ::munmap(mapping.data(), mapping.size());
+  }
+  if (direct_fd != -1) {
+    ::close(direct_fd);
+  }
+  if (fd != -1) {
+    ::close(fd);
+  }
+}
+
+SSTable::~SSTable() {
+  if (options_.table_cache != nullptr) {
+    options_.table_cache->erase(*this);
+  }
+  close_file();
+  sequential_ = {};
+  file_.reset();
+  if (obsolete_.load(std::memory_order_acquire)) {
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+  }
+}
 
 SSTable &SSTable::operator=(SSTable &&other) noexcept {
   if (this != &other) {
+    if (options_.table_cache != nullptr) {
+      options_.table_cache->erase(*this);
+    }
+    if (other.options_.table_cache != nullptr) {
+      other.options_.table_cache->erase(other);
+    }
     close_file();
     path_ = std::move(other.path_);
     fd_ = std::exchange(other.fd_, -1);
     mapped_data_ = std::exchange(other.mapped_data_, {});
     file_pos_ = std::exchange(other.file_pos_, 0);
     file_size_ = std::exchange(other.file_size_, 0);
+    ready_ = std::exchange(other.ready_, false);
     header_ = std::move(other.header_);
     footer_ = other.footer_;
+    filter_size_ = other.filter_size_;
+    filter_hashes_ = other.filter_hashes_;
     index_ = std::move(other.index_);
     bloom_filter_ = std::move(other.bloom_filter_);
+    range_tombstones_ = std::move(other.range_tombstones_);
+    metadata_loaded_ = other.metadata_loaded_.exchange(true);
+    metadata_error_ = std::exchange(other.metadata_error_, std::nullopt);
+    rate_limiter_ = std::exchange(other.rate_limiter_, nullptr);
+    io_priority_ = other.io_priority_;
+    wait_for_limiter_ = other.wait_for_limiter_;
+    obsolete_.store(other.obsolete_.exchange(false));
+    options_ = other.options_;
+    file_id_ = other.file_id_;
+    file_ = std::exchange(other.file_, nullptr);
+    sequential_ = std::exchange(other.sequential_, {});
+    sequential_offset_ = other.sequential_offset_;
+    access_ = other.access_.load();
+    readahead_until_ = other.readahead_until_;
   }
   return *this;
 }
 
-std::expected<void, StorageError> SSTable::open_file() {
-  fd_ = ::open(path_.c_str(), O_CREAT | O_RDWR, 0644);
+std::expected<void, StorageError> SSTable::open_file(bool create) {
+  fd_ = create ? ::open(path_.c_str(), O_CREAT | O_RDWR, 0644)
+               : ::open(path_.c_str(), O_RDONLY);
   if (fd_ == -1) {
     return std::unexpected(StorageError::file_open(path()));
   }
@@ -58,43 +166,341 @@ void SSTable::close_file() {
     ::close(fd_);
     fd_ = -1;
   }
+  unmap_file();
+}
+
+void SSTable::unmap_file() {
   if (mapped_data_.data() != nullptr) {
-    ::munmap(mapped_data_.data(), file_size_);
+    ::munmap(mapped_data_.data(), mapped_data_.size());
+    mapped_data_ = {};
   }
 }
 
-std::expected<std::optional<std::string>, StorageError>
-SSTable::get(std::string_view key) {
+std::expected<std::shared_ptr<const TableFile>, StorageError>
+SSTable::pin() const {
+  std::shared_ptr<const TableFile> file;
+  bool opened = false;
+  {
+    std::lock_guard lock(file_mutex_);
+    if (file_ == nullptr) {
+      auto reopened = open_for_reads();
+      if (!reopened) {
+        return std::unexpected{reopened.error()};
+      }
+      file_ = std::move(*reopened);
+      opened = true;
+    }
+    file = file_;
+  }
+  // Not under file_mutex_: the cache may close other tables' files, and it
+  // locks those tables' mutexes while holding its own.
+  if (options_.table_cache != nullptr) {
+    options_.table_cache->touch(*this, opened);
+  }
+  return file;
+}
+
+void SSTable::close_for_reads() const {
+  std::shared_ptr<const TableFile> closing;
+  std::lock_guard lock(file_mutex_);
+  closing = std::move(file_);
+}
+
+std::expected<std::shared_ptr<const TableFile>, StorageError>
+SSTable::open_for_reads() const {
+  auto file = std::make_shared<TableFile>();
+  file->fd = ::open(path_.c_str(), O_RDONLY);
+  if (file->fd == -1) {
+    return std::unexpected(StorageError::file_open(path()));
+  }
+  if (options_.read_mode == ReadMode::Mmap && file_size_ > 0) {
+    void *addr =
+        ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, file->fd, 0);
+    if (addr == MAP_FAILED) {
+      return std::unexpected(StorageError::file_read(path()));
+    }
+    file->mapping =
+        std::span<std::byte>{static_cast<std::byte *>(addr), file_size_};
+  }
+  if (options_.read_mode == ReadMode::Direct) {
+    file->direct_fd = ::open(path_.c_str(), O_RDONLY | O_DIRECT);
+    // No O_DIRECT on this filesystem (tmpfs): read_uncached() falls back
+    // to pread().
+    if (file->direct_fd == -1 && errno != EINVAL) {
+      return std::unexpected(StorageError::file_open(path()));
+    }
+    if (file->direct_fd != -1) {
+      // Reads skip the page cache; drop what writing the table left there.
+      ::posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+  }
+  apply_advice(*file, access_.load(), options_.read_mode);
+  return file;
+}
+
+bool SSTable::may_contain(std::string_view key) const {
   if (key < header().min_key || key > header().max_key) {
-    return std::nullopt;
+    return false;
+  }
+  if (!load_metadata()) {
+    return true;
+  }
+  return bloom_filter_.bits().empty() || bloom_filter_.contains(key);
+}
+
+std::expected<void, StorageError> SSTable::load_metadata() const {
+  if (!metadata_loaded_.load(std::memory_order_acquire)) {
+    std::lock_guard lock(metadata_mutex_);
+    if (!metadata_loaded_.load(std::memory_order_relaxed)) {
+      if (auto res = read_metadata(); !res) {
+        metadata_error_ = res.error();
+      }
+      metadata_loaded_.store(true, std::memory_order_release);
+    }
+  }
+  if (metadata_error_) {
+    return std::unexpected{*metadata_error_};
+  }
+  return {};
+}
+
+std::expected<void, StorageError> SSTable::read_metadata() const {
+  auto file = pin();
+  if (!file) {
+    return std::unexpected{file.error()};
   }
-  if (bloom_filter_.bits().size() > 0 && !bloom_filter_.contains(key)) {
+  // Straight from the file: the metadata stays resident, so caching its
+  // blocks would only count it twice.
+  size_t filter_offset = header_.size + sizeof(size_t);
+  auto filter = read_uncached(*file, filter_offset, filter_size_);
+  if (!filter) {
+    return std::unexpected{filter.error()};
+  }
+  if (auto res = read_bloom_filter(filter->data); !res) {
+    return res;
+  }
+  // The index and range tombstones run from the index to the footer.
+  if (file_size_ < sizeof(Footer) + footer_.index_offset ||
+      file_size_ - sizeof(Footer) - footer_.index_offset <
+          footer_.index_size) {
+    return std::unexpected{StorageError::file_read(path())};
+  }
+  auto tail = read_uncached(*file, footer_.index_offset,
+                            file_size_ - sizeof(Footer) - footer_.index_offset);
+  if (!tail) {
+    return std::unexpected{tail.error()};
+  }
+  return read_index(tail->data.first(footer_.index_size))
+      .and_then([&] {
+        return read_range_tombstones(
+            tail->data.subspan(footer_.index_size));
+      });
+}
+
+std::expected<std::optional<std::string>, StorageError>
+SSTable::get(std::string_view key) const {
+  auto entry = lookup(key);
+  if (!entry) {
+    return std::unexpected{entry.error()};
+  }
+  if (!entry->has_value() || (*entry)->type != EntryType::Put) {
     return std::nullopt;
   }
-  // Calculate the correct position after header and bloom filter
-  size_t bloom_filter_size =
-      sizeof(size_t) + bloom_filter_.bits().size() * sizeof(bool);
-  size_t jump_to{header().size + bloom_filter_size};
-  auto it = std::ranges::upper_bound(index_, key, std::ranges::less{},
+  return std::move((*entry)->value);
+}
+
+/**
+ * Read all of [offset, offset + buffer.size()) of `fd` into `buffer`.
+ */
+static bool pread_exact(int fd, std::span<std::byte> buffer, size_t offset) {
+  size_t done = 0;
+  while (done < buffer.size()) {
+    auto n = ::pread(fd, buffer.data() + done, buffer.size() - done,
+                     static_cast<off_t>(offset + done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/**
+ * Serialized size of the entry whose fixed-size prefix (the first
+ * entry_size(0, 0) bytes) starts `data`.
+ */
+static size_t encoded_entry_size(std::span<const std::byte> data) {
+  uint32_t keylen{0};
+  uint32_t valuelen{0};
+  ::memcpy(&keylen, data.data(), sizeof(keylen));
+  ::memcpy(&valuelen, data.data() + sizeof(uint32_t), sizeof(valuelen));
+  return SSTable::entry_size(keylen, valuelen);
+}
+
+/**
+ * The entry a read should see when the newest visible version of a key has
+ * sequence `found` (or there is none) and the newest visible range tombstone
+ * over it has sequence `range_seq` (or there is none).
+ */
+static std::optional<Entry> visible(std::optional<Entry> found,
+                                    std::optional<SequenceNumber> range_seq) {
+  if (range_seq && (!found || found->seq < *range_seq)) {
+    auto deleted = Entry::tombstone();
+    deleted.seq = *range_seq;
+    return deleted;
+  }
+  return found;
+}
+
+size_t SSTable::block_offset(std::string_view key) const {
+  // Index entries hold the first key of each block. The versions of a key
+  // may straddle blocks, so start in the last block beginning before it.
+  auto it = std::ranges::lower_bound(index_, key, std::ranges::less{},
                                      &IndexEntry::key);
-  if (it != index_.begin()) {
-    --it;
-    jump_to = it->file_position;
+  return it == index_.begin() ? data_offset() : std::prev(it)->file_position;
+}
+
+std::optional<SSTable::BlockRange>
+SSTable::lookup_range(std::string_view key) const {
+  if (!may_contain(key)) {
+    return std::nullopt;
   }
+  // Runs to the start of the first block beginning past the key.
+  auto after = std::ranges::upper_bound(index_, key, std::ranges::less{},
+                                        &IndexEntry::key);
+  size_t begin = block_offset(key);
+  size_t end = after == index_.end() ? footer().index_offset
+                                     : after->file_position;
+  return BlockRange{.offset = begin, .length = end > begin ? end - begin : 0};
+}
 
-  file_pos_ = static_cast<off_t>(jump_to);
-  for (size_t i = 0; i < lsm_constants::kIndexSpace; ++i) {
-    auto entry = next();
+std::expected<std::optional<Entry>, StorageError>
+SSTable::lookup(std::string_view key, SequenceNumber snapshot) const {
+  BlockHandle block;
+  if (auto found = lookup_range(key); found && found->length > 0) {
+    auto read = read_block(found->offset, found->length);
+    if (!read) {
+      return std::unexpected{read.error()};
+    }
+    block = std::move(*read);
+  }
+  return lookup_in(key, snapshot, block.data);
+}
+
+std::expected<std::optional<Entry>, StorageError>
+SSTable::lookup_in(std::string_view key, SequenceNumber snapshot,
+                   std::span<const std::byte> range) const {
+  if (auto res = load_metadata(); !res) {
+    return std::unexpected{res.error()};
+  }
+  auto range_seq = range_tombstones_.covering_seq(key, snapshot);
+  for (size_t pos = 0; pos < range.size();) {
+    auto entry = decode_entry(range.subspan(pos));
     if (!entry)
       return std::unexpected{entry.error()};
-    if (!entry->has_value())
-      return std::nullopt;
 
-    if (entry->value().first == key) {
-      return entry->value().second;
+    auto &[k, e] = *entry;
+    if (k > key) {
+      break;
+    }
+    // Versions are sorted newest first: the first one old enough wins.
+    if (k == key && e.seq <= snapshot) {
+      return visible(std::move(e), range_seq);
     }
+    pos += entry_size(k.size(), e.value.size());
   }
-  return std::nullopt;
+  return visible(std::nullopt, range_seq);
+}
+
+std::expected<std::vector<std::optional<Entry>>, StorageError>
+SSTable::multi_lookup(std::span<const std::string_view> keys,
+                      SequenceNumber snapshot) const {
+  if (auto res = load_metadata(); !res) {
+    return std::unexpected{res.error()};
+  }
+  std::vector<std::optional<Entry>> results(keys.size());
+  std::vector<std::optional<BlockRange>> ranges(keys.size());
+  // Pinned on the first key that needs data, for the whole batch.
+  std::shared_ptr<const TableFile> file;
+
+  // Pass 1: filter every key and find its blocks. If the file is mapped,
+  // touch each block as it's found, so the cache misses for the whole batch
+  // overlap instead of being taken one at a time in pass 2.
+  auto index_it = index_.begin();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!may_contain(keys[i])) {
+      continue;
+    }
+    // Keys are sorted, so the search never has to look behind the last hit.
+    index_it = std::lower_bound(
+        index_it, index_.end(), keys[i],
+        [](const IndexEntry &e, std::string_view key) { return e.key < key; });
+    size_t begin = index_it == index_.begin()
+                       ? data_offset()
+                       : std::prev(index_it)->file_position;
+    auto after = std::upper_bound(
+        index_it, index_.end(), keys[i],
+        [](std::string_view key, const IndexEntry &e) { return key < e.key; });
+    size_t end =
+        after == index_.end() ? footer().index_offset : after->file_position;
+    ranges[i] = BlockRange{.offset = begin,
+                           .length = end > begin ? end - begin : 0};
+    if (file == nullptr) {
+      auto pinned = pin();
+      if (!pinned) {
+        return std::unexpected{pinned.error()};
+      }
+      file = std::move(*pinned);
+    }
+    if (begin < file->mapping.size()) {
+      __builtin_prefetch(file->mapping.data() + begin);
+    }
+  }
+
+  // Pass 2: scan forward for each key. Keys in the same block pick up where
+  // the previous one stopped rather than decoding the block from the start.
+  BlockHandle block;
+  std::optional<size_t> block_offset;
+  size_t pos = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (ranges[i]) {
+      auto [offset, length] = *ranges[i];
+      // A key whose versions straddle blocks needs a longer range.
+      if (offset != block_offset || length > block.data.size()) {
+        auto read = read_block(file, offset, length);
+        if (!read) {
+          return std::unexpected{read.error()};
+        }
+        if (offset != block_offset) {
+          pos = 0;
+        }
+        block = std::move(*read);
+        block_offset = offset;
+      }
+      while (pos < block.data.size()) {
+        auto entry = decode_entry(block.data.subspan(pos));
+        if (!entry)
+          return std::unexpected{entry.error()};
+
+        auto &[k, e] = *entry;
+        if (k > keys[i]) {
+          break;
+        }
+        // Stay on the version found: a duplicate key next finds it again.
+        if (k == keys[i] && e.seq <= snapshot) {
+          results[i] = std::move(e);
+          break;
+        }
+        pos += entry_size(k.size(), e.value.size());
+      }
+    }
+    results[i] = visible(std::move(results[i]),
+                         range_tombstones_.covering_seq(keys[i], snapshot));
+  }
+  return results;
 }
 std::expected<SSTable, StorageError> SSTable::create() {
   SSTable sst;
@@ -115,77 +521,222 @@ SSTable::create(std::filesystem::path path) {
   return sst;
 }
 std::expected<SSTable, StorageError>
-SSTable::open(const std::filesystem::path &path) {
+SSTable::open(const std::filesystem::path &path,
+              const TableOptions &options) {
   SSTable sst{path};
-  if (auto res = sst.open_file(); !res) {
+  sst.set_options(options);
+  // Read-only, so a wrong path fails instead of leaving an empty table.
+  if (auto res = sst.open_file(false); !res) {
     return std::unexpected{res.error()};
   }
-  if (auto res = sst.ensure_mapped(); !res) {
+  if (auto res = sst.map_file(); !res) {
     return std::unexpected{res.error()};
   }
   if (auto res = sst.read_header(); !res) {
     return std::unexpected{res.error()};
   }
-  if (auto res = sst.read_bloom_filter(); !res) {
-    return std::unexpected{res.error()};
+  if (sst.file_size_ < sst.header_.size + sizeof(Footer)) {
+    return std::unexpected{StorageError::file_read(sst.path())};
   }
   if (auto res = sst.read_footer(); !res) {
     return std::unexpected{res.error()};
   }
-  if (auto res = sst.read_index(); !res) {
-    return std::unexpected{res.error()};
+  // The filter's size, right after the header, places the data.
+  if (sst.file_size_ < sst.header_.size + sizeof(size_t)) {
+    return std::unexpected{StorageError::file_read(sst.path())};
+  }
+  size_t filter_field{0};
+  ::memcpy(&filter_field, sst.mapped_data_.data() + sst.header_.size,
+           sizeof(filter_field));
+  sst.filter_size_ = filter_field & ((1UZ << kFilterHashesShift) - 1);
+  // Tables from before the hash count was stored have zero there.
+  if (auto hashes = filter_field >> kFilterHashesShift; hashes > 0) {
+    sst.filter_hashes_ = hashes;
   }
+  // Only these pages were touched; the rest of the metadata waits for the
+  // first read, which reopens the file through pin().
+  sst.close_file();
+  sst.metadata_loaded_ = false;
+  sst.ready_ = true;
   return sst;
 }
 
-std::expected<std::optional<std::pair<std::string, std::string>>, StorageError>
+std::expected<std::optional<KeyEntry>, StorageError>
 SSTable::read_entry() const {
+  return read_entry_at(static_cast<size_t>(file_pos_));
+}
+
+std::expected<std::optional<KeyEntry>, StorageError>
+SSTable::read_entry_at(size_t pos) const {
   if (file_size_ == 0) {
     return std::nullopt;
   }
-  if (mapped_data_.data() == nullptr) {
-    return std::unexpected(StorageError::file_open(path()));
-  }
   // Stop before the index
   size_t data_end = footer().index_offset;
-  if (static_cast<size_t>(file_pos_) >= data_end) {
+  if (pos >= data_end) {
     return std::nullopt;
   }
+  auto file = pin();
+  if (!file) {
+    return std::unexpected{file.error()};
+  }
+  auto to_optional = [](KeyEntry entry) {
+    return std::optional<KeyEntry>{std::move(entry)};
+  };
+  if ((*file)->mapping.data() != nullptr) {
+    return mapped_range((*file)->mapping, pos, data_end - pos)
+        .and_then([&](std::span<const std::byte> data) {
+          return decode_entry(data);
+        })
+        .transform(to_optional);
+  }
+  // Read the lengths first, then the whole entry.
+  auto prefix =
+      read_uncached(*file, pos, std::min(entry_size(0, 0), data_end - pos));
+  if (!prefix) {
+    return std::unexpected{prefix.error()};
+  }
+  size_t size = prefix->data.size() < entry_size(0, 0)
+                    ? prefix->data.size()
+                    : encoded_entry_size(prefix->data);
+  return read_uncached(*file, pos, std::min(size, data_end - pos))
+      .and_then([&](const BlockHandle &entry) {
+        return decode_entry(entry.data);
+      })
+      .transform(to_optional);
+}
+
+std::expected<BlockHandle, StorageError>
+SSTable::read_block(size_t offset, size_t length) const {
+  if (length == 0) {
+    return BlockHandle{};
+  }
+  return pin().and_then([&](const std::shared_ptr<const TableFile> &file) {
+    return read_block(file, offset, length);
+  });
+}
+
+std::expected<BlockHandle, StorageError>
+SSTable::read_block(const std::shared_ptr<const TableFile> &file,
+                    size_t offset, size_t length) const {
+  auto *cache = options_.block_cache;
+  if (length == 0 || file->mapping.data() != nullptr || cache == nullptr) {
+    return read_uncached(file, offset, length);
+  }
+  if (auto cached = cache->lookup(file_id_, offset, length)) {
+    return std::move(*cached);
+  }
+  return read_uncached(file, offset, length).transform([&](BlockHandle block) {
+    cache->insert(file_id_, offset, block);
+    return block;
+  });
+}
+
+std::expected<BlockHandle, StorageError>
+SSTable::read_uncached(const std::shared_ptr<const TableFile> &file,
+                       size_t offset, size_t length) const {
+  if (file->mapping.data() != nullptr) {
+    // The block keeps the mapping alive, even if the table cache closes it.
+    return mapped_range(file->mapping, offset, length)
+        .transform([&](std::span<const std::byte> data) {
+          return BlockHandle{file, data};
+        });
+  }
+  if (offset + length > file_size_) {
+    return std::unexpected(StorageError{
+        .kind = StorageError::Kind::FileRead,
+        .message = "Corrupted SSTable: read past the end of the file",
+        .path = path(),
+    });
+  }
+  if (file->direct_fd != -1) {
+    return read_direct(*file, offset, length);
+  }
+  auto buffer = std::make_shared_for_overwrite<std::byte[]>(length);
+  if (!pread_exact(file->fd, {buffer.get(), length}, offset)) {
+    return std::unexpected(StorageError::file_read(path()));
+  }
+  return BlockHandle{std::shared_ptr<const void>{buffer, buffer.get()},
+                     {buffer.get(), length}};
+}
+
+std::expected<BlockHandle, StorageError>
+SSTable::read_direct(const TableFile &file, size_t offset,
+                     size_t length) const {
+  constexpr size_t kAlign = lsm_constants::kDirectIoAlignment;
+  size_t begin = offset - offset % kAlign;
+  size_t end = (offset + length + kAlign - 1) / kAlign * kAlign;
+  auto *raw = static_cast<std::byte *>(std::aligned_alloc(kAlign, end - begin));
+  if (raw == nullptr) {
+    return std::unexpected(StorageError::file_read(path()));
+  }
+  std::shared_ptr<std::byte> buffer{raw, [](std::byte *p) { std::free(p); }};
+  // The read comes up short at the end of the file; only the bytes asked
+  // for have to arrive.
+  size_t done = 0;
+  while (begin + done < offset + length) {
+    auto n = ::pread(file.direct_fd, buffer.get() + done, end - begin - done,
+                     static_cast<off_t>(begin + done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return std::unexpected(StorageError::file_read(path()));
+    }
+    done += static_cast<size_t>(n);
+  }
+  return BlockHandle{buffer, {buffer.get() + (offset - begin), length}};
+}
+
+std::expected<std::span<const std::byte>, StorageError>
+SSTable::mapped_range(std::span<const std::byte> mapping, size_t offset,
+                      size_t length) const {
+  if (mapping.data() == nullptr) {
+    return std::unexpected(StorageError::file_open(path()));
+  }
+  if (offset + length > mapping.size()) {
+    return std::unexpected(StorageError{
+        .kind = StorageError::Kind::FileRead,
+        .message = "Corrupted SSTable: read past the end of the file",
+        .path = path(),
+    });
+  }
+  return mapping.subspan(offset, length);
+}
+
+std::expected<KeyEntry, StorageError>
+SSTable::decode_entry(std::span<const std::byte> data) const {
   uint32_t keylen{0};
   uint32_t valuelen{0};
+  EntryType type{EntryType::Put};
   uint32_t file_checksum{0};
-  ::memcpy(&keylen, mapped_data_.data() + file_pos_, sizeof(keylen));
-  ::memcpy(&valuelen, mapped_data_.data() + file_pos_ + sizeof(uint32_t),
-           sizeof(valuelen));
-
-  size_t entry_size =
-      2 * sizeof(uint32_t) + keylen + valuelen + sizeof(uint32_t);
-  if (static_cast<size_t>(file_pos_) + entry_size > data_end) {
+  if (data.size() < entry_size(0, 0)) {
     return std::unexpected(StorageError{
         .kind = StorageError::Kind::FileRead,
         .message = "Corrupted SSTable: entry extends into footer",
         .path = path(),
     });
   }
+  ::memcpy(&keylen, data.data(), sizeof(keylen));
+  ::memcpy(&valuelen, data.data() + sizeof(uint32_t), sizeof(valuelen));
+  ::memcpy(&type, data.data() + 2 * sizeof(uint32_t), sizeof(type));
+  SequenceNumber seq{0};
+  ::memcpy(&seq, data.data() + 2 * sizeof(uint32_t) + sizeof(type),
+           sizeof(seq));
 
-  std::string k(keylen, '\0');
-  std::string val(valuelen, '\0');
-  ::memcpy(k.data(), mapped_data_.data() + file_pos_ + 2 * sizeof(uint32_t),
-           keylen);
-  ::memcpy(val.data(),
-           mapped_data_.data() + file_pos_ + 2 * sizeof(uint32_t) + k.size(),
-           valuelen);
-  ::memcpy(&file_checksum,
-           mapped_data_.data() + file_pos_ + 2 * sizeof(uint32_t) + k.size() +
-               val.size(),
-           sizeof(file_checksum));
+  size_t size = entry_size(keylen, valuelen);
+  if (size > data.size()) {
+    return std::unexpected(StorageError{
+        .kind = StorageError::Kind::FileRead,
+        .message = "Corrupted SSTable: entry extends into footer",
+        .path = path(),
+    });
+  }
 
-  auto datalen =
-      static_cast<uint32_t>(2 * sizeof(uint32_t) + keylen + valuelen);
+  size_t datalen = size - sizeof(uint32_t);
+  ::memcpy(&file_checksum, data.data() + datalen, sizeof(file_checksum));
   auto checksum =
-      hash32({reinterpret_cast<const char *>(mapped_data_.data() + file_pos_),
-              datalen});
-
+      hash32({reinterpret_cast<const char *>(data.data()), datalen});
   if (file_checksum != checksum) {
     return std::unexpected(StorageError{
         .kind = StorageError::Kind::FileRead,
@@ -193,37 +744,88 @@ SSTable::read_entry() const {
         .path = path(),
     });
   }
-  return {{{std::move(k), std::move(val)}}};
+
+  // An ingested table's entries are written with 0 and all take the
+  // sequence number ingestion gave the table (see assign_sequence()).
+  if (seq == 0) {
+    seq = header_.max_sequence;
+  }
+  const std::byte *key_data =
+      data.data() + 2 * sizeof(uint32_t) + sizeof(type) + sizeof(seq);
+  std::string k(reinterpret_cast<const char *>(key_data), keylen);
+  std::string val(reinterpret_cast<const char *>(key_data + keylen), valuelen);
+  return KeyEntry{std::move(k), Entry{type, std::move(val), {}, seq}};
 }
 
-std::expected<std::optional<std::pair<std::string, std::string>>, StorageError>
-SSTable::next() {
-  size_t bloom_filter_size =
-      sizeof(size_t) + bloom_filter_.bits().size() * sizeof(bool);
-  size_t data_start = header().size + bloom_filter_size;
+std::expected<std::optional<KeyEntry>, StorageError> SSTable::next() {
+  size_t data_start = data_offset();
   if (file_pos_ < static_cast<off_t>(data_start)) {
     file_pos_ = static_cast<off_t>(data_start);
   }
-  auto entry = ensure_mapped().and_then([&] { return read_entry(); });
+  auto pos = static_cast<size_t>(file_pos_);
+  if (access_ == Access::Sequential && pos >= readahead_until_) {
+    // Start on the next window while the rest of this one is consumed.
+    prefetch(pos, lsm_constants::kCompactionReadahead);
+    readahead_until_ = pos + lsm_constants::kCompactionReadahead / 2;
+  }
+  auto entry = ensure_mapped().and_then([&] { return read_sequential(); });
 
   if (!entry) {
     return std::unexpected(entry.error());
   }
   if (!entry->has_value())
     return std::nullopt;
-  auto &[k, v] = entry->value();
-
-  // [keysize][valuesize][key][val][checksum]
-  file_pos_ += static_cast<off_t>(sizeof(uint32_t) * 2 + k.size() + v.size() +
-                                  sizeof(uint32_t));
-  return {{{std::move(k), std::move(v)}}};
+  auto &[k, e] = entry->value();
+  file_pos_ += static_cast<off_t>(entry_size(k.size(), e.value.size()));
+  return entry;
 }
+std::expected<std::optional<KeyEntry>, StorageError>
+SSTable::read_sequential() {
+  auto pos = static_cast<size_t>(file_pos_);
+  size_t data_end = footer().index_offset;
+  if (file_size_ == 0 || pos >= data_end) {
+    // Done: let go of the file (and the last chunk).
+    sequential_ = {};
+    return std::nullopt;
+  }
+  size_t needed = entry_size(0, 0);
+  // One refill for the entry's lengths, and one more if it's longer than a
+  // chunk.
+  for (int refills = 0;; ++refills) {
+    std::span<const std::byte> buffered;
+    if (pos >= sequential_offset_ &&
+        pos - sequential_offset_ < sequential_.data.size()) {
+      buffered = sequential_.data.subspan(pos - sequential_offset_);
+    }
+    if (buffered.size() >= entry_size(0, 0)) {
+      needed = encoded_entry_size(buffered);
+    }
+    if (buffered.size() >= needed || refills == 2) {
+      return decode_entry(buffered).transform([](KeyEntry entry) {
+        return std::optional<KeyEntry>{std::move(entry)};
+      });
+    }
+    // Skips the block cache: a compaction streaming through the table
+    // shouldn't evict the blocks point reads need.
+    auto length = std::min(std::max(needed, lsm_constants::kSequentialReadSize),
+                           data_end - pos);
+    auto chunk = pin().and_then(
+        [&](const std::shared_ptr<const TableFile> &file) {
+          return read_uncached(file, pos, length);
+        });
+    if (!chunk) {
+      return std::unexpected{chunk.error()};
+    }
+    sequential_ = std::move(*chunk);
+    sequential_offset_ = pos;
+  }
+}
+
 std::expected<size_t, StorageError>
-SSTable::write_entry(const std::string_view key,
-                     const std::string_view value) const {
+SSTable::write_entry(const std::string_view key, const Entry &entry) const {
   std::vector<std::byte> write_buffer;
   auto keylen = static_cast<uint32_t>(key.size());
-  auto valuelen = static_cast<uint32_t>(value.size());
+  auto valuelen = static_cast<uint32_t>(entry.value.size());
 
   auto append = [&write_buffer](const void *d, size_t len) {
     auto data = reinterpret_cast<const std::byte *>(d);
@@ -232,22 +834,107 @@ SSTable::write_entry(const std::string_view key,
 
   append(&keylen, sizeof(keylen));
   append(&valuelen, sizeof(valuelen));
+  append(&entry.type, sizeof(entry.type));
+  append(&entry.seq, sizeof(entry.seq));
   append(key.data(), key.size());
-  append(value.data(), value.size());
+  append(entry.value.data(), entry.value.size());
 
   auto cs = hash32({reinterpret_cast<const char *>(write_buffer.data()),
                     write_buffer.size()});
 
   append(&cs, sizeof(cs));
 
-  if (::write(fd_, write_buffer.data(), write_buffer.size()) !=
-      static_cast<ssize_t>(write_buffer.size())) {
-    return std::unexpected(StorageError::file_write(path()));
+  if (auto res = write_bytes(write_buffer); !res) {
+    return std::unexpected{res.error()};
   }
 
   return write_buffer.size();
 }
+std::expected<void, StorageError>
+SSTable::write_bytes(const std::vector<std::byte> &buffer) const {
+  if (rate_limiter_ != nullptr) {
+    if (wait_for_limiter_) {
+      rate_limiter_->request(buffer.size(), io_priority_);
+    } else {
+      rate_limiter_->charge(buffer.size(), io_priority_);
+    }
+  }
+  if (::write(fd_, buffer.data(), buffer.size()) !=
+      static_cast<ssize_t>(buffer.size())) {
+    return std::unexpected(StorageError::file_write(path()));
+  }
+  return {};
+}
+void SSTable::prefetch(size_t offset, size_t length) const {
+  if (offset >= file_size_ || length == 0) {
+    return;
+  }
+  auto file = pin();
+  if (!file) {
+    return;
+  }
+  length = std::min(length, file_size_ - offset);
+  if ((*file)->mapping.data() != nullptr) {
+    advise_mapping((*file)->mapping, offset, length, MADV_WILLNEED);
+  } else if (options_.read_mode == ReadMode::Pread) {
+    ::posix_fadvise((*file)->fd, static_cast<off_t>(offset),
+                    static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+  }
+}
+
+void SSTable::release(size_t offset, size_t length) const {
+  if (offset >= file_size_ || length == 0) {
+    return;
+  }
+  length = std::min(length, file_size_ - offset);
+  std::shared_ptr<const TableFile> file;
+  {
+    std::lock_guard lock(file_mutex_);
+    file = file_;
+  }
+  // Not worth opening (and taking a table cache slot) just for this: any
+  // descriptor reaches the same page cache.
+  int fd = file != nullptr ? file->fd : ::open(path_.c_str(), O_RDONLY);
+  if (file != nullptr) {
+    // The mapping is read-only, so dropped pages just fault back in from
+    // the file if someone still reads them.
+    advise_mapping(file->mapping, offset, length, MADV_DONTNEED);
+  }
+  if (fd != -1) {
+    ::posix_fadvise(fd, static_cast<off_t>(offset),
+                    static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+  }
+  if (file == nullptr && fd != -1) {
+    ::close(fd);
+  }
+}
+
+void SSTable::advise(Access access) {
+  access_ = access;
+  readahead_until_ = 0;
+  // A closed file gets the advice when it's reopened.
+  std::shared_ptr<const TableFile> file;
+  {
+    std::lock_guard lock(file_mutex_);
+    file = file_;
+  }
+  if (file != nullptr) {
+    apply_advice(*file, access, options_.read_mode);
+  }
+}
+
 std::expected<void, StorageError> SSTable::ensure_mapped() {
+  if (ready_) {
+    return {};
+  }
+  // Done writing: reads open the file as the read mode wants it.
+  close_file();
+  file_size_ = std::filesystem::file_size(path());
+  ready_ = true;
+  return {};
+}
+
+std::expected<void, StorageError> SSTable::map_file() {
   if (mapped_data_.data() == nullptr) {
     file_size_ = std::filesystem::file_size(path());
     if (file_size_ > 0) {
@@ -276,41 +963,79 @@ std::expected<void, StorageError> SSTable::write_header(Header &&header) {
   append(header_.min_key.data(), header_.min_key.size());
   append(&max_len, sizeof(max_len));
   append(header_.max_key.data(), header_.max_key.size());
+  append(&header_.max_sequence, sizeof(header_.max_sequence));
 
-  if (::write(fd_, write_buffer.data(), write_buffer.size()) !=
-      static_cast<ssize_t>(write_buffer.size())) {
-    return std::unexpected(StorageError::file_write(path()));
+  if (auto res = write_bytes(write_buffer); !res) {
+    return std::unexpected{res.error()};
   }
 
   return {};
 }
+std::expected<void, StorageError>
+SSTable::assign_sequence(const std::filesystem::path &path,
+                         SequenceNumber seq) {
+  int fd = ::open(path.c_str(), O_RDWR);
+  if (fd == -1) {
+    return std::unexpected{StorageError::file_open(path)};
+  }
+  // Skip [min_key_len:4][min_key][max_key_len:4][max_key] to max_sequence.
+  uint32_t len{0};
+  off_t pos{0};
+  auto read_len = [&] {
+    if (::pread(fd, &len, sizeof(len), pos) !=
+        static_cast<ssize_t>(sizeof(len))) {
+      return false;
+    }
+    pos += static_cast<off_t>(sizeof(len) + len);
+    return true;
+  };
+  bool ok = read_len() && read_len() &&
+            ::pwrite(fd, &seq, sizeof(seq), pos) ==
+                static_cast<ssize_t>(sizeof(seq));
+  ::close(fd);
+  if (!ok) {
+    return std::unexpected{StorageError::file_write(path)};
+  }
+  return {};
+}
+
 std::expected<SSTable::Header, StorageError> SSTable::read_header() {
   file_pos_ = 0;
   auto header =
-      ensure_mapped().and_then([&] -> std::expected<Header, StorageError> {
-        uint32_t min_key_len{0};
-        uint32_t max_key_len{0};
-
-        ::memcpy(&min_key_len, mapped_data_.data() + file_pos_,
-                 sizeof(min_key_len));
-
-        std::string min_key(min_key_len, '\0');
-        ::memcpy(min_key.data(),
-                 mapped_data_.data() + file_pos_ + sizeof(uint32_t),
-                 min_key_len);
-
-        ::memcpy(&max_key_len,
-                 mapped_data_.data() + file_pos_ + sizeof(uint32_t) +
-                     min_key_len,
-                 sizeof(max_key_len));
-        std::string max_key(max_key_len, '\0');
-
-        ::memcpy(max_key.data(),
-                 mapped_data_.data() + file_pos_ + 2 * sizeof(uint32_t) +
-                     min_key_len,
-                 max_key_len);
-
-        return Header{min_key, max_key};
+      map_file().and_then([&] -> std::expected<Header, StorageError> {
+        // The lengths come from the file, so check each against its size:
+        // a truncated or foreign file fails here instead of reading past
+        // the mapping.
+        size_t offset{0};
+        auto take = [&](void *out, size_t len) {
+          if (offset > file_size_ || len > file_size_ - offset) {
+            return false;
+          }
+          ::memcpy(out, mapped_data_.data() + offset, len);
+          offset += len;
+          return true;
+        };
+        auto take_key = [&](std::string &key) {
+          uint32_t len{0};
+          if (!take(&len, sizeof(len)) || len > file_size_ - offset) {
+            return false;
+          }
+          key.resize(len);
+          return take(key.data(), len);
+        };
+        std::string min_key;
+        std::string max_key;
+        SequenceNumber max_sequence{0};
+        bool ok = take_key(min_key) && take_key(max_key) &&
+                  take(&max_sequence, sizeof(max_sequence));
+        if (!ok) {
+          return std::unexpected{StorageError{
+              .kind = StorageError::Kind::Corruption,
+              .message = "SSTable header runs past the end of the file",
+              .path = path(),
+          }};
+        }
+        return Header{std::move(min_key), std::move(max_key), max_sequence};
       });
   if (!header) {
     return std::unexpected{header.error()};
@@ -334,16 +1059,15 @@ std::expected<void, StorageError> SSTable::write_footer(Footer footer) {
   append(&footer.num_index_entries, sizeof(footer.num_index_entries));
   append(&footer.magic_num, sizeof(footer.magic_num));
 
-  if (::write(fd_, write_buffer.data(), write_buffer.size()) !=
-      static_cast<ssize_t>(write_buffer.size())) {
-    return std::unexpected(StorageError::file_write(path()));
+  if (auto res = write_bytes(write_buffer); !res) {
+    return std::unexpected{res.error()};
   }
 
   return {};
 }
 std::expected<SSTable::Footer, StorageError> SSTable::read_footer() {
   auto footer =
-      ensure_mapped().and_then([&] -> std::expected<Footer, StorageError> {
+      map_file().and_then([&] -> std::expected<Footer, StorageError> {
         if (file_size_ < sizeof(Footer)) {
           return std::unexpected{StorageError::file_read(path())};
         }
@@ -400,48 +1124,151 @@ std::expected<size_t, StorageError> SSTable::write_index() {
     append(&fpos, sizeof(fpos));
   }
 
-  if (::write(fd_, write_buffer.data(), write_buffer.size()) !=
-      static_cast<ssize_t>(write_buffer.size())) {
-    return std::unexpected(StorageError::file_write(path()));
+  if (auto res = write_bytes(write_buffer); !res) {
+    return std::unexpected{res.error()};
   }
 
   return write_buffer.size();
 }
-std::expected<void, StorageError> SSTable::read_index() {
-  if (!index_.empty()) {
-    return {};
-  }
-  auto idx = ensure_mapped().and_then([&] -> std::expected<void, StorageError> {
-    if (file_size_ < footer_.index_size) {
+std::expected<void, StorageError>
+SSTable::read_index(std::span<const std::byte> block) const {
+  std::vector<IndexEntry> index;
+  index.reserve(footer_.num_index_entries);
+  size_t read_pos = 0;
+  while (index.size() < footer_.num_index_entries) {
+    // Format: [key_len:4][key:key_len][fpos:8]
+    uint32_t key_len{0};
+    size_t fpos{0};
+    if (block.size() - read_pos < sizeof(key_len)) {
       return std::unexpected{StorageError::file_read(path())};
     }
+    ::memcpy(&key_len, block.data() + read_pos, sizeof(key_len));
+    read_pos += sizeof(key_len);
+    if (block.size() - read_pos < key_len + sizeof(fpos)) {
+      return std::unexpected{StorageError::file_read(path())};
+    }
+    std::string key(reinterpret_cast<const char *>(block.data() + read_pos),
+                    key_len);
+    ::memcpy(&fpos, block.data() + read_pos + key_len, sizeof(fpos));
+    read_pos += key_len + sizeof(fpos);
+    index.emplace_back(std::move(key), fpos);
+  }
+  index_ = std::move(index);
+  return {};
+}
 
-    size_t read_pos = footer_.index_offset;
-
-    while (index_.size() < footer_.num_index_entries) {
-      uint32_t key_len{0};
-      size_t fpos{0};
+std::expected<size_t, StorageError>
+SSTable::write_range_tombstones(const RangeTombstoneList &ranges) {
+  if (ranges.empty()) {
+    // No block at all, like tables written before range deletes existed.
+    range_tombstones_.clear();
+    return 0;
+  }
+  std::vector<std::byte> write_buffer;
 
-      ::memcpy(&key_len, mapped_data_.data() + read_pos, sizeof(key_len));
+  auto append = [&write_buffer](const void *d, size_t len) {
+    auto data = reinterpret_cast<const std::byte *>(d);
+    write_buffer.insert(write_buffer.end(), data, data + len);
+  };
 
-      std::string key(key_len, '\0');
-      ::memcpy(key.data(), mapped_data_.data() + read_pos + sizeof(uint32_t),
-               key_len);
+  // Format: [count:4]{[begin_len:4][begin][end_len:4][end]
+  //                    [seq_count:4]{[seq:8]}*}*[checksum:4]
+  auto count = static_cast<uint32_t>(ranges.fragments().size());
+  append(&count, sizeof(count));
+  for (const auto &[begin, end, seqs] : ranges.fragments()) {
+    auto begin_len = static_cast<uint32_t>(begin.size());
+    auto end_len = static_cast<uint32_t>(end.size());
+    auto seq_count = static_cast<uint32_t>(seqs.size());
+    append(&begin_len, sizeof(begin_len));
+    append(begin.data(), begin.size());
+    append(&end_len, sizeof(end_len));
+    append(end.data(), end.size());
+    append(&seq_count, sizeof(seq_count));
+    append(seqs.data(), seqs.size() * sizeof(SequenceNumber));
+  }
+  auto cs = hash32({reinterpret_cast<const char *>(write_buffer.data()),
+                    write_buffer.size()});
+  append(&cs, sizeof(cs));
 
-      ::memcpy(&fpos,
-               mapped_data_.data() + read_pos + sizeof(uint32_t) + key_len,
-               sizeof(fpos));
-      index_.emplace_back(key, fpos);
+  if (auto res = write_bytes(write_buffer); !res) {
+    return std::unexpected{res.error()};
+  }
 
-      read_pos += sizeof(uint32_t) + key_len + sizeof(fpos);
-    }
+  range_tombstones_ = ranges;
+  return write_buffer.size();
+}
 
+std::expected<void, StorageError>
+SSTable::read_range_tombstones(std::span<const std::byte> block) const {
+  // The block sits between the index and the footer, if there is one.
+  size_t begin = 0;
+  size_t end = block.size();
+  if (begin == end) {
     return {};
-  });
+  }
+  auto corrupted = [&] {
+    return std::unexpected{StorageError{
+        .kind = StorageError::Kind::Corruption,
+        .message = "Corrupted SSTable range tombstone block",
+        .path = path(),
+    }};
+  };
+  if (end - begin < 2 * sizeof(uint32_t)) {
+    return corrupted();
+  }
+  const std::byte *data = block.data();
+  uint32_t file_checksum{0};
+  ::memcpy(&file_checksum, data + end - sizeof(uint32_t),
+           sizeof(file_checksum));
+  auto checksum = hash32({reinterpret_cast<const char *>(data + begin),
+                          end - sizeof(uint32_t) - begin});
+  if (file_checksum != checksum) {
+    return corrupted();
+  }
+  end -= sizeof(uint32_t);
 
-  if (!idx) {
-    return std::unexpected{idx.error()};
+  // Bounds-checked reader over [begin, end).
+  size_t pos = begin;
+  auto read_string = [&](std::string &out) {
+    uint32_t len{0};
+    if (end - pos < sizeof(len)) {
+      return false;
+    }
+    ::memcpy(&len, data + pos, sizeof(len));
+    pos += sizeof(len);
+    if (end - pos < len) {
+      return false;
+    }
+    out.assign(reinterpret_cast<const char *>(data + pos), len);
+    pos += len;
+    return true;
+  };
+
+  uint32_t count{0};
+  ::memcpy(&count, data + pos, sizeof(count));
+  pos += sizeof(count);
+  RangeTombstoneList ranges;
+  for (uint32_t i = 0; i < count; ++i) {
+    std::string range_begin;
+    std::string range_end;
+    uint32_t seq_count{0};
+    if (!read_string(range_begin) || !read_string(range_end) ||
+        end - pos < sizeof(seq_count)) {
+      return corrupted();
+    }
+    ::memcpy(&seq_count, data + pos, sizeof(seq_count));
+    pos += sizeof(seq_count);
+    if ((end - pos) / sizeof(SequenceNumber) < seq_count) {
+      return corrupted();
+    }
+    for (uint32_t j = 0; j < seq_count; ++j) {
+      SequenceNumber seq{0};
+      ::memcpy(&seq, data + pos, sizeof(seq));
+      pos += sizeof(seq);
+      ranges.add(range_begin, range_end, seq);
+    }
   }
+  range_tombstones_ = std::move(ranges);
   return {};
 }
 
@@ -456,47 +1283,31 @@ SSTable::write_bloom_filter(BloomFilter &&bf) {
   };
 
   size_t bf_size = bf.bits().size();
-  append(&bf_size, sizeof(size_t));
+  size_t field = bf_size | (bf.num_hashes() << kFilterHashesShift);
+  append(&field, sizeof(field));
   if (bf_size > 0) {
     for (bool bit : bf.bits()) {
       append(&bit, sizeof(bit));
     }
   }
-  if (::write(fd_, write_buffer.data(), write_buffer.size()) !=
-      static_cast<ssize_t>(write_buffer.size())) {
-    return std::unexpected(StorageError::file_write(path()));
+  if (auto res = write_bytes(write_buffer); !res) {
+    return std::unexpected{res.error()};
   }
 
   bloom_filter_ = std::move(bf);
+  filter_size_ = bf_size;
+  filter_hashes_ = bloom_filter_.num_hashes();
   return write_buffer.size();
 }
 
-std::expected<BloomFilter, StorageError> SSTable::read_bloom_filter() {
-  // After header
-  file_pos_ = static_cast<off_t>(header_.size);
-  size_t bf_size{0};
-  ::memcpy(&bf_size, mapped_data_.data() + file_pos_, sizeof(bf_size));
-
-  if (bf_size == 0) {
-    BloomFilter bf;
-    bloom_filter_ = bf;
-    return bloom_filter_;
-  }
-
-  std::vector<bool> bf_bits(bf_size);
-
-  for (size_t i = 0; i < bf_bits.size(); ++i) {
-    bool byte{0};
-    ::memcpy(&byte,
-             mapped_data_.data() + file_pos_ + sizeof(bf_size) +
-                 i * sizeof(byte),
-             sizeof(byte));
-    bf_bits[i] = (byte != 0);
+std::expected<void, StorageError>
+SSTable::read_bloom_filter(std::span<const std::byte> block) const {
+  // One byte per bit.
+  std::vector<bool> bits(block.size());
+  for (size_t i = 0; i < block.size(); ++i) {
+    bits[i] = block[i] != std::byte{0};
   }
-
-  BloomFilter bf{std::move(bf_bits)};
-  bloom_filter_ = std::move(bf);
-
-  return bloom_filter_;
+  bloom_filter_ = BloomFilter{std::move(bits), filter_hashes_};
+  return {};
 }
 } // namespace lsm_storage_engine
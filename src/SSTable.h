@@ -1,14 +1,70 @@
 #pragma once
+#include "BlockCache.h"
 #include "BloomFilter.h"
 #include "Constants.h"
+#include "Entry.h"
+#include "RangeTombstones.h"
+#include "RateLimiter.h"
 #include "StorageError.h"
+#include <algorithm>
+#include <atomic>
 #include <expected>
 #include <filesystem>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <vector>
 namespace lsm_storage_engine {
 
+class TableCache;
+
+/**
+ * @brief How an SSTable reads its data blocks.
+ */
+enum class ReadMode {
+  /// Map the whole file and let the kernel page blocks in and out.
+  Mmap,
+  /// pread() blocks through the page cache into engine-owned buffers.
+  Pread,
+  /// pread() aligned blocks with O_DIRECT, bypassing the page cache, so
+  /// only the engine's block cache decides what stays in memory.
+  Direct,
+};
+
+/**
+ * @brief How an SSTable reads its file, and the caches it shares with the
+ * other tables.
+ */
+struct TableOptions {
+  ReadMode read_mode{ReadMode::Mmap};
+  /// Cache for blocks read without mmap, or nullptr for none.
+  BlockCache *block_cache{nullptr};
+  /// Bounds how many tables keep their file open, or nullptr for no bound.
+  TableCache *table_cache{nullptr};
+  /// New tables index every this many entries.
+  size_t index_interval{lsm_constants::kIndexSpace};
+  /// Bloom filter bits per key of new tables. 0 writes no filter.
+  size_t bloom_bits_per_key{lsm_constants::kBloomBitsPerKey};
+};
+
+/**
+ * @brief An SSTable's open file: descriptors and, in Mmap mode, the
+ * mapping. Closed once the table and every reader holding it let go.
+ */
+struct TableFile {
+  int fd{-1};
+  /// The file opened with O_DIRECT, or -1.
+  int direct_fd{-1};
+  std::span<std::byte> mapping;
+
+  TableFile() = default;
+  TableFile(const TableFile &) = delete;
+  TableFile &operator=(const TableFile &) = delete;
+  ~TableFile();
+};
+
 /**
  * @brief Immutable on-disk sorted string table.
  *
@@ -17,6 +73,14 @@ namespace lsm_storage_engine {
  * written. Keys are stored in lexicographic order to support efficient lookups
  * and range scans.
  *
+ * Opening a table reads only its header and footer. The bloom filter, index
+ * and range tombstones are loaded on first touch (see load_metadata()) and
+ * then stay in memory for the table's lifetime, so startup doesn't pay for
+ * tables nobody reads. The file itself is opened (and mapped) on first read
+ * and, with a TableCache, closed again once the table goes cold, so the
+ * number of open descriptors and mappings stays bounded however many tables
+ * there are.
+ *
  * Read operations are thread-safe. The table is immutable after creation.
  */
 class SSTable {
@@ -41,11 +105,25 @@ public:
 
   /**
    * @brief Opens an existing SSTable from the specified path.
+   *
+   * Reads just the header and footer, which are closed again once parsed:
+   * the first read reopens the file and loads the rest of the metadata.
+   * Safe to call from several threads at once for different tables.
    * @param path Path to the SSTable file.
+   * @param options How to read the file.
    * @return SSTable on success, StorageError if the file cannot be opened.
    */
   static std::expected<SSTable, StorageError>
-  open(const std::filesystem::path &);
+  open(const std::filesystem::path &, const TableOptions &options = {});
+
+  /**
+   * @brief Give a table written with sequence number 0 throughout (see
+   * SSTableWriter) one number for all its entries, by writing it into the
+   * header's max_sequence in place.
+   * @return void on success, StorageError on failure.
+   */
+  static std::expected<void, StorageError>
+  assign_sequence(const std::filesystem::path &path, SequenceNumber seq);
 
   /**
    * @brief Constructs an SSTable with the given path (does not open file).
@@ -53,7 +131,7 @@ public:
    */
   SSTable(std::filesystem::path path) : path_(std::move(path)) {}
 
-  ~SSTable() { close_file(); }
+  ~SSTable();
 
   // No copies.
   SSTable(const SSTable &) = delete;
@@ -75,35 +153,230 @@ public:
    *         on I/O failure.
    */
   std::expected<std::optional<std::string>, StorageError>
-  get(std::string_view key);
+  get(std::string_view key) const;
 
-  std::expected<std::optional<std::pair<std::string, std::string>>,
-                StorageError>
-  next();
+  /**
+   * @brief Like get(), but also reports tombstones and merge operands.
+   *
+   * Returns the newest entry for the key a read at `snapshot` can see. To
+   * get to the version beneath a merge operand, look up again at the
+   * operand's sequence number minus one.
+   * @param key The key to look up.
+   * @param snapshot Ignore entries with larger sequence numbers.
+   * @return The entry (value, tombstone or merge operand) if found,
+   *         std::nullopt if this table has nothing for the key, or
+   *         StorageError on I/O failure. A covering range tombstone is
+   *         reported as a tombstone with the range's sequence number.
+   */
+  std::expected<std::optional<Entry>, StorageError>
+  lookup(std::string_view key,
+         SequenceNumber snapshot = kMaxSequenceNumber) const;
 
-  std::expected<std::optional<std::pair<std::string, std::string>>,
-                StorageError>
-  read_entry() const;
-  std::expected<size_t, StorageError>
-  write_entry(const std::string_view key, const std::string_view value) const;
+  /// A byte range of the table file.
+  struct BlockRange {
+    size_t offset;
+    size_t length;
+  };
+
+  /**
+   * @brief The part of the file a lookup of `key` has to read: the blocks
+   * that may hold its versions. For callers doing their own I/O.
+   * @return The range, or std::nullopt if the key range or bloom filter
+   *         rule the key out.
+   */
+  std::optional<BlockRange> lookup_range(std::string_view key) const;
+
+  /**
+   * @brief lookup(), on the bytes of lookup_range(key) read by the caller.
+   * @param range The bytes, or an empty span if lookup_range() ruled the
+   *        key out (range tombstones may still delete it).
+   */
+  std::expected<std::optional<Entry>, StorageError>
+  lookup_in(std::string_view key, SequenceNumber snapshot,
+            std::span<const std::byte> range) const;
+
+  /**
+   * @brief The open file, opening it if the table cache closed it, for
+   * callers doing their own I/O. Stays open while the pointer is held.
+   * @return The file, or StorageError if it can't be opened.
+   */
+  std::expected<std::shared_ptr<const TableFile>, StorageError> pin() const;
+
+  /**
+   * @brief The bytes [offset, offset + length) of the file, as the read mode
+   * gets them: a view of the mapping, or a buffer from the block cache or a
+   * fresh read (which is then cached).
+   * @return The bytes, or StorageError on I/O failure or a range past the
+   *         end of the file.
+   */
+  std::expected<BlockHandle, StorageError> read_block(size_t offset,
+                                                      size_t length) const;
 
-  bool marked_for_delete_{false};
+  /**
+   * @brief Decodes the entry at the start of `data`, which must hold all of
+   * it.
+   */
+  std::expected<KeyEntry, StorageError>
+  decode_entry(std::span<const std::byte> data) const;
+
+  /**
+   * @brief lookup() for a batch of keys, sharing one pass over the filter,
+   * index and data blocks.
+   * @param keys Keys to look up, sorted ascending. Duplicates are allowed.
+   * @param snapshot Ignore entries with larger sequence numbers.
+   * @return One result per key, in the same order, or StorageError on I/O
+   *         failure.
+   */
+  std::expected<std::vector<std::optional<Entry>>, StorageError>
+  multi_lookup(std::span<const std::string_view> keys,
+               SequenceNumber snapshot = kMaxSequenceNumber) const;
+
+  /**
+   * @brief Cheap check (key range, then bloom filter) for whether this table
+   * may hold an entry for the key. No false negatives; true if the filter
+   * can't be loaded, so the read that follows reports the error.
+   */
+  bool may_contain(std::string_view key) const;
+
+  /**
+   * @brief Loads the bloom filter, index and range tombstones of an opened
+   * table, unless already loaded. Thread-safe; every call after the first
+   * returns the first one's result.
+   *
+   * The accessors and lookups call this themselves. Those returning
+   * references (index(), range_tombstones()) see empty metadata if it
+   * failed, so callers that must tell the difference call this first.
+   * @return void on success, StorageError if the metadata can't be read.
+   */
+  std::expected<void, StorageError> load_metadata() const;
+
+  std::expected<std::optional<KeyEntry>, StorageError> next();
+
+  std::expected<std::optional<KeyEntry>, StorageError> read_entry() const;
+
+  /**
+   * @brief Decodes the entry starting at the given file offset.
+   *
+   * Unlike next()/read_entry(), this doesn't touch the table's cursor, so it
+   * is safe to call from concurrent readers.
+   * @param pos File offset of the entry.
+   * @return The entry, std::nullopt past the last entry, or StorageError.
+   */
+  std::expected<std::optional<KeyEntry>, StorageError>
+  read_entry_at(size_t pos) const;
+
+  /**
+   * @brief Resets the next() cursor to the first entry.
+   */
+  void rewind() {
+    file_pos_ = 0;
+    readahead_until_ = 0;
+  }
+  std::expected<size_t, StorageError> write_entry(const std::string_view key,
+                                                  const Entry &entry) const;
+
+  /**
+   * @brief Serialized size of an entry:
+   * [keylen:4][valuelen:4][type:1][seq:8][key][value][checksum:4]
+   */
+  static size_t entry_size(size_t keylen, size_t valuelen) {
+    return 2 * sizeof(uint32_t) + sizeof(EntryType) + sizeof(SequenceNumber) +
+           keylen + valuelen + sizeof(uint32_t);
+  }
+
+  /**
+   * @brief Writes a complete table (header, bloom filter, entries, index,
+   * range tombstones and footer) from a range of (key, Entry) pairs sorted by
+   * key, with several versions of a key ordered newest first.
+   * @param first Start of the sorted range.
+   * @param last End of the sorted range.
+   * @param ranges Deleted key ranges hiding data in older tables. The
+   *        header's key range is widened to include them.
+   * @return void on success, StorageError on failure.
+   */
+  template <typename It>
+  std::expected<void, StorageError>
+  write_sorted(It first, It last, const RangeTombstoneList &ranges = {});
+
+  /**
+   * @brief Deleted key ranges stored with this table. They hide entries in
+   * older tables, not this table's own entries.
+   */
+  const RangeTombstoneList &range_tombstones() const {
+    (void)load_metadata();
+    return range_tombstones_;
+  }
+
+  /**
+   * @brief Throttle all writes to this table through a shared rate limiter.
+   * @param limiter Limiter to charge writes to, or nullptr for no limit.
+   * @param priority Flush or Compaction, depending on who is writing.
+   * @param wait Whether writes wait for the limiter, or are only charged to
+   *        it (see RateLimiter::charge()).
+   */
+  void set_rate_limiter(RateLimiter *limiter, RateLimiter::Priority priority,
+                        bool wait = true) {
+    rate_limiter_ = limiter;
+    io_priority_ = priority;
+    wait_for_limiter_ = wait;
+  }
+
+  /**
+   * @brief Choose how the file is read. Call before ensure_mapped().
+   */
+  void set_options(const TableOptions &options) { options_ = options; }
+
+  ReadMode read_mode() const { return options_.read_mode; }
+
+  /**
+   * @brief Process-unique id of this table, naming its blocks in the block
+   * cache.
+   */
+  uint64_t file_id() const { return file_id_; }
+
+  /**
+   * @brief Size of the table file in bytes, once ready for reads (see
+   * ensure_mapped()).
+   */
+  size_t file_size() const { return file_size_; }
+
+  /**
+   * @brief Delete the file once this table is destroyed, i.e. once the last
+   * Version (and reader) holding it lets go.
+   */
+  void mark_obsolete() { obsolete_.store(true, std::memory_order_release); }
+
+  /**
+   * @brief Finishes writing: closes the writer's descriptor, so the first
+   * read opens the file as the read mode wants it (mapped, or with O_DIRECT
+   * too). A table must be ready before it is shared between threads, since
+   * the lazy setup in next() isn't thread-safe.
+   *
+   * On filesystems without O_DIRECT (tmpfs), Direct falls back to pread().
+   * @return void on success, StorageError on failure.
+   */
+  std::expected<void, StorageError> ensure_mapped();
 
   struct Header {
     std::string min_key;
     std::string max_key;
+    /**
+     * Largest sequence number of any entry or range tombstone in the table.
+     */
+    SequenceNumber max_sequence;
     /**
      * Serialized size in bytes.
      */
     size_t size;
-    Header() : min_key(), max_key(), size(0) {}
-    Header(std::string min, std::string max)
+    Header() : min_key(), max_key(), max_sequence(0), size(0) {}
+    Header(std::string min, std::string max, SequenceNumber max_seq = 0)
         : min_key(std::move(min)), max_key(std::move(max)),
+          max_sequence(max_seq),
           size(this->min_key.size() + sizeof(uint32_t) + this->max_key.size() +
-               sizeof(uint32_t)) {
+               sizeof(uint32_t) + sizeof(SequenceNumber)) {
 
       // Serialized size in bytes:
-      // [num_entries:4][min_key_len:4][min_key][max_key_len:4][max_key]
+      // [min_key_len:4][min_key][max_key_len:4][max_key][max_sequence:8]
     }
   };
   struct Footer {
@@ -135,10 +408,11 @@ public:
   std::expected<void, StorageError> write_footer(Footer footer);
   [[nodiscard]]
   std::expected<size_t, StorageError> write_index();
-  std::expected<void, StorageError> read_index();
+  [[nodiscard]]
+  std::expected<size_t, StorageError>
+  write_range_tombstones(const RangeTombstoneList &ranges);
   [[nodiscard]]
   std::expected<size_t, StorageError> write_bloom_filter(BloomFilter &&);
-  std::expected<BloomFilter, StorageError> read_bloom_filter();
   [[nodiscard]]
   const Header &header() const {
     return header_;
@@ -150,32 +424,261 @@ public:
 
   [[nodiscard]]
   std::vector<IndexEntry> &index() {
+    (void)load_metadata();
+    return index_;
+  }
+  [[nodiscard]]
+  const std::vector<IndexEntry> &index() const {
+    (void)load_metadata();
     return index_;
   }
 
+  /**
+   * @brief File offset of the first entry, right after the header and bloom
+   * filter.
+   */
+  size_t data_offset() const {
+    return header_.size + sizeof(size_t) + filter_size_ * sizeof(bool);
+  }
+
+  /**
+   * @brief Hint that [offset, offset + length) of the file will be read soon,
+   * so the kernel can start paging it in. Best effort; a no-op for Direct
+   * reads, which skip the page cache.
+   */
+  void prefetch(size_t offset, size_t length) const;
+
+  /**
+   * @brief Hint that [offset, offset + length) of the file won't be read
+   * again soon: drop it from the page cache and the mapping. Best effort.
+   */
+  void release(size_t offset, size_t length) const;
+
+  /// How the table is about to be read, for the kernel's readahead.
+  enum class Access {
+    /// Point lookups: read only the pages asked for. The default.
+    Random,
+    /// One pass from front to back with next(): read well ahead.
+    Sequential,
+  };
+
+  /**
+   * @brief Tell the kernel how the table is about to be read. While
+   * Sequential, next() also keeps a window of kCompactionReadahead bytes
+   * ahead of the cursor on its way in.
+   */
+  void advise(Access access);
+
 private:
+  friend class TableCache;
+
   std::filesystem::path path_;
+  /// Descriptor and mapping for writing and parsing the metadata; reads go
+  /// through file_.
   int fd_{-1};
   off_t file_pos_{0};
   std::span<std::byte> mapped_data_;
   size_t file_size_{0};
+  bool ready_{false};
   Header header_;
   Footer footer_;
-  std::vector<IndexEntry> index_;
-  BloomFilter bloom_filter_;
-  // TODO: Add a refcount
+  /// Bits in the bloom filter, known before the filter itself is loaded.
+  size_t filter_size_{0};
+  /// Hash count of the filter, stored in the top byte of its size.
+  size_t filter_hashes_{BloomFilter::kDefaultHashes};
+  static constexpr unsigned kFilterHashesShift = 56;
+  /// Filled in by load_metadata() for opened tables, or by the writer.
+  mutable std::vector<IndexEntry> index_;
+  mutable BloomFilter bloom_filter_;
+  mutable RangeTombstoneList range_tombstones_;
+  /// Whether load_metadata() has run (or there was nothing to load).
+  mutable std::atomic<bool> metadata_loaded_{true};
+  mutable std::optional<StorageError> metadata_error_;
+  mutable std::mutex metadata_mutex_;
+  RateLimiter *rate_limiter_{nullptr};
+  RateLimiter::Priority io_priority_{RateLimiter::Priority::Flush};
+  bool wait_for_limiter_{true};
+  std::atomic<bool> obsolete_{false};
+  TableOptions options_;
+  uint64_t file_id_{next_file_id()};
+  /// The open file for reads, or null while closed. Guarded by file_mutex_.
+  mutable std::shared_ptr<const TableFile> file_;
+  mutable std::mutex file_mutex_;
+  /// Chunk of the file next() reads from.
+  BlockHandle sequential_;
+  size_t sequential_offset_{0};
+  std::atomic<Access> access_{Access::Random};
+  /// Once next() gets here, it prefetches the next window.
+  size_t readahead_until_{0};
+
+  static uint64_t next_file_id();
 
   /**
-   * @brief Opens the SSTable file for reading.
+   * @brief Opens the SSTable file.
+   * @param create Open for writing, creating the file if it doesn't exist;
+   *        otherwise open an existing file read-only.
    * @return void on success, StorageError on failure.
    */
-  std::expected<void, StorageError> open_file();
+  std::expected<void, StorageError> open_file(bool create = true);
 
-  std::expected<void, StorageError> ensure_mapped();
+  /**
+   * @brief Write a buffer at the current file offset, charging the rate
+   * limiter first if one is set.
+   * @return void on success, StorageError on failure.
+   */
+  std::expected<void, StorageError>
+  write_bytes(const std::vector<std::byte> &buffer) const;
 
   /**
-   * @brief Closes the file descriptor if open.
+   * @brief Closes the writer's descriptor and mapping if open.
    */
   void close_file();
+
+  /**
+   * @brief Opens the file for reads in the read mode.
+   */
+  std::expected<std::shared_ptr<const TableFile>, StorageError>
+  open_for_reads() const;
+
+  /**
+   * @brief Drop the table's reference to its open file; readers still
+   * holding it keep it open until they're done. For the TableCache.
+   */
+  void close_for_reads() const;
+
+  /**
+   * @brief Reads the metadata load_metadata() loads. Needs metadata_mutex_.
+   */
+  std::expected<void, StorageError> read_metadata() const;
+
+  /// Parsers for the metadata blocks, each given exactly its block.
+  std::expected<void, StorageError>
+  read_bloom_filter(std::span<const std::byte> block) const;
+  std::expected<void, StorageError>
+  read_index(std::span<const std::byte> block) const;
+  std::expected<void, StorageError>
+  read_range_tombstones(std::span<const std::byte> block) const;
+
+  /**
+   * @brief Maps the whole file, whatever the read mode.
+   */
+  std::expected<void, StorageError> map_file();
+
+  void unmap_file();
+
+  /**
+   * @brief File offset to start scanning from for the key's entries.
+   */
+  size_t block_offset(std::string_view key) const;
+
+  /**
+   * @brief The bytes [offset, offset + length) of `mapping`, which maps the
+   * file.
+   */
+  std::expected<std::span<const std::byte>, StorageError>
+  mapped_range(std::span<const std::byte> mapping, size_t offset,
+               size_t length) const;
+
+  /**
+   * @brief read_block() from an already pinned file.
+   */
+  std::expected<BlockHandle, StorageError>
+  read_block(const std::shared_ptr<const TableFile> &file, size_t offset,
+             size_t length) const;
+
+  /**
+   * @brief read_block() without the block cache.
+   */
+  std::expected<BlockHandle, StorageError>
+  read_uncached(const std::shared_ptr<const TableFile> &file, size_t offset,
+                size_t length) const;
+
+  /**
+   * @brief Read [offset, offset + length) through the file's O_DIRECT
+   * descriptor, widened to aligned offsets.
+   */
+  std::expected<BlockHandle, StorageError>
+  read_direct(const TableFile &file, size_t offset, size_t length) const;
+
+  /**
+   * @brief read_entry() for next(): decodes the entry at the cursor from
+   * sequential_, refilling it a chunk at a time.
+   */
+  std::expected<std::optional<KeyEntry>, StorageError> read_sequential();
 };
+
+template <typename It>
+std::expected<void, StorageError>
+SSTable::write_sorted(It first, It last, const RangeTombstoneList &ranges) {
+  // Handle empty table - write valid SSTable with empty key range
+  std::string min_key;
+  std::string max_key;
+  SequenceNumber max_sequence = ranges.max_sequence();
+  size_t bytes_written{0};
+
+  for (auto it = first; it != last; ++it) {
+    max_sequence = std::max(max_sequence, it->second.seq);
+  }
+  if (first != last) {
+    min_key = first->first;
+    max_key = std::prev(last)->first;
+  }
+  if (!ranges.empty()) {
+    // Range ends are exclusive, so this over-approximates by one key; the
+    // header range only has to be a superset.
+    const auto &lo = ranges.fragments().front().begin;
+    const auto &hi = ranges.fragments().back().end;
+    min_key = first != last ? std::min(min_key, lo) : lo;
+    max_key = first != last ? std::max(max_key, hi) : hi;
+  }
+
+  Header header{min_key, max_key, max_sequence};
+  if (auto res = write_header(std::move(header)); !res) {
+    return std::unexpected{res.error()};
+  }
+  bytes_written += header_.size;
+
+  BloomFilter bloom_filter{static_cast<size_t>(std::distance(first, last)),
+                           options_.bloom_bits_per_key};
+  for (auto it = first; it != last; ++it) {
+    bloom_filter.add(std::string_view{it->first});
+  }
+
+  auto bf_res = write_bloom_filter(std::move(bloom_filter));
+  if (!bf_res) {
+    return std::unexpected{bf_res.error()};
+  }
+  bytes_written += bf_res.value();
+
+  size_t i = 0;
+  for (auto it = first; it != last; ++it) {
+    const auto &[key, entry] = *it;
+    auto result = write_entry(key, entry);
+    if (!result) {
+      return std::unexpected(result.error());
+    }
+
+    if (i % std::max<size_t>(options_.index_interval, 1) == 0) {
+      index_.emplace_back(std::string{key}, bytes_written);
+    }
+    bytes_written += result.value();
+    i++;
+  }
+
+  Footer footer;
+  footer.index_offset = bytes_written;
+
+  auto result = write_index();
+  if (!result) {
+    return std::unexpected(result.error());
+  }
+  footer.index_size = result.value();
+  footer.num_index_entries = index_.size();
+
+  if (auto res = write_range_tombstones(ranges); !res) {
+    return std::unexpected(res.error());
+  }
+
+  return write_footer(footer);
+}
 } // namespace lsm_storage_engine
@@ -0,0 +1,144 @@
+#include "SSTableIterator.h"
+#include <algorithm>
+#include <utility>
+namespace lsm_storage_engine {
+
+SSTableIterator::SSTableIterator(const SSTable &table,
+                                 std::optional<std::string> lower_bound,
+                                 std::optional<std::string> upper_bound,
+                                 size_t readahead_size)
+    : table_(table), lower_bound_(std::move(lower_bound)),
+      upper_bound_(std::move(upper_bound)), readahead_size_(readahead_size) {
+  // Without its index the table reads as empty; say why.
+  if (auto res = table_.load_metadata(); !res) {
+    error_ = res.error();
+  }
+}
+
+bool SSTableIterator::load_block(size_t block, bool forward) {
+  const auto &index = table_.index();
+  if (block >= index.size()) {
+    invalidate();
+    return false;
+  }
+  // Skip blocks that start at or past the upper bound, or end before the
+  // lower bound: nothing in them is in range. (A block followed by one
+  // starting at the lower bound may still hold newer versions of that key.)
+  bool above = upper_bound_ && index[block].key >= *upper_bound_;
+  bool below = lower_bound_ && block + 1 < index.size() &&
+               index[block + 1].key < *lower_bound_;
+  if (above || below) {
+    invalidate();
+    return false;
+  }
+
+  size_t begin = index[block].file_position;
+  size_t end = block + 1 < index.size() ? index[block + 1].file_position
+                                        : table_.footer().index_offset;
+  if (readahead_size_ > 0) {
+    if (forward) {
+      table_.prefetch(end, readahead_size_);
+    } else {
+      size_t start = begin > readahead_size_ ? begin - readahead_size_ : 0;
+      table_.prefetch(start, begin - start);
+    }
+  }
+
+  auto bytes = table_.read_block(begin, end - begin);
+  if (!bytes) {
+    error_ = bytes.error();
+    invalidate();
+    return false;
+  }
+  entries_.clear();
+  pos_ = 0;
+  for (size_t pos = 0; pos < bytes->data.size();) {
+    auto entry = table_.decode_entry(bytes->data.subspan(pos));
+    if (!entry) {
+      error_ = entry.error();
+      invalidate();
+      return false;
+    }
+    pos += SSTable::entry_size(entry->first.size(),
+                               entry->second.value.size());
+    entries_.push_back(std::move(*entry));
+  }
+  block_ = block;
+  return !entries_.empty();
+}
+
+void SSTableIterator::seek_to_first() {
+  if (lower_bound_) {
+    seek(*lower_bound_);
+  } else if (load_block(0, true)) {
+    pos_ = 0;
+  }
+}
+
+void SSTableIterator::seek_to_last() {
+  const auto &index = table_.index();
+  // Last block starting below the upper bound.
+  size_t block = index.size();
+  if (upper_bound_) {
+    auto it = std::ranges::lower_bound(index, *upper_bound_,
+                                       std::ranges::less{},
+                                       &SSTable::IndexEntry::key);
+    block = static_cast<size_t>(it - index.begin());
+  }
+  if (block == 0 || !load_block(block - 1, false)) {
+    invalidate();
+    return;
+  }
+  pos_ = entries_.size() - 1;
+  if (upper_bound_) {
+    auto it = std::ranges::lower_bound(entries_, *upper_bound_,
+                                       std::ranges::less{}, &KeyEntry::first);
+    // The block starts below the bound, so this is at least one entry in.
+    pos_ = static_cast<size_t>(it - entries_.begin()) - 1;
+  }
+}
+
+void SSTableIterator::seek(std::string_view target) {
+  if (lower_bound_ && target < *lower_bound_) {
+    target = *lower_bound_;
+  }
+  // Versions of the target may start in the block before the first one
+  // whose first key is the target.
+  const auto &index = table_.index();
+  auto it = std::ranges::lower_bound(index, target, std::ranges::less{},
+                                     &SSTable::IndexEntry::key);
+  size_t block =
+      it == index.begin() ? 0 : static_cast<size_t>(it - index.begin()) - 1;
+  if (!load_block(block, true)) {
+    return;
+  }
+  auto entry = std::ranges::lower_bound(entries_, target, std::ranges::less{},
+                                        &KeyEntry::first);
+  pos_ = static_cast<size_t>(entry - entries_.begin());
+  if (pos_ == entries_.size() && load_block(block + 1, true)) {
+    pos_ = 0;
+  }
+}
+
+void SSTableIterator::next() {
+  if (!valid()) {
+    return;
+  }
+  if (++pos_ == entries_.size() && load_block(block_ + 1, true)) {
+    pos_ = 0;
+  }
+}
+
+void SSTableIterator::prev() {
+  if (!valid()) {
+    return;
+  }
+  if (pos_ > 0) {
+    --pos_;
+  } else if (block_ == 0) {
+    invalidate();
+  } else if (load_block(block_ - 1, false)) {
+    pos_ = entries_.size() - 1;
+  }
+}
+} // namespace lsm_storage_engine
@@ -0,0 +1,74 @@
+#pragma once
+#include "InternalIterator.h"
+#include "SSTable.h"
+#include <optional>
+#include <string>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief InternalIterator over one SSTable.
+ *
+ * Decodes one index block (the kIndexSpace entries between two index
+ * entries) at a time, so seeks binary-search the index and prev() doesn't
+ * need back pointers in the file. Blocks entirely outside the bounds are
+ * never read, and with a readahead size set, the next block in the scan
+ * direction is prefetched while the current one is consumed.
+ *
+ * Reads blocks with SSTable::read_block(), through the table's shared
+ * mapping or block cache, so several iterators (and get()s) can run over the
+ * same table at once. The table must outlive the iterator.
+ */
+class SSTableIterator : public InternalIterator {
+public:
+  /**
+   * @param table The mapped table to scan.
+   * @param lower_bound Inclusive lower key bound, if any.
+   * @param upper_bound Exclusive upper key bound, if any.
+   * @param readahead_size Bytes to prefetch ahead of the scan; 0 for none.
+   */
+  SSTableIterator(const SSTable &table, std::optional<std::string> lower_bound,
+                  std::optional<std::string> upper_bound,
+                  size_t readahead_size);
+
+  bool valid() const override { return pos_ < entries_.size(); }
+  void seek_to_first() override;
+  void seek_to_last() override;
+  void seek(std::string_view target) override;
+  void next() override;
+  void prev() override;
+  const std::string &key() const override { return entries_[pos_].first; }
+  const Entry &entry() const override { return entries_[pos_].second; }
+  const RangeTombstoneList &range_tombstones() const override {
+    return table_.range_tombstones();
+  }
+  const std::optional<StorageError> &error() const override { return error_; }
+
+private:
+  const SSTable &table_;
+  std::optional<std::string> lower_bound_;
+  std::optional<std::string> upper_bound_;
+  size_t readahead_size_;
+
+  /// Index of the decoded block, or npos if none.
+  size_t block_{npos};
+  std::vector<KeyEntry> entries_;
+  /// Position in entries_; entries_.size() when invalid.
+  size_t pos_{0};
+  std::optional<StorageError> error_;
+
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  /**
+   * @brief Decode block `block` into entries_, unless it lies entirely
+   * outside the bounds. Invalidates the cursor if it isn't loaded.
+   * @return Whether the block was loaded.
+   */
+  bool load_block(size_t block, bool forward);
+
+  void invalidate() {
+    entries_.clear();
+    pos_ = 0;
+  }
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,59 @@
+#include "SSTableWriter.h"
+#include "Manifest.h"
+#include <stdexcept>
+#include <utility>
+namespace lsm_storage_engine {
+
+SSTableWriter::SSTableWriter(std::filesystem::path dir, const Options &options)
+    : dir_(std::move(dir)), target_file_size_(options.target_file_size) {
+  table_options_.index_interval = options.index_interval;
+  table_options_.bloom_bits_per_key = options.bloom_bits_per_key;
+  std::filesystem::create_directories(dir_);
+}
+
+void SSTableWriter::put(std::string_view key, std::string_view value) {
+  add(key, Entry::put(std::string{value}));
+}
+
+void SSTableWriter::rm(std::string_view key) { add(key, Entry::tombstone()); }
+
+void SSTableWriter::merge(std::string_view key, std::string_view operand) {
+  add(key, Entry::merge(std::string{operand}));
+}
+
+void SSTableWriter::add(std::string_view key, Entry entry) {
+  if (last_key_ && key <= *last_key_) {
+    throw std::invalid_argument(
+        "SSTableWriter keys must be strictly ascending!");
+  }
+  last_key_ = key;
+  pending_bytes_ += SSTable::entry_size(key.size(), entry.value.size());
+  pending_.emplace_back(std::string{key}, std::move(entry));
+  if (pending_bytes_ >= target_file_size_) {
+    write_table();
+  }
+}
+
+void SSTableWriter::write_table() {
+  auto path = dir_ / ("ingest-" + Manifest::table_name(written_.size() + 1));
+  auto sst = SSTable::create(path);
+  if (!sst) {
+    throw std::runtime_error("Could not create " + path.string());
+  }
+  sst->set_options(table_options_);
+  if (auto res = sst->write_sorted(pending_.cbegin(), pending_.cend());
+      !res || !sst->ensure_mapped()) {
+    throw std::runtime_error("Could not write " + path.string());
+  }
+  written_.push_back(std::move(path));
+  pending_.clear();
+  pending_bytes_ = 0;
+}
+
+std::vector<std::filesystem::path> SSTableWriter::finish() {
+  if (!pending_.empty()) {
+    write_table();
+  }
+  return written_;
+}
+} // namespace lsm_storage_engine
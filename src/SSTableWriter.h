@@ -0,0 +1,66 @@
+#pragma once
+#include "Entry.h"
+#include "Options.h"
+#include "SSTable.h"
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Builds SSTables offline from keys in ascending order, for
+ * LsmTree::ingest_files().
+ *
+ * Entries are buffered until they fill a table of about
+ * `options.target_file_size`, which is then written in one sequential pass,
+ * so memory stays bounded however much is loaded. Nothing goes through a
+ * WAL or memtable.
+ *
+ * Every entry is written with sequence number 0; ingestion gives each file
+ * its number. Not thread-safe: use one writer per key range to build in
+ * parallel.
+ */
+class SSTableWriter {
+public:
+  /**
+   * @param dir Where the tables go, as `ingest-<n>.sst`. Created if missing.
+   * @param options The table format (index_interval, bloom_bits_per_key)
+   *        and target_file_size; the rest is unused.
+   */
+  explicit SSTableWriter(std::filesystem::path dir,
+                         const Options &options = {});
+
+  /**
+   * @brief Add an entry. Keys must be strictly ascending.
+   * @throws std::invalid_argument if `key` isn't greater than the last one.
+   * @throws std::runtime_error if a table can't be written.
+   */
+  void put(std::string_view key, std::string_view value);
+  void rm(std::string_view key);
+  void merge(std::string_view key, std::string_view operand);
+
+  /**
+   * @brief Write out what is still buffered.
+   * @return Every table written, in key order.
+   */
+  std::vector<std::filesystem::path> finish();
+
+private:
+  std::filesystem::path dir_;
+  TableOptions table_options_;
+  size_t target_file_size_;
+  std::vector<KeyEntry> pending_;
+  size_t pending_bytes_{0};
+  /// The last key added, for the order check.
+  std::optional<std::string> last_key_;
+  std::vector<std::filesystem::path> written_;
+
+  void add(std::string_view key, Entry entry);
+
+  /// Write pending_ out as the next table.
+  void write_table();
+};
+} // namespace lsm_storage_engine
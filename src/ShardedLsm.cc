@@ -0,0 +1,261 @@
+#include "ShardedLsm.h"
+#include "utils/CheckSum.h"
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+namespace lsm_storage_engine {
+
+ShardedIterator::ShardedIterator(std::vector<Iterator> shards)
+    : shards_(std::move(shards)), current_(shards_.size()) {}
+
+void ShardedIterator::pick_smallest() {
+  current_ = shards_.size();
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i].valid() &&
+        (!valid() || shards_[i].key() < shards_[current_].key())) {
+      current_ = i;
+    }
+  }
+}
+
+void ShardedIterator::pick_largest() {
+  current_ = shards_.size();
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i].valid() &&
+        (!valid() || shards_[i].key() > shards_[current_].key())) {
+      current_ = i;
+    }
+  }
+}
+
+void ShardedIterator::seek_to_first() {
+  for (auto &shard : shards_) {
+    shard.seek_to_first();
+  }
+  direction_ = Direction::Forward;
+  pick_smallest();
+}
+
+void ShardedIterator::seek_to_last() {
+  for (auto &shard : shards_) {
+    shard.seek_to_last();
+  }
+  direction_ = Direction::Backward;
+  pick_largest();
+}
+
+void ShardedIterator::seek(std::string_view target) {
+  for (auto &shard : shards_) {
+    shard.seek(target);
+  }
+  direction_ = Direction::Forward;
+  pick_smallest();
+}
+
+void ShardedIterator::seek_for_prev(std::string_view target) {
+  for (auto &shard : shards_) {
+    shard.seek_for_prev(target);
+  }
+  direction_ = Direction::Backward;
+  pick_largest();
+}
+
+void ShardedIterator::next() {
+  if (direction_ == Direction::Backward) {
+    // The other shards sit before the current key. None of them holds it,
+    // so seeking puts them on their first key past it.
+    std::string key = shards_[current_].key();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      if (i != current_) {
+        shards_[i].seek(key);
+      }
+    }
+    direction_ = Direction::Forward;
+  }
+  shards_[current_].next();
+  pick_smallest();
+}
+
+void ShardedIterator::prev() {
+  if (direction_ == Direction::Forward) {
+    std::string key = shards_[current_].key();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      if (i != current_) {
+        shards_[i].seek_for_prev(key);
+      }
+    }
+    direction_ = Direction::Backward;
+  }
+  shards_[current_].prev();
+  pick_largest();
+}
+
+ShardedLsm::ShardedLsm(ShardedOptions options) : options_(std::move(options)) {
+  auto n = options_.num_shards;
+  if (n == 0) {
+    throw std::invalid_argument("A ShardedLsm needs at least one shard!");
+  }
+  if (options_.partitioning == Partitioning::Range &&
+      (options_.split_keys.size() != n - 1 ||
+       std::ranges::adjacent_find(options_.split_keys, std::greater_equal{}) !=
+           options_.split_keys.end())) {
+    throw std::invalid_argument(
+        "Range partitioning needs num_shards - 1 ascending split keys!");
+  }
+  std::filesystem::create_directories(options_.shard_options.dir);
+  check_layout();
+
+  // Created here, rather than by each shard, so the shards share them.
+  auto base = options_.shard_options;
+  base.create_shared();
+  base.row_cache_bytes /= n;
+
+  // Each shard replays its own WAL and opens its own tables: do it in
+  // parallel.
+  shards_.resize(n);
+  std::vector<std::exception_ptr> errors(n);
+  {
+    std::vector<std::jthread> pool;
+    for (size_t i = 0; i < n; ++i) {
+      pool.emplace_back([&, i] {
+        auto shard_options = base;
+        shard_options.dir = base.dir / ("shard-" + std::to_string(i));
+        try {
+          shards_[i] = std::make_unique<LsmTree>(std::move(shard_options));
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void ShardedLsm::check_layout() const {
+  std::ostringstream layout;
+  layout << (options_.partitioning == Partitioning::Hash ? "hash" : "range")
+         << ' ' << options_.num_shards << '\n';
+  // Length-prefixed: split keys may hold any byte.
+  for (const auto &key : options_.split_keys) {
+    layout << key.size() << ' ' << key << '\n';
+  }
+  auto path = options_.shard_options.dir / "SHARDS";
+  if (!std::filesystem::exists(path)) {
+    // A crash before this completes leaves no shards behind either.
+    std::ofstream file{path, std::ios::binary};
+    file << layout.str();
+    if (!file.good()) {
+      throw std::runtime_error("Could not write " + path.string());
+    }
+    return;
+  }
+  std::ifstream file{path, std::ios::binary};
+  std::string recorded{std::istreambuf_iterator<char>{file}, {}};
+  if (recorded != layout.str()) {
+    throw std::invalid_argument(
+        "Shard layout doesn't match the one in " + path.string() + "!");
+  }
+}
+
+size_t ShardedLsm::shard_of(std::string_view key) const {
+  if (options_.partitioning == Partitioning::Hash) {
+    return xxhash64(key) % shards_.size();
+  }
+  // Shard i starts at split_keys[i - 1].
+  auto it = std::ranges::upper_bound(options_.split_keys, key, std::less{});
+  return static_cast<size_t>(it - options_.split_keys.begin());
+}
+
+std::vector<size_t>
+ShardedLsm::shards_overlapping(const std::optional<std::string> &lower,
+                               const std::optional<std::string> &upper) const {
+  std::vector<size_t> overlapping;
+  const auto &splits = options_.split_keys;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (options_.partitioning == Partitioning::Range) {
+      // Shard i holds [splits[i - 1], splits[i]).
+      if (i > 0 && upper && *upper <= splits[i - 1]) {
+        continue;
+      }
+      if (i + 1 < shards_.size() && lower && splits[i] <= *lower) {
+        continue;
+      }
+    }
+    overlapping.push_back(i);
+  }
+  return overlapping;
+}
+
+std::optional<std::string> ShardedLsm::get(std::string_view key) {
+  return shards_[shard_of(key)]->get(key);
+}
+
+std::vector<std::optional<std::string>>
+ShardedLsm::multi_get(std::span<const std::string_view> keys) {
+  std::vector<std::vector<std::string_view>> batches(shards_.size());
+  std::vector<std::vector<size_t>> positions(shards_.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto s = shard_of(keys[i]);
+    batches[s].push_back(keys[i]);
+    positions[s].push_back(i);
+  }
+  std::vector<std::optional<std::string>> results(keys.size());
+  for (size_t s = 0; s < shards_.size(); ++s) {
+    if (batches[s].empty()) {
+      continue;
+    }
+    auto found = shards_[s]->multi_get(batches[s]);
+    for (size_t j = 0; j < found.size(); ++j) {
+      results[positions[s][j]] = std::move(found[j]);
+    }
+  }
+  return results;
+}
+
+void ShardedLsm::put(const std::string &key, const std::string &value) {
+  shards_[shard_of(key)]->put(key, value);
+}
+
+void ShardedLsm::rm(const std::string &key) { shards_[shard_of(key)]->rm(key); }
+
+void ShardedLsm::merge(const std::string &key, const std::string &operand) {
+  shards_[shard_of(key)]->merge(key, operand);
+}
+
+void ShardedLsm::delete_range(const std::string &begin,
+                              const std::string &end) {
+  if (begin >= end) {
+    return;
+  }
+  for (auto s : shards_overlapping(begin, end)) {
+    shards_[s]->delete_range(begin, end);
+  }
+}
+
+ShardedIterator ShardedLsm::new_iterator(const ReadOptions &options) {
+  if (options.snapshot) {
+    throw std::invalid_argument("ShardedLsm scans can't use a snapshot!");
+  }
+  std::vector<Iterator> iterators;
+  for (auto s : shards_overlapping(options.lower_bound, options.upper_bound)) {
+    iterators.push_back(shards_[s]->new_iterator(options));
+  }
+  return ShardedIterator{std::move(iterators)};
+}
+
+void ShardedLsm::close() {
+  for (auto &shard : shards_) {
+    shard->close();
+  }
+}
+} // namespace lsm_storage_engine
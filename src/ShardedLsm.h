@@ -0,0 +1,164 @@
+#pragma once
+#include "Constants.h"
+#include "Iterator.h"
+#include "LsmTree.h"
+#include "Options.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief How a ShardedLsm assigns keys to shards.
+ */
+enum class Partitioning {
+  /// By hash of the key: spreads any workload evenly, but every scan visits
+  /// every shard.
+  Hash,
+  /// By key range, split at ShardedOptions::split_keys: scans only visit
+  /// the shards their bounds overlap, but skewed keys load shards unevenly.
+  Range,
+};
+
+/**
+ * @brief Configuration of a ShardedLsm.
+ */
+struct ShardedOptions {
+  /// Options of every shard. `dir` is the parent: shard i lives in
+  /// `dir/shard-<i>`. Caches and the rate limiter left null are created
+  /// once and shared by all shards; the row cache budget is split evenly.
+  Options shard_options;
+  size_t num_shards{lsm_constants::kDefaultShards};
+  Partitioning partitioning{Partitioning::Hash};
+  /// For Range: the num_shards - 1 keys, ascending, at which each shard
+  /// after the first begins.
+  std::vector<std::string> split_keys;
+};
+
+/**
+ * @brief Ordered, bidirectional scan over every shard of a ShardedLsm.
+ *
+ * Each key lives in exactly one shard, so this only has to interleave the
+ * shards' own iterators in key order; nothing needs resolving between
+ * them. A step costs O(shards).
+ *
+ * Every shard is read as of the iterator's creation, but the shards are
+ * opened one after another, so a scan racing writes to several shards may
+ * see one shard's write and not an earlier one's on another shard.
+ *
+ * Not thread-safe.
+ */
+class ShardedIterator {
+public:
+  /// @param shards One iterator per shard, in any order.
+  explicit ShardedIterator(std::vector<Iterator> shards);
+
+  bool valid() const { return current_ < shards_.size(); }
+
+  void seek_to_first();
+  void seek_to_last();
+  /// Position at the first key >= target.
+  void seek(std::string_view target);
+  /// Position at the last key <= target.
+  void seek_for_prev(std::string_view target);
+  void next();
+  void prev();
+
+  /// Only while valid().
+  const std::string &key() const { return shards_[current_].key(); }
+  const std::string &value() const { return shards_[current_].value(); }
+
+private:
+  enum class Direction { Forward, Backward };
+
+  std::vector<Iterator> shards_;
+  /// The shard positioned at key(), or shards_.size() if none is.
+  size_t current_;
+  Direction direction_{Direction::Forward};
+
+  /// Point current_ at the valid shard with the smallest (or largest) key.
+  void pick_smallest();
+  void pick_largest();
+};
+
+/**
+ * @brief Front end splitting the keyspace across independent LsmTrees.
+ *
+ * A single tree serializes writes on its lock, WAL and memtable. Each shard
+ * here has its own, so writers of keys in different shards never wait on
+ * each other, and each shard flushes and compacts on the threads writing to
+ * it. Block cache, table cache and flush/compaction rate limit are shared.
+ *
+ * The partitioning is recorded in `dir/SHARDS` on first open; reopening
+ * with a different one throws, since keys would land in the wrong shards.
+ *
+ * Writes to one key are ordered as in a single tree; there is no ordering
+ * or atomicity across shards. Snapshots are per tree, so reads here always
+ * see the latest data. Thread-safe.
+ */
+class ShardedLsm {
+public:
+  /**
+   * @brief Open (or create) every shard, in parallel.
+   * @throws std::invalid_argument if the partitioning is malformed or
+   *         doesn't match the one on disk.
+   */
+  explicit ShardedLsm(ShardedOptions options);
+
+  ShardedLsm(const ShardedLsm &) = delete;
+  ShardedLsm &operator=(const ShardedLsm &) = delete;
+
+  std::optional<std::string> get(std::string_view key);
+
+  /**
+   * @brief Retrieve a batch of keys with one LsmTree::multi_get() per shard.
+   * @return One result per key, in the same order as `keys`.
+   */
+  std::vector<std::optional<std::string>>
+  multi_get(std::span<const std::string_view> keys);
+
+  void put(const std::string &key, const std::string &value);
+  void rm(const std::string &key);
+  void merge(const std::string &key, const std::string &operand);
+
+  /// Delete [begin, end) on every shard that may hold keys in it.
+  void delete_range(const std::string &begin, const std::string &end);
+
+  /**
+   * @brief Scan across shards. Only the bounds and readahead of `options`
+   * apply; a snapshot throws std::invalid_argument.
+   */
+  ShardedIterator new_iterator(const ReadOptions &options = {});
+
+  /// Close every shard (see LsmTree::close()).
+  void close();
+
+  /// Index of the shard holding `key`.
+  size_t shard_of(std::string_view key) const;
+
+  size_t num_shards() const { return shards_.size(); }
+
+  LsmTree &shard(size_t index) { return *shards_[index]; }
+
+private:
+  ShardedOptions options_;
+  std::vector<std::unique_ptr<LsmTree>> shards_;
+
+  /**
+   * @brief Shards whose keys may fall in [lower, upper).
+   */
+  std::vector<size_t>
+  shards_overlapping(const std::optional<std::string> &lower,
+                     const std::optional<std::string> &upper) const;
+
+  /**
+   * @brief Record the partitioning in a new tree, or check it against the
+   * one recorded.
+   */
+  void check_layout() const;
+};
+} // namespace lsm_storage_engine
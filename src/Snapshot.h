@@ -0,0 +1,62 @@
+#pragma once
+#include "Entry.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief A consistent, read-only view of the tree as of one sequence number.
+ *
+ * Reads through a snapshot see exactly the writes up to its sequence, no
+ * matter what is written, flushed or compacted afterwards. Taken with
+ * LsmTree::get_snapshot() and handed back with release_snapshot(); until
+ * then, compaction keeps every version it can see.
+ */
+struct Snapshot {
+  SequenceNumber sequence{0};
+};
+
+/**
+ * @brief The sequence numbers of the live snapshots, as one compaction sees
+ * them.
+ *
+ * Snapshots split the sequence space into stripes: a version belongs to the
+ * stripe of the oldest snapshot that can see it. Every reader sees either
+ * all versions of a key in a stripe or none of them, so only the newest one
+ * in each stripe has to be kept.
+ */
+class SnapshotList {
+public:
+  SnapshotList() = default;
+
+  /// @param sequences Live snapshot sequences, in any order.
+  explicit SnapshotList(std::vector<SequenceNumber> sequences)
+      : sequences_(std::move(sequences)) {
+    std::ranges::sort(sequences_);
+  }
+
+  /**
+   * @brief Index of the oldest snapshot that can see `seq`, or the number
+   * of snapshots if only the latest view can.
+   */
+  size_t stripe(SequenceNumber seq) const {
+    return static_cast<size_t>(std::ranges::lower_bound(sequences_, seq) -
+                               sequences_.begin());
+  }
+
+  /**
+   * @brief The oldest snapshot's sequence, or kMaxSequenceNumber if there
+   * are none. Whatever this sequence can't see, nobody can.
+   */
+  SequenceNumber oldest() const {
+    return sequences_.empty() ? kMaxSequenceNumber : sequences_.front();
+  }
+
+  bool empty() const { return sequences_.empty(); }
+
+private:
+  /// Sorted ascending; may hold duplicates.
+  std::vector<SequenceNumber> sequences_;
+};
+} // namespace lsm_storage_engine
@@ -19,5 +19,10 @@ struct StorageError {
   static StorageError file_read(const std::filesystem::path &path) {
     return {Kind::FileRead, "Failed to read file", path};
   }
+
+  static StorageError missing_merge_operator() {
+    return {Kind::Corruption,
+            "Found merge operands but no merge operator is set", {}};
+  }
 };
 } // namespace lsm_storage_engine
@@ -0,0 +1,57 @@
+#include "TableCache.h"
+#include "SSTable.h"
+namespace lsm_storage_engine {
+
+void TableCache::touch(const SSTable &table, bool opened) {
+  std::lock_guard lock(mutex_);
+  ++(opened ? opens_ : hits_);
+  if (auto it = index_.find(&table); it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+  lru_.push_front(&table);
+  index_.emplace(&table, lru_.begin());
+  evict();
+}
+
+void TableCache::erase(const SSTable &table) {
+  std::lock_guard lock(mutex_);
+  if (auto it = index_.find(&table); it != index_.end()) {
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+}
+
+void TableCache::set_capacity(size_t capacity) {
+  std::lock_guard lock(mutex_);
+  capacity_ = capacity;
+  evict();
+}
+
+size_t TableCache::capacity() const {
+  std::lock_guard lock(mutex_);
+  return capacity_;
+}
+
+void TableCache::evict() {
+  // Tables unregister (under mutex_) before they're destroyed, so every
+  // table listed here is still alive.
+  while (capacity_ > 0 && lru_.size() > capacity_) {
+    const SSTable *victim = lru_.back();
+    lru_.pop_back();
+    index_.erase(victim);
+    victim->close_for_reads();
+    ++evictions_;
+  }
+}
+
+TableCache::Stats TableCache::stats() const {
+  std::lock_guard lock(mutex_);
+  return Stats{
+      .hits = hits_,
+      .opens = opens_,
+      .evictions = evictions_,
+      .open_tables = lru_.size(),
+  };
+}
+} // namespace lsm_storage_engine
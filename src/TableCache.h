@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+namespace lsm_storage_engine {
+
+class SSTable;
+
+/**
+ * @brief Bounds how many SSTables keep their file open at once.
+ *
+ * Every table keeps its metadata in memory, but its descriptors and mapping
+ * are only opened on a read (see SSTable::pin()). Each read reports here,
+ * and once more tables are open than the capacity allows, the least
+ * recently read ones are closed; their next read reopens them. So tens of
+ * thousands of tables cost neither tens of thousands of descriptors nor as
+ * many mappings.
+ *
+ * Closing only drops the table's own reference: a reader that pinned the
+ * file keeps it open until it's done.
+ *
+ * A capacity of 0 means no bound. Thread-safe.
+ */
+class TableCache {
+public:
+  /// @param capacity Most tables with an open file at once; 0 for no bound.
+  explicit TableCache(size_t capacity) : capacity_(capacity) {}
+
+  /// Tables point at it, so no copies or moves.
+  TableCache(const TableCache &) = delete;
+  TableCache &operator=(const TableCache &) = delete;
+
+  /**
+   * @brief Record a read of `table`'s open file, closing the least recently
+   * read files over capacity.
+   * @param opened Whether the read had to open the file.
+   */
+  void touch(const SSTable &table, bool opened);
+
+  /// Forget `table`, which is going away.
+  void erase(const SSTable &table);
+
+  /// Change the capacity, closing files over the new one right away.
+  void set_capacity(size_t capacity);
+
+  size_t capacity() const;
+
+  struct Stats {
+    /// Reads that found the file open.
+    unsigned long hits;
+    /// Reads that had to open it.
+    unsigned long opens;
+    /// Files closed to stay within capacity.
+    unsigned long evictions;
+    /// Tables with an open file.
+    size_t open_tables;
+  };
+
+  Stats stats() const;
+
+private:
+  using LruList = std::list<const SSTable *>;
+
+  mutable std::mutex mutex_;
+  size_t capacity_;
+  /// Tables with an open file, most recently read first.
+  LruList lru_;
+  std::unordered_map<const SSTable *, LruList::iterator> index_;
+  unsigned long hits_{0};
+  unsigned long opens_{0};
+  unsigned long evictions_{0};
+
+  /// Close files from the LRU end until within capacity. Needs mutex_.
+  void evict();
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,100 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+namespace lsm_storage_engine {
+
+/**
+ * @brief A lazily started coroutine producing a T.
+ *
+ * Nothing runs until the task is awaited (`co_await task` from another
+ * coroutine) or start()ed from plain code. When it finishes, it resumes its
+ * awaiter directly, so chains of tasks don't grow the stack. Exceptions are
+ * rethrown from the await or result().
+ *
+ * Owns the coroutine frame: move-only, and must outlive the coroutine.
+ */
+template <typename T> class [[nodiscard]] Task {
+public:
+  struct promise_type {
+    std::optional<T> value;
+    std::exception_ptr exception;
+    /// Who to resume once done; nobody for a start()ed task.
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        auto next = handle.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void return_value(T result) { value = std::move(result); }
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() { destroy(); }
+
+  /// Run until the first suspension point, for a task nobody awaits.
+  void start() { handle_.resume(); }
+
+  bool done() const { return handle_.done(); }
+
+  /// The result of a done() task. Throws what the coroutine threw.
+  T result() { return take_result(handle_); }
+
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      std::coroutine_handle<promise_type> handle;
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+      }
+      T await_resume() { return take_result(handle); }
+    };
+    return Awaiter{handle_};
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+
+  static T take_result(std::coroutine_handle<promise_type> handle) {
+    auto &promise = handle.promise();
+    if (promise.exception) {
+      std::rethrow_exception(promise.exception);
+    }
+    return std::move(*promise.value);
+  }
+
+  void destroy() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+};
+} // namespace lsm_storage_engine
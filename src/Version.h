@@ -0,0 +1,48 @@
+#pragma once
+#include "SSTable.h"
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Immutable snapshot of the set of live SSTables.
+ *
+ * The LsmTree publishes the current Version through an atomic shared_ptr.
+ * Readers take a reference with one atomic load and walk the tables without
+ * holding any lock; flushes and compactions build a new Version and swap it
+ * in. An SSTable replaced by compaction stays readable (and its file stays on
+ * disk) until the last Version referencing it is released.
+ */
+struct Version {
+  /**
+   * SSTables ordered oldest to newest.
+   */
+  std::vector<std::shared_ptr<SSTable>> tables;
+
+  /**
+   * Compaction level of each of `tables`: 0 for fresh flushes, +1 per
+   * compaction. Kept here rather than in the tables, which older versions
+   * share, so moving a table down only changes the versions after the move.
+   */
+  std::vector<int> levels;
+
+  /**
+   * @brief Append `table` at `level` as the newest table.
+   */
+  void add(std::shared_ptr<SSTable> table, int level) {
+    tables.push_back(std::move(table));
+    levels.push_back(level);
+  }
+
+  /**
+   * @brief Insert `table` at `level` before the table at `pos`.
+   */
+  void insert(size_t pos, std::shared_ptr<SSTable> table, int level) {
+    auto offset = static_cast<std::ptrdiff_t>(pos);
+    tables.insert(tables.begin() + offset, std::move(table));
+    levels.insert(levels.begin() + offset, level);
+  }
+};
+} // namespace lsm_storage_engine
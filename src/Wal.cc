@@ -1,11 +1,19 @@
 #include "Wal.h"
+#include "Constants.h"
 #include "StorageError.h"
 #include "utils/CheckSum.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <expected>
 #include <fcntl.h>
+#include <iterator>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 #include <vector>
@@ -48,10 +56,10 @@ void Wal::close_file() {
 }
 
 std::expected<void, StorageError> Wal::write(std::string_view key,
-                                             std::string_view value) const {
+                                             const Entry &entry) const {
   std::vector<std::byte> write_buffer;
   auto keylen = static_cast<uint32_t>(key.size());
-  auto valuelen = static_cast<uint32_t>(value.size());
+  auto valuelen = static_cast<uint32_t>(entry.value.size());
 
   auto append = [&write_buffer](const void *d, size_t len) {
     auto data = reinterpret_cast<const std::byte *>(d);
@@ -60,16 +68,29 @@ std::expected<void, StorageError> Wal::write(std::string_view key,
 
   append(&keylen, sizeof(keylen));
   append(&valuelen, sizeof(valuelen));
+  append(&entry.type, sizeof(entry.type));
+  append(&entry.seq, sizeof(entry.seq));
   append(key.data(), key.size());
-  append(value.data(), value.size());
+  append(entry.value.data(), entry.value.size());
 
   auto cs = hash32({reinterpret_cast<const char *>(write_buffer.data()),
                     write_buffer.size()});
 
   append(&cs, sizeof(cs));
 
-  if (::write(fd_, write_buffer.data(), write_buffer.size()) !=
-      static_cast<ssize_t>(write_buffer.size())) {
+  auto written = ::write(fd_, write_buffer.data(), write_buffer.size());
+  if (written != static_cast<ssize_t>(write_buffer.size())) {
+    // Don't leave half a record for the next one to follow: replay would
+    // find it in the middle of the log and report corruption.
+    if (written > 0) {
+      auto end = ::lseek(fd_, 0, SEEK_END);
+      if (end == -1 || ::ftruncate(fd_, end - written) == -1) {
+        return std::unexpected(StorageError{
+            .kind = StorageError::Kind::FileWrite,
+            .message = "Could not cut a torn record off the WAL",
+            .path = path()});
+      }
+    }
     return std::unexpected(StorageError::file_write(path()));
   }
   return {};
@@ -82,11 +103,191 @@ std::expected<void, StorageError> Wal::sync() const {
   return {};
 }
 
-std::expected<void, StorageError> Wal::clear() const {
-  if (::ftruncate(fd_, 0) == -1) {
+std::expected<void, StorageError> Wal::clear() const { return truncate(0); }
+
+std::expected<size_t, StorageError> Wal::size() const {
+  struct stat st{};
+  if (::fstat(fd_, &st) == -1) {
+    return std::unexpected{StorageError::file_read(path())};
+  }
+  return static_cast<size_t>(st.st_size);
+}
+
+std::expected<void, StorageError> Wal::truncate(size_t size) const {
+  if (::ftruncate(fd_, static_cast<off_t>(size)) == -1) {
     return std::unexpected{StorageError::file_write(path())};
   }
   return {};
 }
 
+/**
+ * Size of the WAL record at the start of `data`, or 0 if `data` ends before
+ * the record does, as it does after a torn write.
+ * Format: [keylen:4][valuelen:4][type:1][seq:8][key][value][checksum:4]
+ */
+static size_t wal_record_size(std::span<const std::byte> data) {
+  constexpr size_t kFixed = 2 * sizeof(uint32_t) + sizeof(EntryType) +
+                            sizeof(SequenceNumber) + sizeof(uint32_t);
+  if (data.size() < kFixed) {
+    return 0;
+  }
+  uint32_t keylen{0};
+  uint32_t valuelen{0};
+  ::memcpy(&keylen, data.data(), sizeof(keylen));
+  ::memcpy(&valuelen, data.data() + sizeof(keylen), sizeof(valuelen));
+  size_t size = kFixed + keylen + valuelen;
+  return size <= data.size() ? size : 0;
+}
+
+/**
+ * Decode a record found by wal_record_size(), or std::nullopt if its
+ * checksum doesn't match.
+ */
+static std::optional<KeyEntry>
+decode_wal_record(std::span<const std::byte> record) {
+  size_t datalen = record.size() - sizeof(uint32_t);
+  uint32_t checksum{0};
+  ::memcpy(&checksum, record.data() + datalen, sizeof(checksum));
+  if (checksum !=
+      hash32({reinterpret_cast<const char *>(record.data()), datalen})) {
+    return std::nullopt;
+  }
+  uint32_t keylen{0};
+  uint32_t valuelen{0};
+  EntryType type{EntryType::Put};
+  SequenceNumber seq{0};
+  const std::byte *pos = record.data();
+  ::memcpy(&keylen, pos, sizeof(keylen));
+  pos += sizeof(keylen);
+  ::memcpy(&valuelen, pos, sizeof(valuelen));
+  pos += sizeof(valuelen);
+  ::memcpy(&type, pos, sizeof(type));
+  pos += sizeof(type);
+  ::memcpy(&seq, pos, sizeof(seq));
+  pos += sizeof(seq);
+  std::string key(reinterpret_cast<const char *>(pos), keylen);
+  std::string value(reinterpret_cast<const char *>(pos + keylen), valuelen);
+  return KeyEntry{std::move(key), Entry{type, std::move(value), {}, seq}};
+}
+
+/**
+ * Whether a whole record with a valid checksum starts anywhere in `data`.
+ * Nothing follows a write the crash cut short, so the bytes after a record
+ * running past the end of the log can't hold one unless its length is
+ * corrupt.
+ */
+static bool holds_record(std::span<const std::byte> data) {
+  for (size_t pos = 0; pos < data.size(); ++pos) {
+    auto rest = data.subspan(pos);
+    auto record_size = wal_record_size(rest);
+    if (record_size > 0 && decode_wal_record(rest.first(record_size))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::expected<std::vector<KeyEntry>, StorageError>
+Wal::read(const std::filesystem::path &wal_path) {
+  if (!std::filesystem::exists(wal_path)) {
+    return std::vector<KeyEntry>{};
+  }
+
+  int fd = ::open(wal_path.c_str(), O_RDONLY, 0644);
+  if (fd == -1) {
+    return std::unexpected(StorageError::file_open(wal_path));
+  }
+  struct stat st{};
+  if (::fstat(fd, &st) == -1) {
+    ::close(fd);
+    return std::unexpected(StorageError::file_read(wal_path));
+  }
+  auto size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    ::close(fd);
+    return std::vector<KeyEntry>{};
+  }
+  void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return std::unexpected(StorageError::file_read(wal_path));
+  }
+  ::madvise(addr, size, MADV_SEQUENTIAL);
+  std::span<const std::byte> log{static_cast<const std::byte *>(addr), size};
+
+  // Pass 1: walk the length fields to find the records. A record running
+  // past the end of the file is a write the crash cut short, unless whole
+  // records follow it: then its length is what's wrong.
+  std::vector<std::span<const std::byte>> records;
+  size_t end = 0;
+  while (end < log.size()) {
+    auto record_size = wal_record_size(log.subspan(end));
+    if (record_size == 0) {
+      if (holds_record(log.subspan(end + 1))) {
+        ::munmap(addr, size);
+        return std::unexpected(StorageError{
+            .kind = StorageError::Kind::Corruption,
+            .message = "Corrupted WAL entry, length runs past valid records",
+            .path = wal_path});
+      }
+      break;
+    }
+    records.push_back(log.subspan(end, record_size));
+    end += record_size;
+  }
+
+  // Pass 2: verify checksums and decode, in parallel chunks for big logs.
+  std::vector<std::optional<KeyEntry>> decoded(records.size());
+  auto decode_range = [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      decoded[i] = decode_wal_record(records[i]);
+    }
+  };
+  size_t threads = std::clamp<size_t>(
+      size / lsm_constants::kWalReplayChunkBytes, 1,
+      std::min<size_t>(lsm_constants::kWalReplayThreads,
+                       std::max(std::thread::hardware_concurrency(), 1U)));
+  size_t per_thread = (records.size() + threads - 1) / threads;
+  {
+    std::vector<std::jthread> pool;
+    for (size_t t = 1; t < threads; ++t) {
+      pool.emplace_back(decode_range, std::min(t * per_thread, records.size()),
+                        std::min((t + 1) * per_thread, records.size()));
+    }
+    decode_range(0, std::min(per_thread, records.size()));
+  }
+
+  // A bad checksum on the last record is a torn write too: its length made
+  // it to disk but not all of its bytes. Anywhere else, or if whole records
+  // hide inside it, it's corruption.
+  auto bad = std::ranges::find_if(
+      decoded, [](const auto &record) { return !record.has_value(); });
+  if (bad != decoded.end() &&
+      (std::next(bad) != decoded.end() ||
+       holds_record(records.back().subspan(1)))) {
+    ::munmap(addr, size);
+    return std::unexpected(
+        StorageError{.kind = StorageError::Kind::Corruption,
+                     .message = "Corrupted WAL entry, checksum mismatch",
+                     .path = wal_path});
+  }
+  if (bad != decoded.end()) {
+    decoded.pop_back();
+    end = static_cast<size_t>(records.back().data() - log.data());
+  }
+  ::munmap(addr, size);
+
+  // Cut the torn tail off, so records appended from here on aren't
+  // stranded behind it.
+  if (end < size && ::truncate(wal_path.c_str(), static_cast<off_t>(end))) {
+    return std::unexpected(StorageError::file_write(wal_path));
+  }
+  std::vector<KeyEntry> entries;
+  entries.reserve(decoded.size());
+  for (auto &record : decoded) {
+    entries.push_back(std::move(*record));
+  }
+  return entries;
+}
+
 } // namespace lsm_storage_engine
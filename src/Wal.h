@@ -1,8 +1,11 @@
 #pragma once
+#include "Entry.h"
 #include "StorageError.h"
 #include <expected>
 #include <filesystem>
+#include <string>
 #include <string_view>
+#include <vector>
 namespace lsm_storage_engine {
 
 /**
@@ -31,7 +34,18 @@ public:
    * @return void on success, StorageError on failure.
    */
   std::expected<void, StorageError> write(std::string_view key,
-                                          std::string_view value) const;
+                                          std::string_view value) const {
+    return write(key, Entry::put(std::string{value}));
+  }
+
+  /**
+   * @brief Append a record (value or tombstone) to the log.
+   * Format: [keylen:4][valuelen:4][type:1][seq:8][key][value][checksum:4]
+   * @return void on success, StorageError on failure. A failed write cuts
+   *         off whatever part of the record made it into the file.
+   */
+  std::expected<void, StorageError> write(std::string_view key,
+                                          const Entry &entry) const;
 
   /**
    * @brief Get the path to the WAL.
@@ -45,12 +59,39 @@ public:
    */
   std::expected<void, StorageError> clear() const;
 
+  /**
+   * @brief Size of the log in bytes.
+   * @return The size on success, StorageError on failure.
+   */
+  std::expected<size_t, StorageError> size() const;
+
+  /**
+   * @brief Cut the log back to `size` bytes, dropping the records appended
+   * since it was that long.
+   * @return void on success, StorageError on failure.
+   */
+  std::expected<void, StorageError> truncate(size_t size) const;
+
   /**
    * @brief Sync buffered writes to disk.
    * @return void on success, StorageError on failure.
    */
   std::expected<void, StorageError> sync() const;
 
+  /**
+   * @brief Read back every record of a log, in the order written.
+   *
+   * Maps the log and verifies and decodes its records in parallel chunks. A
+   * torn last record (cut short, or failing its checksum) is where the log
+   * ends: it is dropped and the file truncated before it. A record is only
+   * torn if no valid record follows it.
+   * @return The records, empty if there is no log, or StorageError if a
+   *         record before the last fails its checksum or has a length that
+   *         runs over valid records.
+   */
+  static std::expected<std::vector<KeyEntry>, StorageError>
+  read(const std::filesystem::path &path);
+
 private:
   std::filesystem::path path_;
   int fd_{-1};
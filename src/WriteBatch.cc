@@ -0,0 +1,83 @@
+#include "WriteBatch.h"
+#include <cstring>
+#include <utility>
+namespace lsm_storage_engine {
+
+void WriteBatch::put(uint32_t family, std::string key, std::string value) {
+  writes_.push_back({family, std::move(key), Entry::put(std::move(value))});
+}
+
+void WriteBatch::rm(uint32_t family, std::string key) {
+  writes_.push_back({family, std::move(key), Entry::tombstone()});
+}
+
+void WriteBatch::merge(uint32_t family, std::string key,
+                       std::string operand) {
+  writes_.push_back({family, std::move(key), Entry::merge(std::move(operand))});
+}
+
+void WriteBatch::delete_range(uint32_t family, std::string begin,
+                              std::string end) {
+  if (begin >= end) {
+    return;
+  }
+  writes_.push_back({family, std::move(begin),
+                     Entry{EntryType::RangeDelete, std::move(end), {}}});
+}
+
+std::string WriteBatch::encode() const {
+  std::string out;
+  auto append = [&out](const void *data, size_t len) {
+    out.append(static_cast<const char *>(data), len);
+  };
+  auto count = static_cast<uint32_t>(writes_.size());
+  append(&count, sizeof(count));
+  for (const auto &write : writes_) {
+    auto keylen = static_cast<uint32_t>(write.key.size());
+    auto valuelen = static_cast<uint32_t>(write.entry.value.size());
+    append(&write.family, sizeof(write.family));
+    append(&write.entry.type, sizeof(write.entry.type));
+    append(&keylen, sizeof(keylen));
+    append(&valuelen, sizeof(valuelen));
+    out += write.key;
+    out += write.entry.value;
+  }
+  return out;
+}
+
+std::optional<WriteBatch> WriteBatch::decode(std::string_view data) {
+  auto read = [&data](void *field, size_t len) {
+    if (data.size() < len) {
+      return false;
+    }
+    ::memcpy(field, data.data(), len);
+    data.remove_prefix(len);
+    return true;
+  };
+  uint32_t count{0};
+  if (!read(&count, sizeof(count))) {
+    return std::nullopt;
+  }
+  WriteBatch batch;
+  for (uint32_t i = 0; i < count; ++i) {
+    Write write{};
+    uint32_t keylen{0};
+    uint32_t valuelen{0};
+    if (!read(&write.family, sizeof(write.family)) ||
+        !read(&write.entry.type, sizeof(write.entry.type)) ||
+        write.entry.type > EntryType::Merge ||
+        !read(&keylen, sizeof(keylen)) || !read(&valuelen, sizeof(valuelen)) ||
+        data.size() < size_t{keylen} + valuelen) {
+      return std::nullopt;
+    }
+    write.key = data.substr(0, keylen);
+    write.entry.value = data.substr(keylen, valuelen);
+    data.remove_prefix(size_t{keylen} + valuelen);
+    batch.writes_.push_back(std::move(write));
+  }
+  if (!data.empty()) {
+    return std::nullopt;
+  }
+  return batch;
+}
+} // namespace lsm_storage_engine
@@ -0,0 +1,53 @@
+#pragma once
+#include "Entry.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Writes to the column families of a ColumnFamilyDb, applied
+ * atomically by ColumnFamilyDb::write().
+ *
+ * Families are named by their ids (ColumnFamilyDb::id()). Writes apply in
+ * the order they were added.
+ */
+class WriteBatch {
+public:
+  struct Write {
+    uint32_t family;
+    std::string key;
+    Entry entry;
+  };
+
+  void put(uint32_t family, std::string key, std::string value);
+  void rm(uint32_t family, std::string key);
+  void merge(uint32_t family, std::string key, std::string operand);
+  /// Delete [begin, end) in `family`. An empty range is a no-op.
+  void delete_range(uint32_t family, std::string begin, std::string end);
+
+  const std::vector<Write> &writes() const { return writes_; }
+  size_t size() const { return writes_.size(); }
+  bool empty() const { return writes_.empty(); }
+  void clear() { writes_.clear(); }
+
+  /**
+   * @brief The batch as one WAL record value.
+   * Format: [count:4] then per write
+   * [family:4][type:1][keylen:4][valuelen:4][key][value]
+   */
+  std::string encode() const;
+
+  /**
+   * @brief Parse encode()'s output.
+   * @return The batch, or std::nullopt if `data` is malformed.
+   */
+  static std::optional<WriteBatch> decode(std::string_view data);
+
+private:
+  std::vector<Write> writes_;
+};
+} // namespace lsm_storage_engine
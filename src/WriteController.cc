@@ -0,0 +1,104 @@
+#include "WriteController.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+namespace lsm_storage_engine {
+
+/**
+ * How far `value` is between `soft` and `hard`, clamped to [0, 1].
+ */
+static double overshoot(size_t value, size_t soft, size_t hard) {
+  if (value < soft) {
+    return 0.0;
+  }
+  if (hard <= soft) {
+    return 1.0;
+  }
+  return std::min(1.0, static_cast<double>(value - soft + 1) /
+                           static_cast<double>(hard - soft));
+}
+
+void WriteController::refresh_state() {
+  bool stop = debt_.l0_files >= limits_.l0_stop ||
+              debt_.pending_compaction_bytes >= limits_.pending_bytes_stop ||
+              debt_.immutable_memtables >= limits_.immutable_memtables_stop;
+  double worst = std::max(
+      overshoot(debt_.l0_files, limits_.l0_slowdown, limits_.l0_stop),
+      overshoot(debt_.pending_compaction_bytes, limits_.pending_bytes_slowdown,
+                limits_.pending_bytes_stop));
+
+  auto delay = static_cast<long long>(
+      worst * static_cast<double>(limits_.max_delay.count()));
+  delay_us_.store(delay, std::memory_order_relaxed);
+  state_.store(stop        ? State::Stopped
+               : delay > 0 ? State::Delayed
+                           : State::Normal,
+               std::memory_order_release);
+}
+
+void WriteController::update(Debt debt) {
+  {
+    std::lock_guard lock(mu_);
+    debt_ = debt;
+    refresh_state();
+  }
+  cv_.notify_all();
+}
+
+void WriteController::set_limits(Limits limits) {
+  {
+    std::lock_guard lock(mu_);
+    limits_ = limits;
+    refresh_state();
+  }
+  cv_.notify_all();
+}
+
+void WriteController::delay_write() {
+  if (state() != State::Delayed) {
+    return;
+  }
+  auto delay = delay_us_.load(std::memory_order_relaxed);
+  if (delay <= 0) {
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::microseconds(delay));
+  delayed_writes_.fetch_add(1, std::memory_order_relaxed);
+  delay_time_us_.fetch_add(delay, std::memory_order_relaxed);
+}
+
+void WriteController::wait_while_stopped(
+    const std::function<void()> &make_progress) {
+  if (state() != State::Stopped) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  while (state() == State::Stopped) {
+    make_progress();
+    std::unique_lock lock(mu_);
+    cv_.wait_for(lock, kStopPollInterval,
+                 [&] { return state() != State::Stopped; });
+  }
+  auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  stopped_writes_.fetch_add(1, std::memory_order_relaxed);
+  stop_time_us_.fetch_add(waited, std::memory_order_relaxed);
+}
+
+WriteController::Stats WriteController::stats() const {
+  Debt debt;
+  {
+    std::lock_guard lock(mu_);
+    debt = debt_;
+  }
+  return Stats{
+      .delayed_writes = delayed_writes_.load(std::memory_order_relaxed),
+      .stopped_writes = stopped_writes_.load(std::memory_order_relaxed),
+      .delay_time_us = delay_time_us_.load(std::memory_order_relaxed),
+      .stop_time_us = stop_time_us_.load(std::memory_order_relaxed),
+      .debt = debt,
+  };
+}
+} // namespace lsm_storage_engine
@@ -0,0 +1,135 @@
+#pragma once
+#include "Constants.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Pushes back on writers when flushes and compactions fall behind.
+ *
+ * The LsmTree reports its compaction debt (L0 table count, bytes waiting to
+ * be compacted, immutable memtables) every time it installs a new version.
+ * Past a soft limit writers are delayed, proportionally to how far past the
+ * limit the worst metric is; past a hard limit they are stopped until the
+ * debt is paid down. This keeps the table count, and therefore read latency,
+ * bounded.
+ *
+ * Thread-safe.
+ */
+class WriteController {
+public:
+  struct Limits {
+    size_t l0_slowdown;
+    size_t l0_stop;
+    size_t pending_bytes_slowdown;
+    size_t pending_bytes_stop;
+    size_t immutable_memtables_stop;
+    /// Delay applied to a write right below the hard limit.
+    std::chrono::microseconds max_delay;
+  };
+
+  struct Debt {
+    size_t l0_files;
+    size_t pending_compaction_bytes;
+    size_t immutable_memtables;
+  };
+
+  enum class State { Normal, Delayed, Stopped };
+
+  /**
+   * @brief The default limits, with level 0's scaled to a tree compacting it
+   * at `compaction_trigger` tables.
+   */
+  static Limits default_limits(
+      size_t compaction_trigger = lsm_constants::kCompactionTrigger) {
+    // A trigger of 0 compacts at one table, as LsmTree treats it.
+    compaction_trigger = std::max<size_t>(compaction_trigger, 1);
+    return Limits{
+        .l0_slowdown = compaction_trigger * lsm_constants::kL0SlowdownFactor,
+        .l0_stop = compaction_trigger * lsm_constants::kL0StopFactor,
+        .pending_bytes_slowdown =
+            lsm_constants::kPendingCompactionBytesSlowdown,
+        .pending_bytes_stop = lsm_constants::kPendingCompactionBytesStop,
+        .immutable_memtables_stop = lsm_constants::kMaxImmutableMemTables,
+        .max_delay = std::chrono::microseconds(lsm_constants::kMaxWriteDelayUs),
+    };
+  }
+
+  WriteController() : WriteController(default_limits()) {}
+  explicit WriteController(Limits limits) : limits_(limits) {}
+
+  /// Shared between threads, so no copies or moves.
+  WriteController(const WriteController &) = delete;
+  WriteController &operator=(const WriteController &) = delete;
+
+  /**
+   * @brief Record the latest compaction debt and wake stopped writers if it
+   * dropped below the hard limit.
+   */
+  void update(Debt debt);
+
+  /**
+   * @brief Replace the limits, and re-check the last reported debt against
+   * them.
+   */
+  void set_limits(Limits limits);
+
+  /**
+   * @brief Current state derived from the last reported debt.
+   */
+  State state() const { return state_.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Sleep for the current slowdown delay, if any.
+   *
+   * Writers call this before taking the write lock.
+   */
+  void delay_write();
+
+  /**
+   * @brief Block while writes are stopped.
+   * @param make_progress Called between waits, so a stopped writer can pay
+   *        down the debt itself (e.g. run compaction) when nobody else is.
+   */
+  void wait_while_stopped(const std::function<void()> &make_progress);
+
+  struct Stats {
+    unsigned long delayed_writes;
+    unsigned long stopped_writes;
+    long long delay_time_us;
+    long long stop_time_us;
+    Debt debt;
+  };
+
+  /**
+   * @brief Get stall counters and durations, plus the last reported debt.
+   */
+  Stats stats() const;
+
+private:
+  /// Re-check interval while stopped, in case a wakeup was missed.
+  static constexpr auto kStopPollInterval = std::chrono::milliseconds(10);
+
+  /// Recompute state_ and delay_us_ from debt_. Requires mu_.
+  void refresh_state();
+
+  Limits limits_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  Debt debt_{};
+  std::atomic<State> state_{State::Normal};
+  /// Current per-write delay, recomputed on every update().
+  std::atomic<long long> delay_us_{0};
+
+  std::atomic<unsigned long> delayed_writes_{0};
+  std::atomic<unsigned long> stopped_writes_{0};
+  std::atomic<long long> delay_time_us_{0};
+  std::atomic<long long> stop_time_us_{0};
+};
+} // namespace lsm_storage_engine
@@ -16,6 +16,7 @@ int main() {
                  s.avg_put_time_us, s.max_put_time_us_);
   }
   LsmTree lsm;
+  std::println("Startup: {}us", lsm.stats().startup_time_us);
   for (int i = 0; i < 100000; i++) {
     auto key = "key" + std::to_string(i);
     auto val = lsm.get(key);
@@ -0,0 +1,72 @@
+#pragma once
+#include "StorageError.h"
+#include <cerrno>
+#include <cstddef>
+#include <expected>
+#include <fcntl.h>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <unistd.h>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Write all of `data` to `fd` and fsync it.
+ * @param path The file `fd` is open on, for the error.
+ * @return void on success, StorageError on failure.
+ */
+inline std::expected<void, StorageError>
+write_synced(int fd, std::span<const std::byte> data,
+             const std::filesystem::path &path) {
+  while (!data.empty()) {
+    auto n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return std::unexpected(StorageError::file_write(path));
+    }
+    data = data.subspan(static_cast<size_t>(n));
+  }
+  if (::fsync(fd) == -1) {
+    return std::unexpected(StorageError::file_write(path));
+  }
+  return {};
+}
+
+/**
+ * @brief Write `contents` to a new file at `path`, replacing any there, and
+ * fsync it.
+ * @return void on success, StorageError on failure.
+ */
+inline std::expected<void, StorageError>
+write_file_synced(const std::filesystem::path &path,
+                  std::string_view contents) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return std::unexpected(StorageError::file_open(path));
+  }
+  auto res = write_synced(fd, std::as_bytes(std::span{contents}), path);
+  ::close(fd);
+  return res;
+}
+
+/**
+ * @brief fsync() the file or directory at `path`. Syncing a directory makes
+ * the names created, renamed or removed in it durable.
+ * @return void on success, StorageError on failure.
+ */
+inline std::expected<void, StorageError>
+sync_path(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return std::unexpected(StorageError::file_open(path));
+  }
+  int res = ::fsync(fd);
+  ::close(fd);
+  if (res == -1) {
+    return std::unexpected(StorageError::file_write(path));
+  }
+  return {};
+}
+} // namespace lsm_storage_engine
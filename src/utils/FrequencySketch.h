@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Approximate, aging access counts for TinyLFU cache admission.
+ *
+ * A count-min sketch of 4 rows of saturating counters (max 15). Once it has
+ * recorded 10 accesses per counter, every counter is halved, so keys that
+ * used to be hot fade out and recent popularity wins.
+ *
+ * Not thread-safe.
+ */
+class FrequencySketch {
+public:
+  /// @param counters Counters per row; rounded up to a power of two.
+  explicit FrequencySketch(size_t counters)
+      : mask_(std::bit_ceil(std::max<size_t>(counters, 64)) - 1),
+        table_(kRows * (mask_ + 1), 0), sample_size_(10 * (mask_ + 1)) {}
+
+  /// Record one access of the key with this hash.
+  void increment(uint64_t hash) {
+    for (size_t row = 0; row < kRows; ++row) {
+      auto &counter = table_[index(hash, row)];
+      if (counter < kMaxCount) {
+        ++counter;
+      }
+    }
+    if (++additions_ == sample_size_) {
+      age();
+    }
+  }
+
+  /// Estimated recent accesses of the key with this hash; never too low.
+  uint8_t estimate(uint64_t hash) const {
+    uint8_t count = kMaxCount;
+    for (size_t row = 0; row < kRows; ++row) {
+      count = std::min(count, table_[index(hash, row)]);
+    }
+    return count;
+  }
+
+private:
+  static constexpr size_t kRows = 4;
+  static constexpr uint8_t kMaxCount = 15;
+
+  size_t mask_;
+  std::vector<uint8_t> table_;
+  size_t sample_size_;
+  size_t additions_{0};
+
+  /// Double hashing, like the bloom filter: one independent slot per row.
+  size_t index(uint64_t hash, size_t row) const {
+    auto h1 = static_cast<size_t>(hash);
+    auto h2 = static_cast<size_t>(hash >> 32) | 1;
+    return row * (mask_ + 1) + ((h1 + row * h2) & mask_);
+  }
+
+  void age() {
+    for (auto &counter : table_) {
+      counter = static_cast<uint8_t>(counter >> 1);
+    }
+    additions_ /= 2;
+  }
+};
+} // namespace lsm_storage_engine
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <vector>
+namespace lsm_storage_engine {
+
+/**
+ * @brief Splits a sorted run of (key, Entry) pairs into output files of
+ * about `target_size` bytes of key and value data each.
+ *
+ * A file is cut once it reaches `target_size`. Past half the target, it is
+ * also cut where the keys cross one of `boundaries` (the sorted max keys of
+ * the tables in the next level), so output files line up with next-level
+ * files and later compactions of a key range touch as few files as possible.
+ * A target of 0 disables cutting. The versions of a key are never split
+ * across files.
+ * @return Iterators where each output file after the first starts.
+ */
+template <typename It>
+std::vector<It> partition_entries(It first, It last, size_t target_size,
+                                  const std::vector<std::string> &boundaries) {
+  std::vector<It> cuts;
+  if (target_size == 0) {
+    return cuts;
+  }
+  size_t bytes{0};
+  auto boundary = boundaries.begin();
+  for (auto it = first; it != last; ++it) {
+    const auto &[key, entry] = *it;
+    bool crossed = false;
+    while (boundary != boundaries.end() && *boundary < key) {
+      ++boundary;
+      crossed = true;
+    }
+    if (bytes > 0 && key != std::prev(it)->first &&
+        (bytes >= target_size || (crossed && bytes >= target_size / 2))) {
+      cuts.push_back(it);
+      bytes = 0;
+    }
+    bytes += key.size() + entry.value.size();
+  }
+  return cuts;
+}
+} // namespace lsm_storage_engine
@@ -0,0 +1,46 @@
+#include "BlockCache.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+namespace {
+BlockHandle block_of(size_t size) {
+  auto bytes = std::make_shared<std::vector<std::byte>>(size);
+  return BlockHandle{bytes, *bytes};
+}
+} // namespace
+
+TEST(BlockCacheTest, EvictsLeastRecentlyUsedBlocks) {
+  // Room for three 1000-byte blocks, in a single shard.
+  BlockCache cache(3 * 1100, 1);
+  cache.insert(1, 0, block_of(1000));
+  cache.insert(1, 1000, block_of(1000));
+  cache.insert(2, 0, block_of(1000));
+  // Touch the first block so the second is the oldest.
+  EXPECT_TRUE(cache.lookup(1, 0, 1000).has_value());
+  cache.insert(2, 1000, block_of(1000));
+
+  EXPECT_TRUE(cache.lookup(1, 0, 1000).has_value());
+  EXPECT_FALSE(cache.lookup(1, 1000, 1000).has_value());
+  EXPECT_TRUE(cache.lookup(2, 0, 1000).has_value());
+  EXPECT_TRUE(cache.lookup(2, 1000, 1000).has_value());
+  EXPECT_LE(cache.stats().usage, 3UZ * 1100);
+}
+
+TEST(BlockCacheTest, ServesPrefixesOfLongerBlocks) {
+  BlockCache cache(1UZ << 16, 1);
+  cache.insert(7, 4096, block_of(500));
+
+  auto prefix = cache.lookup(7, 4096, 100);
+  ASSERT_TRUE(prefix.has_value());
+  EXPECT_EQ(prefix->data.size(), 100);
+  // Too short for this read: a miss, so the caller reads the longer range.
+  EXPECT_FALSE(cache.lookup(7, 4096, 600).has_value());
+  EXPECT_FALSE(cache.lookup(8, 4096, 100).has_value());
+
+  auto s = cache.stats();
+  EXPECT_EQ(s.hits, 1);
+  EXPECT_EQ(s.misses, 2);
+}
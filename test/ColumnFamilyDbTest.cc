@@ -0,0 +1,136 @@
+#include "ColumnFamilyDb.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+class ColumnFamilyDbTest : public ::testing::Test {
+protected:
+  std::filesystem::path dir_ = "column_family_test";
+  std::filesystem::path crashed_ = "column_family_test_crashed";
+
+  void SetUp() override {
+    std::filesystem::remove_all(dir_);
+    std::filesystem::remove_all(crashed_);
+  }
+  void TearDown() override {
+    std::filesystem::remove_all(dir_);
+    std::filesystem::remove_all(crashed_);
+  }
+
+  DbOptions options(const std::filesystem::path &dir) {
+    Options small;
+    small.memtable_bytes = 1024;
+    DbOptions options;
+    options.dir = dir;
+    options.families = {{"users", Options{}}, {"index", small}};
+    return options;
+  }
+
+  static int tables(const std::filesystem::path &dir) {
+    int count = 0;
+    for (const auto &file : std::filesystem::directory_iterator(dir)) {
+      count += file.path().extension() == ".sst";
+    }
+    return count;
+  }
+
+  /// What a crash would leave on disk: the files as they are right now.
+  void crash_copy() {
+    std::filesystem::copy(dir_, crashed_,
+                          std::filesystem::copy_options::recursive);
+  }
+};
+
+TEST_F(ColumnFamilyDbTest, BatchesReplayWholeOrNotAtAll) {
+  ColumnFamilyDb db{options(dir_)};
+  auto users = db.id("users");
+  auto index = db.id("index");
+  WriteBatch first;
+  first.put(users, "alice", "1");
+  first.put(index, "name:alice", "alice");
+  db.write(first);
+  WriteBatch second;
+  second.put(users, "bob", "2");
+  second.put(index, "name:bob", "bob");
+  db.write(second);
+  EXPECT_THROW(db.family(users).put("carol", "3"), std::runtime_error);
+  crash_copy();
+
+  // Tear the second batch's record.
+  auto wal = crashed_ / "db.wal";
+  std::filesystem::resize_file(wal, std::filesystem::file_size(wal) - 3);
+  ColumnFamilyDb recovered{options(crashed_)};
+  EXPECT_EQ(recovered.family(users).get("alice"), "1");
+  EXPECT_EQ(recovered.family(index).get("name:alice"), "alice");
+  EXPECT_FALSE(recovered.family(users).get("bob").has_value());
+  EXPECT_FALSE(recovered.family(index).get("name:bob").has_value());
+  // Sequence numbers carry on past the replayed batch.
+  recovered.put(users, "alice", "4");
+  EXPECT_EQ(recovered.family(users).get("alice"), "4");
+}
+
+TEST_F(ColumnFamilyDbTest, FamiliesFlushOnTheirOwn) {
+  ColumnFamilyDb db{options(dir_)};
+  auto users = db.id("users");
+  auto index = db.id("index");
+  for (int i = 0; i < 100; ++i) {
+    auto key = "key" + std::to_string(i);
+    WriteBatch batch;
+    batch.put(users, key, "u");
+    batch.put(index, key, std::string(50, 'i'));
+    db.write(batch);
+  }
+  // Only the family with the small memtable has flushed, so the WAL still
+  // holds the other's writes.
+  EXPECT_EQ(tables(dir_ / "users"), 0);
+  EXPECT_GT(tables(dir_ / "index"), 0);
+  EXPECT_GT(std::filesystem::file_size(dir_ / "db.wal"), 0);
+  crash_copy();
+  {
+    // Replay skips what "index" flushed and restores the rest.
+    ColumnFamilyDb recovered{options(crashed_)};
+    for (int i = 0; i < 100; ++i) {
+      auto key = "key" + std::to_string(i);
+      ASSERT_EQ(recovered.family(users).get(key), "u");
+      ASSERT_EQ(recovered.family(index).get(key), std::string(50, 'i'));
+    }
+  }
+
+  db.flush(index);
+  EXPECT_GT(std::filesystem::file_size(dir_ / "db.wal"), 0);
+  db.flush(users);
+  EXPECT_EQ(std::filesystem::file_size(dir_ / "db.wal"), 0);
+  EXPECT_EQ(db.family(users).get("key7"), "u");
+}
+
+TEST_F(ColumnFamilyDbTest, ConcurrentWritersShareSyncs) {
+  auto synced = options(dir_);
+  synced.sync_mode = SyncMode::EveryWrite;
+  {
+    ColumnFamilyDb db{synced};
+    auto users = db.id("users");
+    std::vector<std::jthread> writers;
+    for (int t = 0; t < 8; ++t) {
+      writers.emplace_back([&, t] {
+        for (int i = 0; i < 50; ++i) {
+          db.put(users, std::to_string(t) + "-" + std::to_string(i), "v");
+        }
+      });
+    }
+    writers.clear();
+    auto stats = db.stats();
+    EXPECT_EQ(stats.batches, 400);
+    EXPECT_GT(stats.wal_syncs, 0);
+    EXPECT_LE(stats.wal_syncs, stats.batches);
+  }
+  // Families are found again by name, in the order first created.
+  auto reordered = synced;
+  std::swap(reordered.families[0], reordered.families[1]);
+  ColumnFamilyDb db{reordered};
+  EXPECT_EQ(db.id("users"), 0);
+  EXPECT_EQ(db.family(db.id("users")).get("7-49"), "v");
+}
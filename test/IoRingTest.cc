@@ -0,0 +1,59 @@
+#include "IoRing.h"
+#include "Task.h"
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+namespace {
+Task<std::string> read_string(IoRing &ring, int fd, size_t offset,
+                              size_t length) {
+  auto bytes = co_await ring.read(fd, offset, length);
+  if (!bytes) {
+    co_return "error";
+  }
+  co_return std::string{reinterpret_cast<const char *>(bytes->data()),
+                        bytes->size()};
+}
+
+/// Awaits another task, like a lookup awaiting its block reads.
+Task<std::string> read_twice(IoRing &ring, int fd, size_t offset) {
+  auto first = co_await read_string(ring, fd, offset, 2);
+  auto second = co_await read_string(ring, fd, offset + 2, 2);
+  co_return first + second;
+}
+} // namespace
+
+TEST(IoRingTest, ManyReadsInFlightOnOneThread) {
+  auto path = std::filesystem::temp_directory_path() / "io_ring_test.dat";
+  std::string data;
+  for (int i = 0; i < 100; ++i) {
+    data += std::to_string(1000 + i);
+  }
+  std::ofstream{path} << data;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+
+  {
+    // More reads than submission queue entries.
+    IoRing ring(8);
+    std::vector<Task<std::string>> tasks;
+    for (size_t i = 0; i < 100; ++i) {
+      tasks.push_back(read_twice(ring, fd, 4 * i));
+      tasks.back().start();
+    }
+    ring.run();
+    EXPECT_EQ(ring.in_flight(), 0);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      ASSERT_TRUE(tasks[i].done());
+      EXPECT_EQ(tasks[i].result(), std::to_string(1000 + i));
+    }
+  }
+  ::close(fd);
+  std::filesystem::remove(path);
+}
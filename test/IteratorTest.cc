@@ -0,0 +1,159 @@
+#include "Constants.h"
+#include "Iterator.h"
+#include "LsmTree.h"
+#include "MemTable.h"
+#include "SSTableIterator.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+class IteratorTest : public ::testing::Test {
+protected:
+  void SetUp() override { cleanup_test_files(); }
+  void TearDown() override { cleanup_test_files(); }
+
+  /// Collect (key, value) pairs going forward from the current position.
+  static std::vector<std::pair<std::string, std::string>>
+  collect(Iterator &it) {
+    std::vector<std::pair<std::string, std::string>> out;
+    for (; it.valid(); it.next()) {
+      out.emplace_back(it.key(), it.value());
+    }
+    return out;
+  }
+
+  static std::string key(int i) {
+    auto s = std::to_string(i);
+    return "key" + std::string(4 - s.size(), '0') + s;
+  }
+
+private:
+  void cleanup_test_files() {
+    std::filesystem::remove("lsm.wal");
+    for (const auto &entry :
+         std::filesystem::directory_iterator(std::filesystem::current_path())) {
+      if (entry.path().extension() == ".sst" ||
+          entry.path().filename().string().starts_with("MANIFEST-")) {
+        std::filesystem::remove(entry.path());
+      }
+    }
+    std::filesystem::remove("lsm.meta");
+    std::filesystem::remove("CURRENT");
+  }
+};
+
+TEST_F(IteratorTest, SSTableIteratorSeeksAndStepsAcrossBlocks) {
+  MemTable table;
+  for (int i = 0; i < 200; i += 2) {
+    table.put(key(i), std::to_string(i));
+  }
+  auto sst = SSTable::create("iterator_test.sst");
+  ASSERT_TRUE(sst.has_value());
+  ASSERT_TRUE(table.flush_to_sst(*sst).has_value());
+  auto opened = SSTable::open("iterator_test.sst");
+  ASSERT_TRUE(opened.has_value());
+
+  SSTableIterator it(*opened, std::nullopt, std::nullopt, 4096);
+  // Odd keys don't exist: land on the next even one.
+  it.seek(key(129));
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(130));
+  // Entry 64 starts the second index block.
+  it.seek(key(128));
+  it.prev();
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(126));
+  it.next();
+  it.next();
+  EXPECT_EQ(it.key(), key(130));
+
+  it.seek_to_last();
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(198));
+  it.next();
+  EXPECT_FALSE(it.valid());
+  EXPECT_FALSE(it.error().has_value());
+}
+
+TEST_F(IteratorTest, ScanMergesSourcesNewestWins) {
+  LsmTree lsm;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  for (int i = 0; i < 10; ++i) {
+    lsm.put(key(i), "old");
+  }
+  lsm.put("zzz_trigger1", large_value); // Flush
+  for (int i = 0; i < 10; i += 2) {
+    lsm.put(key(i), "new");
+  }
+  lsm.rm(key(3));
+  lsm.put("zzz_trigger2", large_value); // Flush
+  lsm.put(key(4), "newest");
+  lsm.rm(key(5));
+
+  auto it = lsm.new_iterator({.lower_bound = key(0),
+                              .upper_bound = "zzz",
+                              .readahead_size = 0});
+  it.seek_to_first();
+  auto rows = collect(it);
+  std::vector<std::pair<std::string, std::string>> expected = {
+      {key(0), "new"}, {key(1), "old"},    {key(2), "new"},
+      {key(4), "newest"}, {key(6), "new"}, {key(7), "old"},
+      {key(8), "new"}, {key(9), "old"},
+  };
+  EXPECT_EQ(rows, expected);
+}
+
+TEST_F(IteratorTest, BoundsAndDirectionChanges) {
+  LsmTree lsm;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  for (int i = 0; i < 100; ++i) {
+    lsm.put(key(i), std::to_string(i));
+  }
+  lsm.put("zzz_trigger", large_value); // Flush
+  lsm.delete_range(key(40), key(60));
+
+  auto it = lsm.new_iterator({.lower_bound = key(30),
+                              .upper_bound = key(70),
+                              .readahead_size = 1 << 16});
+  it.seek_to_last();
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(69));
+
+  // Backward into the deleted range skips straight over it.
+  it.seek_for_prev(key(55));
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(39));
+  it.next();
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(60));
+  it.prev();
+  EXPECT_EQ(it.key(), key(39));
+
+  // Seeking below the lower bound clamps to it.
+  it.seek(key(0));
+  EXPECT_EQ(it.key(), key(30));
+  it.prev();
+  EXPECT_FALSE(it.valid());
+
+  it.seek(key(61));
+  EXPECT_EQ(collect(it).size(), 9);
+}
+
+TEST_F(IteratorTest, ScanIsUnaffectedByLaterWrites) {
+  LsmTree lsm;
+  lsm.put("a", "1");
+  lsm.put("b", "2");
+  auto it = lsm.new_iterator();
+  lsm.put("c", "3");
+  lsm.rm("a");
+
+  it.seek_to_first();
+  auto rows = collect(it);
+  ASSERT_EQ(rows.size(), 2);
+  EXPECT_EQ(rows[0].first, "a");
+  EXPECT_EQ(rows[1].first, "b");
+}
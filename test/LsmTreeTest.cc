@@ -1,8 +1,17 @@
 #include "LsmTree.h"
 #include "Constants.h"
+#include "Manifest.h"
+#include "SSTableWriter.h"
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <map>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
 
 using namespace lsm_storage_engine;
 
@@ -23,11 +32,13 @@ private:
     // Remove any SST files created during tests
     for (const auto &entry :
          std::filesystem::directory_iterator(std::filesystem::current_path())) {
-      if (entry.path().extension() == ".sst") {
+      if (entry.path().extension() == ".sst" ||
+          entry.path().filename().string().starts_with("MANIFEST-")) {
         std::filesystem::remove(entry.path());
       }
     }
     std::filesystem::remove("lsm.meta");
+    std::filesystem::remove("CURRENT");
   }
 };
 
@@ -63,21 +74,27 @@ TEST_F(LsmTreeTest, MultipleKeyValuePairs) {
 }
 
 TEST_F(LsmTreeTest, PutWritesToWal) {
-  {
-    LsmTree lsm;
-    lsm.put("key", "value");
-  }
+  // Still open: closing flushes the memtable and empties the WAL.
+  LsmTree lsm;
+  lsm.put("key", "value");
 
-  // WAL uses binary format: [keylen:4][valuelen:4][key][value][checksum:4]
+  // WAL uses binary format:
+  // [keylen:4][valuelen:4][type:1][seq:8][key][value][checksum:4]
   std::ifstream file(wal_path_, std::ios::binary);
   ASSERT_TRUE(file.good());
 
   uint32_t keylen = 0, valuelen = 0;
+  EntryType type{EntryType::Delete};
+  SequenceNumber seq{0};
   file.read(reinterpret_cast<char *>(&keylen), sizeof(keylen));
   file.read(reinterpret_cast<char *>(&valuelen), sizeof(valuelen));
+  file.read(reinterpret_cast<char *>(&type), sizeof(type));
+  file.read(reinterpret_cast<char *>(&seq), sizeof(seq));
 
   EXPECT_EQ(keylen, 3);   // "key"
   EXPECT_EQ(valuelen, 5); // "value"
+  EXPECT_EQ(type, EntryType::Put);
+  EXPECT_EQ(seq, 1);
 
   std::string key(keylen, '\0');
   std::string value(valuelen, '\0');
@@ -88,8 +105,671 @@ TEST_F(LsmTreeTest, PutWritesToWal) {
   EXPECT_EQ(value, "value");
 }
 
+// --- Delete tests ---
+
+TEST_F(LsmTreeTest, RmHidesKey) {
+  LsmTree lsm;
+  lsm.put("key", "value");
+  lsm.put("other", "value");
+  lsm.rm("key");
+
+  EXPECT_FALSE(lsm.get("key").has_value());
+  EXPECT_EQ(*lsm.get("other"), "value");
+
+  // A later put brings the key back.
+  lsm.put("key", "new_value");
+  EXPECT_EQ(*lsm.get("key"), "new_value");
+}
+
+TEST_F(LsmTreeTest, RmShadowsOlderSSTablesAndSurvivesRestart) {
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm;
+    lsm.put("flushed", "value");
+    lsm.put("trigger1", large_value);
+    lsm.rm("flushed");
+    EXPECT_FALSE(lsm.get("flushed").has_value());
+  }
+  {
+    // The tombstone is replayed from the WAL...
+    LsmTree lsm;
+    EXPECT_FALSE(lsm.get("flushed").has_value());
+    lsm.put("trigger2", large_value);
+  }
+  // ...and then read back from its own SSTable.
+  LsmTree lsm;
+  EXPECT_FALSE(lsm.get("flushed").has_value());
+}
+
+TEST_F(LsmTreeTest, CompactionDropsTombstonesWithNothingOlderBelow) {
+  LsmTree lsm;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+
+  lsm.put("deleted", "value");
+  lsm.put("trigger1", large_value);
+  lsm.rm("deleted");
+  lsm.put("trigger2", large_value);
+  lsm.put("kept", "value");
+  lsm.put("trigger3", large_value);
+  lsm.put("trigger4", large_value); // Triggers compaction
+
+  // The first pair holds the value and its tombstone, and nothing older
+  // exists, so both are gone.
+  auto s = lsm.stats();
+  EXPECT_GT(s.compaction_count, 0);
+  EXPECT_EQ(s.tombstones_dropped, 1);
+  EXPECT_FALSE(lsm.get("deleted").has_value());
+  EXPECT_EQ(*lsm.get("kept"), "value");
+}
+
+TEST_F(LsmTreeTest, DeleteRangeHidesOlderKeysOnly) {
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm;
+    lsm.put("tenant1/a", "value");
+    lsm.put("tenant1/b", "value");
+    lsm.put("trigger1", large_value); // Flushes both keys
+    lsm.put("tenant1/c", "value");
+    lsm.put("tenant2/a", "value");
+
+    lsm.delete_range("tenant1/", "tenant10");
+    lsm.put("tenant1/d", "written_after");
+
+    EXPECT_FALSE(lsm.get("tenant1/a").has_value());
+    EXPECT_FALSE(lsm.get("tenant1/c").has_value());
+    EXPECT_EQ(*lsm.get("tenant1/d"), "written_after");
+    EXPECT_EQ(*lsm.get("tenant2/a"), "value");
+  }
+  {
+    // Replayed from the WAL, then flushed to an SSTable's range block.
+    LsmTree lsm;
+    EXPECT_FALSE(lsm.get("tenant1/b").has_value());
+    EXPECT_EQ(*lsm.get("tenant1/d"), "written_after");
+    lsm.put("trigger2", large_value);
+  }
+  LsmTree lsm;
+  EXPECT_FALSE(lsm.get("tenant1/a").has_value());
+  EXPECT_FALSE(lsm.get("tenant1/b").has_value());
+  EXPECT_FALSE(lsm.get("tenant1/c").has_value());
+  EXPECT_EQ(*lsm.get("tenant1/d"), "written_after");
+  EXPECT_EQ(*lsm.get("tenant2/a"), "value");
+}
+
+TEST_F(LsmTreeTest, CompactionSkipsTablesCoveredByRangeDelete) {
+  LsmTree lsm;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+
+  lsm.put("tenant/a", "value");
+  lsm.put("tenant/big", large_value);
+  lsm.delete_range("tenant/", "tenant0");
+  lsm.put("zzz1", large_value);
+  lsm.put("zzz2", large_value);
+  lsm.put("zzz3", large_value); // Triggers compaction
+
+  auto s = lsm.stats();
+  EXPECT_EQ(s.covered_files_skipped, 1);
+  EXPECT_FALSE(lsm.get("tenant/a").has_value());
+  EXPECT_FALSE(lsm.get("tenant/big").has_value());
+  EXPECT_TRUE(lsm.get("zzz1").has_value());
+}
+
+// --- Merge operator tests ---
+
+/// Adds decimal integers, like a counter.
+struct AddOperator : MergeOperator {
+  std::string merge(std::string_view, std::optional<std::string_view> existing,
+                    std::string_view operand) const override {
+    long long sum = std::stoll(std::string{operand});
+    if (existing) {
+      sum += std::stoll(std::string{*existing});
+    }
+    return std::to_string(sum);
+  }
+};
+
+TEST_F(LsmTreeTest, MergeCombinesAcrossFlushRestartAndCompaction) {
+  auto op = std::make_shared<AddOperator>();
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm(op);
+    lsm.merge("counter", "1");
+    lsm.merge("counter", "2");
+    EXPECT_EQ(*lsm.get("counter"), "3");
+    lsm.put("trigger1", large_value);
+
+    lsm.merge("counter", "10");
+    lsm.put("reset", "5");
+    lsm.merge("reset", "1");
+    EXPECT_EQ(*lsm.get("counter"), "13");
+    EXPECT_EQ(*lsm.get("reset"), "6");
+  }
+  {
+    // Operands replayed from the WAL.
+    LsmTree lsm(op);
+    EXPECT_EQ(*lsm.get("counter"), "13");
+    lsm.rm("reset");
+    lsm.merge("reset", "7");
+    EXPECT_EQ(*lsm.get("reset"), "7");
+    lsm.put("trigger2", large_value);
+    lsm.merge("counter", "100");
+    lsm.put("trigger3", large_value);
+    lsm.merge("counter", "1000");
+    lsm.put("trigger4", large_value); // Triggers compaction
+    EXPECT_GT(lsm.stats().compaction_count, 0);
+  }
+  LsmTree lsm(op);
+  EXPECT_EQ(*lsm.get("counter"), "1113");
+  EXPECT_EQ(*lsm.get("reset"), "7");
+}
+
+TEST_F(LsmTreeTest, MergeWithoutOperatorThrows) {
+  LsmTree lsm;
+  EXPECT_THROW(lsm.merge("counter", "1"), std::runtime_error);
+}
+
+/// Joins operands with commas, so their order shows in the value.
+struct AppendOperator : MergeOperator {
+  std::string merge(std::string_view, std::optional<std::string_view> existing,
+                    std::string_view operand) const override {
+    return existing ? std::string{*existing} + "," + std::string{operand}
+                    : std::string{operand};
+  }
+};
+
+TEST_F(LsmTreeTest, RandomWritesMatchAModelAcrossFlushesAndRestarts) {
+  Options options;
+  options.merge_operator = std::make_shared<AppendOperator>();
+  options.memtable_bytes = 512;
+  options.compaction_trigger = 2;
+  std::mt19937 rng{42};
+  auto pick = [&](int n) {
+    return std::uniform_int_distribution<int>{0, n - 1}(rng);
+  };
+  auto key_at = [](int i) {
+    return std::string{"k"} + static_cast<char>('a' + i);
+  };
+  constexpr int kKeys = 12;
+
+  std::map<std::string, std::string> model;
+  auto check = [&](LsmTree &lsm, const ReadOptions &read,
+                   const std::map<std::string, std::string> &expected) {
+    for (int i = 0; i < kKeys; ++i) {
+      auto key = key_at(i);
+      auto found = expected.find(key);
+      ASSERT_EQ(lsm.get(key, read), found == expected.end()
+                                        ? std::nullopt
+                                        : std::optional{found->second})
+          << key;
+    }
+    std::map<std::string, std::string> scanned;
+    auto it = lsm.new_iterator(read);
+    for (it.seek_to_first(); it.valid(); it.next()) {
+      scanned[it.key()] = it.value();
+    }
+    ASSERT_EQ(scanned, expected);
+  };
+
+  std::optional<LsmTree> lsm{std::in_place, options};
+  std::optional<Snapshot> snap;
+  std::map<std::string, std::string> at_snap;
+  for (int step = 0; step < 3000; ++step) {
+    auto key = key_at(pick(kKeys));
+    switch (pick(10)) {
+    case 0:
+    case 1:
+      lsm->put(key, std::to_string(step));
+      model[key] = std::to_string(step);
+      break;
+    case 2:
+      lsm->rm(key);
+      model.erase(key);
+      break;
+    case 3:
+    case 4:
+    case 5: {
+      auto operand = std::to_string(step);
+      lsm->merge(key, operand);
+      auto &value = model[key];
+      value = value.empty() ? operand : value + "," + operand;
+      break;
+    }
+    case 6: {
+      auto end = key_at(pick(kKeys));
+      if (key < end) {
+        lsm->delete_range(key, end);
+        model.erase(model.lower_bound(key), model.lower_bound(end));
+      }
+      break;
+    }
+    case 7:
+      if (snap) {
+        check(*lsm, {.snapshot = *snap}, at_snap);
+        lsm->release_snapshot(*snap);
+        snap.reset();
+      } else {
+        snap = lsm->get_snapshot();
+        at_snap = model;
+      }
+      break;
+    case 8:
+      if (!snap && pick(4) == 0) {
+        lsm.reset();
+        lsm.emplace(options);
+      }
+      break;
+    default:
+      check(*lsm, {}, model);
+      break;
+    }
+    if (HasFatalFailure()) {
+      FAIL() << "at step " << step;
+    }
+  }
+  if (snap) {
+    lsm->release_snapshot(*snap);
+  }
+  lsm.reset();
+  lsm.emplace(options);
+  check(*lsm, {}, model);
+}
+
+TEST_F(LsmTreeTest, MultiGetMatchesGetAcrossSources) {
+  LsmTree lsm(std::make_shared<AddOperator>());
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  for (int i = 0; i < 300; ++i) {
+    lsm.put("key" + std::to_string(i), std::to_string(i));
+  }
+  lsm.put("zzz_trigger1", large_value); // Flush
+  lsm.put("key7", "newer");
+  lsm.rm("key8");
+  lsm.merge("key9", "1");
+  lsm.put("zzz_trigger2", large_value); // Flush
+  lsm.delete_range("key20", "key21");
+  lsm.put("key200", "memtable");
+
+  std::vector<std::string> owned = {"key299", "key7",   "missing", "key8",
+                                    "key9",   "key200", "key205",  "key7",
+                                    "key0",   "key150"};
+  std::vector<std::string_view> keys(owned.begin(), owned.end());
+  auto values = lsm.multi_get(keys);
+  ASSERT_EQ(values.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(values[i], lsm.get(keys[i])) << keys[i];
+  }
+  EXPECT_EQ(values[1], "newer");
+  EXPECT_EQ(values[2], std::nullopt);
+  EXPECT_EQ(values[3], std::nullopt);
+  EXPECT_EQ(values[4], "10");
+  EXPECT_EQ(values[5], "memtable");
+  EXPECT_EQ(values[6], std::nullopt);
+  EXPECT_EQ(values[7], "newer");
+}
+
+// --- Snapshot tests ---
+
+TEST_F(LsmTreeTest, SnapshotReadsSurviveOverwritesFlushAndCompaction) {
+  LsmTree lsm(std::make_shared<AddOperator>());
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  lsm.put("a", "a1");
+  lsm.put("b", "b1");
+  lsm.put("c", "c1");
+  lsm.put("counter", "1");
+  lsm.put("zzz_trigger1", large_value); // Flush
+  auto snap = lsm.get_snapshot();
+
+  lsm.put("a", "a2");
+  lsm.rm("b");
+  lsm.delete_range("c", "ca");
+  lsm.merge("counter", "1");
+  // An older version in the memtable, kept for the second snapshot.
+  auto snap2 = lsm.get_snapshot();
+  lsm.put("a", "a3");
+
+  ReadOptions at_snap{.upper_bound = "d", .snapshot = snap};
+  auto check = [&] {
+    EXPECT_EQ(lsm.get("a", at_snap), "a1");
+    EXPECT_EQ(lsm.get("b", at_snap), "b1");
+    EXPECT_EQ(lsm.get("c", at_snap), "c1");
+    EXPECT_EQ(lsm.get("counter", at_snap), "1");
+    EXPECT_EQ(lsm.get("a", {.snapshot = snap2}), "a2");
+    std::vector<std::string_view> keys = {"c", "a", "counter"};
+    EXPECT_EQ(lsm.multi_get(keys, at_snap),
+              (std::vector<std::optional<std::string>>{"c1", "a1", "1"}));
+
+    std::vector<std::string> scanned;
+    auto it = lsm.new_iterator(at_snap);
+    for (it.seek_to_first(); it.valid(); it.next()) {
+      scanned.push_back(it.key() + "=" + it.value());
+    }
+    EXPECT_EQ(scanned, (std::vector<std::string>{"a=a1", "b=b1", "c=c1",
+                                                 "counter=1"}));
+
+    EXPECT_EQ(lsm.get("a"), "a3");
+    EXPECT_EQ(lsm.get("b"), std::nullopt);
+    EXPECT_EQ(lsm.get("c"), std::nullopt);
+    EXPECT_EQ(lsm.get("counter"), "2");
+  };
+  check();
+
+  // Overlapping flushes, so compaction merges the versions together.
+  lsm.put("zzz_trigger2", large_value);
+  lsm.put("filler", "f");
+  lsm.put("zzz_trigger3", large_value);
+  lsm.put("filler", "f");
+  lsm.put("zzz_trigger4", large_value);
+  ASSERT_GT(lsm.stats().compaction_count, 0);
+  check();
+
+  // Released snapshots no longer hold old versions back.
+  lsm.release_snapshot(snap);
+  lsm.release_snapshot(snap2);
+  for (int i = 5; i < 9; ++i) {
+    lsm.put("filler", "f");
+    lsm.put("zzz_trigger" + std::to_string(i), large_value);
+  }
+  EXPECT_EQ(lsm.get("a"), "a3");
+  EXPECT_EQ(lsm.get("b"), std::nullopt);
+  EXPECT_EQ(lsm.get("counter"), "2");
+}
+
+TEST_F(LsmTreeTest, RowCacheServesHotKeysAndSeesFlushedWrites) {
+  LsmTree lsm;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  lsm.put("hot", "v1");
+  lsm.put("gone", "v1");
+  lsm.put("zzz_trigger1", large_value); // Flush
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(lsm.get("hot"), "v1");
+    EXPECT_EQ(lsm.get("gone"), "v1");
+  }
+  EXPECT_GE(lsm.row_cache().stats().hits, 4);
+
+  lsm.put("hot", "v2");
+  lsm.rm("gone");
+  lsm.put("zzz_trigger2", large_value); // Flush
+  EXPECT_EQ(lsm.get("hot"), "v2");
+  EXPECT_EQ(lsm.get("gone"), std::nullopt);
+
+  lsm.delete_range("h", "i");
+  lsm.put("zzz_trigger3", large_value); // Flush
+  EXPECT_EQ(lsm.get("hot"), std::nullopt);
+}
+
+TEST_F(LsmTreeTest, AsyncGetMatchesGet) {
+  LsmTree lsm(std::make_shared<AddOperator>());
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  for (int i = 0; i < 300; ++i) {
+    lsm.put("key" + std::to_string(i), std::to_string(i));
+  }
+  lsm.put("zzz_trigger1", large_value); // Flush
+  lsm.put("key7", "newer");
+  lsm.rm("key8");
+  lsm.merge("key9", "1");
+  lsm.delete_range("key20", "key21");
+  lsm.put("zzz_trigger2", large_value); // Flush
+  lsm.merge("key9", "1");
+  lsm.put("key200", "memtable");
+
+  IoRing ring;
+  std::vector<std::string> keys;
+  std::vector<Task<std::optional<std::string>>> tasks;
+  for (int i = 0; i < 300; i += 3) {
+    keys.push_back("key" + std::to_string(i));
+  }
+  keys.insert(keys.end(), {"key7", "key8", "key9", "key205", "missing"});
+  for (const auto &key : keys) {
+    tasks.push_back(lsm.async_get(key, ring));
+    tasks.back().start();
+  }
+  ring.run();
+  std::vector<std::optional<std::string>> values;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_TRUE(tasks[i].done());
+    values.push_back(tasks[i].result());
+    EXPECT_EQ(values[i], lsm.get(keys[i])) << keys[i];
+  }
+  EXPECT_EQ(values[keys.size() - 3], "11");
+}
+
 // --- SSTable integration tests ---
 
+TEST_F(LsmTreeTest, DirectReadModeSurvivesCompactionAndRestart) {
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm(nullptr, ReadMode::Direct);
+    // Enough flushes to compact level 0, which streams the tables.
+    for (int round = 0; round < 5; ++round) {
+      for (int i = 0; i < 100; ++i) {
+        lsm.put("key" + std::to_string(i), std::to_string(round));
+      }
+      lsm.put("zzz_trigger" + std::to_string(round), large_value); // Flush
+    }
+    EXPECT_GT(lsm.stats().compaction_count, 0);
+    EXPECT_EQ(lsm.get("key42"), "4");
+    EXPECT_GT(lsm.block_cache().stats().misses, 0);
+  }
+
+  LsmTree reopened(nullptr, ReadMode::Direct);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(reopened.get("key" + std::to_string(i)), "4");
+  }
+  auto it = reopened.new_iterator();
+  size_t count = 0;
+  for (it.seek_to_first(); it.valid(); it.next()) {
+    ++count;
+  }
+  EXPECT_EQ(count, 105);
+}
+
+TEST_F(LsmTreeTest, RestartOpensTablesInParallelAndReportsStartupTime) {
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm;
+    for (int round = 0; round < 3; ++round) {
+      for (int i = 0; i < 50; ++i) {
+        lsm.put("key" + std::to_string(round * 50 + i), std::to_string(i));
+      }
+      lsm.put("zzz_trigger" + std::to_string(round), large_value); // Flush
+    }
+  }
+
+  LsmTree reopened;
+  EXPECT_GT(reopened.stats().startup_time_us, 0);
+  for (int i = 0; i < 150; ++i) {
+    EXPECT_EQ(reopened.get("key" + std::to_string(i)),
+              std::to_string(i % 50));
+  }
+  EXPECT_FALSE(reopened.get("key150").has_value());
+}
+
+TEST_F(LsmTreeTest, CleanShutdownSkipsWalReplay) {
+  {
+    LsmTree lsm;
+    lsm.put("key", "value");
+    lsm.rm("gone");
+    lsm.close();
+    EXPECT_THROW(lsm.put("late", "write"), std::runtime_error);
+    EXPECT_EQ(lsm.get("key"), "value");
+    EXPECT_EQ(std::filesystem::file_size(wal_path_), 0);
+  }
+  {
+    LsmTree reopened;
+    EXPECT_TRUE(reopened.stats().clean_startup);
+    EXPECT_EQ(reopened.get("key"), "value");
+    // Sequence numbers carry on past the deletes.
+    reopened.put("gone", "back");
+    EXPECT_EQ(reopened.get("gone"), "back");
+    // The marker is gone while the tree is open, so a crash now replays.
+    Manifest manifest{"."};
+    ASSERT_TRUE(manifest.recover().value_or(false));
+    EXPECT_FALSE(manifest.clean_shutdown());
+  }
+  LsmTree again;
+  EXPECT_TRUE(again.stats().clean_startup);
+  EXPECT_EQ(again.get("gone"), "back");
+}
+
+TEST_F(LsmTreeTest, MigratesLegacyMetaFile) {
+  {
+    auto sst = SSTable::create("12345.sst");
+    ASSERT_TRUE(sst.has_value());
+    MemTable mem;
+    mem.put("legacy", "value");
+    ASSERT_TRUE(mem.flush_to_sst(*sst).has_value());
+    std::ofstream meta{"lsm.meta"};
+    meta << "12345.sst\n";
+  }
+  {
+    LsmTree lsm;
+    EXPECT_FALSE(std::filesystem::exists("lsm.meta"));
+    EXPECT_EQ(lsm.get("legacy"), "value");
+    lsm.put("new", "write");
+  }
+  LsmTree reopened;
+  EXPECT_EQ(reopened.get("legacy"), "value");
+  EXPECT_EQ(reopened.get("new"), "write");
+}
+
+TEST_F(LsmTreeTest, TreesInSeparateDirectoriesRunSideBySide) {
+  std::vector<std::filesystem::path> dirs{"lsm_test_a", "lsm_test_b"};
+  for (const auto &dir : dirs) {
+    std::filesystem::remove_all(dir);
+  }
+  {
+    LsmTree a{Options{.dir = dirs[0], .memtable_bytes = 1024}};
+    LsmTree b{Options{.dir = dirs[1], .bloom_bits_per_key = 0}};
+    for (int i = 0; i < 100; ++i) {
+      a.put("key" + std::to_string(i), "a" + std::to_string(i));
+      b.put("key" + std::to_string(i), "b" + std::to_string(i));
+    }
+    EXPECT_EQ(a.get("key7"), "a7");
+    EXPECT_EQ(b.get("key7"), "b7");
+  }
+  EXPECT_FALSE(std::filesystem::exists(wal_path_));
+  for (const auto &dir : dirs) {
+    EXPECT_TRUE(std::filesystem::exists(dir / "CURRENT"));
+    EXPECT_TRUE(std::filesystem::exists(dir / "lsm.wal"));
+  }
+  {
+    LsmTree a{Options{.dir = dirs[0]}};
+    EXPECT_EQ(a.get("key99"), "a99");
+    LsmTree b{Options{.dir = dirs[1]}};
+    EXPECT_EQ(b.get("key99"), "b99");
+  }
+  for (const auto &dir : dirs) {
+    std::filesystem::remove_all(dir);
+  }
+}
+
+TEST_F(LsmTreeTest, PipelinedWritersKeepEachKeysOrder) {
+  {
+    LsmTree lsm;
+    auto options = lsm.options();
+    options.memtable_bytes = 2048;
+    lsm.set_options(options);
+    std::vector<std::jthread> writers;
+    for (int t = 0; t < 4; ++t) {
+      writers.emplace_back([&, t] {
+        auto own = "writer" + std::to_string(t);
+        for (int i = 0; i < 300; ++i) {
+          lsm.put(own, std::to_string(i));
+          lsm.put(own + "-" + std::to_string(i), "v");
+        }
+      });
+    }
+    std::atomic<bool> done{false};
+    std::jthread reader{[&] {
+      while (!done) {
+        // Published writes don't go away again.
+        auto value = lsm.get("writer0");
+        auto again = lsm.get("writer0");
+        if (value && again) {
+          ASSERT_LE(std::stoi(*value), std::stoi(*again));
+        }
+      }
+    }};
+    writers.clear();
+    done = true;
+    for (int t = 0; t < 4; ++t) {
+      EXPECT_EQ(lsm.get("writer" + std::to_string(t)), "299");
+    }
+  }
+  LsmTree reopened;
+  EXPECT_EQ(reopened.get("writer3"), "299");
+  EXPECT_EQ(reopened.get("writer2-150"), "v");
+}
+
+TEST_F(LsmTreeTest, SetOptionsRetunesAnOpenTree) {
+  LsmTree lsm;
+  auto options = lsm.options();
+  EXPECT_EQ(options.memtable_bytes, lsm_constants::kMemTableFlushThreshold);
+  options.memtable_bytes = 512;
+  options.sync_mode = SyncMode::EveryWrite;
+  lsm.set_options(options);
+  EXPECT_EQ(lsm.options().sync_mode, SyncMode::EveryWrite);
+  for (int i = 0; i < 50; ++i) {
+    lsm.put("key" + std::to_string(i), std::string(64, 'v'));
+  }
+  // The smaller memtable flushed long before the default one would have.
+  size_t tables = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(".")) {
+    tables += entry.path().extension() == ".sst";
+  }
+  EXPECT_GT(tables, 0);
+  EXPECT_EQ(lsm.get("key42"), std::string(64, 'v'));
+
+  options.dir = "elsewhere";
+  EXPECT_THROW(lsm.set_options(options), std::invalid_argument);
+}
+
+TEST_F(LsmTreeTest, FlushesDoNotWaitOnTheRateLimiter) {
+  Options options;
+  options.memtable_bytes = 4096;
+  // 1 KiB/s: a flush waiting on the limiter would hold the tree's lock for
+  // seconds.
+  options.rate_limiter = std::make_shared<RateLimiter>(1 << 10);
+  LsmTree lsm{options};
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 8; ++i) {
+    lsm.put("key" + std::to_string(i), std::string(1024, 'v'));
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+  auto s = options.rate_limiter->stats();
+  EXPECT_GT(s.flush_bytes, 4096);
+  EXPECT_EQ(s.flush_throttled_count, 0);
+  EXPECT_EQ(lsm.get("key0"), std::string(1024, 'v'));
+}
+
+TEST_F(LsmTreeTest, LargeCompactionTriggerDoesNotStopWriters) {
+  Options options;
+  options.compaction_trigger = 16;
+  options.memtable_bytes = 4096;
+  LsmTree lsm{options};
+  size_t most_l0_files = 0;
+  auto write_flushes = [&](int first, int flushes) {
+    // Four values fill the memtable.
+    for (int i = first; i < first + flushes * 4; ++i) {
+      lsm.put("key" + std::to_string(i), std::string(1024, 'v'));
+      most_l0_files = std::max(
+          most_l0_files, lsm.write_controller().stats().debt.l0_files);
+    }
+  };
+  write_flushes(0, 20);
+  // Level 0 grew past the default stop limit without stopping writes.
+  EXPECT_GT(most_l0_files, 12);
+  EXPECT_EQ(lsm.write_controller().stats().stopped_writes, 0);
+
+  options = lsm.options();
+  options.compaction_trigger = 24;
+  lsm.set_options(options);
+  write_flushes(80, 30);
+  EXPECT_GT(most_l0_files, 16);
+  EXPECT_EQ(lsm.write_controller().stats().stopped_writes, 0);
+  EXPECT_EQ(lsm.get("key0"), std::string(1024, 'v'));
+  EXPECT_EQ(lsm.get("key199"), std::string(1024, 'v'));
+}
+
 TEST_F(LsmTreeTest, MemTableTakesPrecedenceOverSSTable) {
   LsmTree lsm;
 
@@ -330,3 +1010,177 @@ TEST_F(LsmTreeTest, DataSurvivesRestartAfterCompaction) {
     EXPECT_EQ(*lsm.get("persistent_key4"), "persistent_value4");
   }
 }
+
+TEST_F(LsmTreeTest, CompactionMovesDisjointTablesWithoutRewrite) {
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm;
+
+    // Sequential ingest: every flushed table covers its own key range.
+    for (int i = 0; i < 4; ++i) {
+      auto prefix = "seq" + std::to_string(i);
+      lsm.put(prefix + "_a", "value" + std::to_string(i));
+      lsm.put(prefix + "_b", large_value);
+    }
+
+    auto s = lsm.stats();
+    EXPECT_EQ(s.trivial_move_count, 2);
+    EXPECT_EQ(s.compaction_count, 0);
+  }
+
+  // Nothing was rewritten, so all 4 tables are still on disk.
+  int sst_count = 0;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(std::filesystem::current_path())) {
+    if (entry.path().extension() == ".sst") {
+      ++sst_count;
+    }
+  }
+  EXPECT_EQ(sst_count, 4);
+
+  LsmTree lsm;
+  for (int i = 0; i < 4; ++i) {
+    auto prefix = "seq" + std::to_string(i);
+    EXPECT_EQ(*lsm.get(prefix + "_a"), "value" + std::to_string(i));
+  }
+}
+
+TEST_F(LsmTreeTest, ReadsProceedDuringCompaction) {
+  LsmTree lsm;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  lsm.put("stable_key", "stable_value");
+
+  std::atomic<bool> done{false};
+  std::atomic<int> bad_reads{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        auto val = lsm.get("stable_key");
+        if (!val || *val != "stable_value") {
+          bad_reads.fetch_add(1);
+        }
+      }
+    });
+  }
+
+  // Enough flushes for several rounds of compaction.
+  for (int i = 0; i < 8; ++i) {
+    lsm.put("key" + std::to_string(i), "value" + std::to_string(i));
+    lsm.put("trigger" + std::to_string(i), large_value);
+  }
+  done.store(true);
+  for (auto &t : readers) {
+    t.join();
+  }
+
+  EXPECT_EQ(bad_reads.load(), 0);
+  EXPECT_GT(lsm.stats().compaction_count, 0);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(*lsm.get("key" + std::to_string(i)),
+              "value" + std::to_string(i));
+  }
+}
+
+TEST_F(LsmTreeTest, IngestsWriterTablesWithoutTheWal) {
+  std::filesystem::path staging = "ingest_staging";
+  std::filesystem::remove_all(staging);
+  Options small;
+  small.target_file_size = 4096;
+  SSTableWriter writer{staging, small};
+  for (int i = 100; i < 400; ++i) {
+    writer.put("key" + std::to_string(i), "ingested");
+  }
+  writer.rm("key400");
+  EXPECT_THROW(writer.put("key000", "v"), std::invalid_argument);
+  auto files = writer.finish();
+  ASSERT_GT(files.size(), 1);
+  {
+    LsmTree lsm;
+    lsm.put("key150", "old");
+    lsm.put("key400", "old");
+    lsm.put("key500", "kept");
+    auto snap = lsm.get_snapshot();
+    lsm.ingest_files(files);
+    EXPECT_EQ(lsm.get("key150"), "ingested");
+    EXPECT_FALSE(lsm.get("key400").has_value());
+    EXPECT_EQ(lsm.get("key500"), "kept");
+    // The files are newer than the snapshot.
+    EXPECT_EQ(lsm.get("key150", {.snapshot = snap}), "old");
+    lsm.release_snapshot(snap);
+    EXPECT_EQ(std::filesystem::file_size(wal_path_), 0);
+  }
+  // Only the tree's copies were stamped.
+  for (const auto &file : files) {
+    auto sst = SSTable::open(file);
+    ASSERT_TRUE(sst.has_value());
+    EXPECT_EQ(sst->header().max_sequence, 0);
+  }
+  LsmTree reopened;
+  EXPECT_EQ(reopened.get("key399"), "ingested");
+  std::filesystem::remove_all(staging);
+}
+
+TEST_F(LsmTreeTest, IngestRejectsMissingAndTruncatedFiles) {
+  std::filesystem::path staging = "ingest_staging";
+  std::filesystem::remove_all(staging);
+  SSTableWriter writer{staging};
+  writer.put("key1", "ingested");
+  auto files = writer.finish();
+  ASSERT_EQ(files.size(), 1);
+  auto truncated = staging / "truncated.sst";
+  std::filesystem::copy_file(files[0], truncated);
+  std::filesystem::resize_file(truncated, 6);
+  auto missing = staging / "missing.sst";
+
+  LsmTree lsm;
+  lsm.put("key1", "old");
+  for (const auto &bad : {missing, truncated, staging}) {
+    std::vector<std::filesystem::path> batch{files[0], bad};
+    EXPECT_THROW(lsm.ingest_files(batch), std::runtime_error) << bad;
+  }
+  // Nothing was created or ingested.
+  EXPECT_FALSE(std::filesystem::exists(missing));
+  EXPECT_EQ(lsm.get("key1"), "old");
+  std::filesystem::remove_all(staging);
+}
+
+TEST_F(LsmTreeTest, IngestedTableDoesNotShadowLaterWritesAfterCompaction) {
+  std::filesystem::path staging = "ingest_staging";
+  std::filesystem::remove_all(staging);
+  SSTableWriter writer{staging};
+  for (int i = 0; i < 10; ++i) {
+    writer.put("m" + std::to_string(i), "ingested");
+  }
+  auto files = writer.finish();
+
+  Options options;
+  options.compaction_trigger = 2;
+  options.level_size_multiplier = 8;
+  std::string large_value(lsm_constants::kMemTableFlushThreshold, 'x');
+  {
+    LsmTree lsm{options};
+    // Two disjoint flushes, moved down to level 1 as they are.
+    lsm.put("a", "v");
+    lsm.put("a_fill", large_value);
+    lsm.put("b", "v");
+    lsm.put("b_fill", large_value);
+    ASSERT_EQ(lsm.stats().trivial_move_count, 1);
+    // Flushed to level 0 by the ingestion, which itself goes to level 1.
+    lsm.put("c", "v");
+    lsm.ingest_files(files);
+
+    // A newer value, flushed next to "c" on level 0; the pair is then moved
+    // to level 1.
+    lsm.put("m5", "newer");
+    lsm.put("m5_fill", large_value);
+    ASSERT_EQ(lsm.stats().trivial_move_count, 2);
+    EXPECT_EQ(lsm.get("m5"), "newer");
+    EXPECT_EQ(lsm.get("m3"), "ingested");
+    EXPECT_EQ(lsm.get("c"), "v");
+  }
+  LsmTree reopened{options};
+  EXPECT_EQ(reopened.get("m5"), "newer");
+  EXPECT_EQ(reopened.get("m3"), "ingested");
+  std::filesystem::remove_all(staging);
+}
@@ -0,0 +1,131 @@
+#include "Manifest.h"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+class ManifestTest : public ::testing::Test {
+protected:
+  std::filesystem::path dir_ = "manifest_test";
+
+  void SetUp() override {
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  static FileMeta table(const std::string &name, int level) {
+    return FileMeta{.name = name,
+                    .level = level,
+                    .min_key = "a",
+                    .max_key = "z",
+                    .max_sequence = 7,
+                    .file_size = 100};
+  }
+
+  static std::vector<std::string> names(const Manifest &manifest) {
+    std::vector<std::string> out;
+    for (const auto &file : manifest.files()) {
+      out.push_back(file.name + "@" + std::to_string(file.level));
+    }
+    return out;
+  }
+};
+
+TEST_F(ManifestTest, RecoversLoggedEditsInOrder) {
+  {
+    Manifest manifest{dir_};
+    ASSERT_FALSE(manifest.recover().value_or(true));
+    ASSERT_TRUE(manifest.create({}, 0).has_value());
+    auto before = std::vector{table("a.sst", 0), table("b.sst", 0),
+                              table("c.sst", 0)};
+    VersionEdit flush{.last_sequence = 9};
+    for (size_t i = 0; i < before.size(); ++i) {
+      flush.added.push_back({i == 0 ? "" : before[i - 1].name, before[i]});
+    }
+    ASSERT_TRUE(manifest.log(flush).has_value());
+    // a and b compact into d on level 1; c stays where it was.
+    auto after = std::vector{table("d.sst", 1), table("c.sst", 0)};
+    ASSERT_TRUE(manifest.log(VersionEdit::diff(before, after)).has_value());
+    EXPECT_EQ(manifest.files(), after);
+  }
+  Manifest manifest{dir_};
+  ASSERT_TRUE(manifest.recover().value_or(false));
+  EXPECT_EQ(names(manifest), (std::vector<std::string>{"d.sst@1", "c.sst@0"}));
+  EXPECT_EQ(manifest.last_sequence(), 9);
+  EXPECT_FALSE(manifest.clean_shutdown());
+  // File numbers aren't handed out twice across restarts.
+  EXPECT_GT(manifest.new_file_number(), 1);
+}
+
+TEST_F(ManifestTest, RollsOverToASnapshot) {
+  std::filesystem::path first;
+  {
+    Manifest manifest{dir_, 256};
+    ASSERT_TRUE(manifest.create({}, 0).has_value());
+    first = manifest.path();
+    std::string after;
+    for (int i = 0; i < 20; ++i) {
+      auto file = table(Manifest::table_name(manifest.new_file_number()), 0);
+      VersionEdit edit;
+      edit.added.push_back({std::exchange(after, file.name), file});
+      ASSERT_TRUE(manifest.log(std::move(edit)).has_value());
+    }
+    ASSERT_TRUE(manifest.log(VersionEdit{.clean_shutdown = true}).has_value());
+    EXPECT_NE(manifest.path(), first);
+  }
+  EXPECT_FALSE(std::filesystem::exists(first));
+  Manifest manifest{dir_};
+  ASSERT_TRUE(manifest.recover().value_or(false));
+  EXPECT_EQ(manifest.files().size(), 20);
+  EXPECT_TRUE(manifest.clean_shutdown());
+}
+
+TEST_F(ManifestTest, TruncatesATornLastRecord) {
+  std::filesystem::path path;
+  {
+    Manifest manifest{dir_};
+    ASSERT_TRUE(manifest.create({table("a.sst", 0)}, 3).has_value());
+    VersionEdit edit;
+    edit.added.push_back({"a.sst", table("b.sst", 0)});
+    ASSERT_TRUE(manifest.log(std::move(edit)).has_value());
+    path = manifest.path();
+  }
+  auto size = std::filesystem::file_size(path);
+  std::filesystem::resize_file(path, size - 5);
+  {
+    Manifest manifest{dir_};
+    ASSERT_TRUE(manifest.recover().value_or(false));
+    EXPECT_EQ(names(manifest), (std::vector<std::string>{"a.sst@0"}));
+    // New edits go after the last whole record.
+    ASSERT_TRUE(manifest.log(VersionEdit{.last_sequence = 4}).has_value());
+  }
+  Manifest manifest{dir_};
+  ASSERT_TRUE(manifest.recover().value_or(false));
+  EXPECT_EQ(manifest.last_sequence(), 4);
+}
+
+TEST_F(ManifestTest, RejectsCorruptionBeforeTheLastRecord) {
+  std::filesystem::path path;
+  {
+    Manifest manifest{dir_};
+    ASSERT_TRUE(manifest.create({table("a.sst", 0)}, 3).has_value());
+    ASSERT_TRUE(manifest.log(VersionEdit{.last_sequence = 4}).has_value());
+    path = manifest.path();
+  }
+  {
+    // Flip a byte in the snapshot's key.
+    std::fstream file{path, std::ios::in | std::ios::out | std::ios::binary};
+    file.seekp(20);
+    file.put('!');
+  }
+  Manifest manifest{dir_};
+  auto res = manifest.recover();
+  ASSERT_FALSE(res.has_value());
+  EXPECT_EQ(res.error().kind, StorageError::Kind::Corruption);
+}
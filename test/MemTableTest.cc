@@ -240,3 +240,103 @@ TEST_F(MemTableFlushTest, FlushPreservesKeyOrder) {
   ASSERT_TRUE(r2.has_value() && r2->has_value());
   EXPECT_EQ(**r2, "z");
 }
+
+// --- Partitioned flush tests ---
+
+TEST_F(MemTableFlushTest, FlushToSstsCutsAtTargetSize) {
+  MemTable table;
+  for (int i = 0; i < 100; ++i) {
+    table.put("key" + std::to_string(100 + i), std::string(100, 'v'));
+  }
+
+  // ~10 entries of ~106 bytes per file.
+  auto ssts = table.flush_to_ssts([] { return SSTable::create(); }, 1000, {});
+  ASSERT_TRUE(ssts.has_value());
+  EXPECT_EQ(ssts->size(), 10);
+
+  for (size_t i = 0; i + 1 < ssts->size(); ++i) {
+    EXPECT_LT((*ssts)[i].header().max_key, (*ssts)[i + 1].header().min_key);
+  }
+  for (auto &sst : *ssts) {
+    auto read = SSTable::open(sst.path());
+    ASSERT_TRUE(read.has_value());
+    auto min = read->get(sst.header().min_key);
+    ASSERT_TRUE(min.has_value() && min->has_value());
+    std::filesystem::remove(sst.path());
+  }
+}
+
+TEST_F(MemTableFlushTest, FlushToSstsAlignsWithNextLevelBoundaries) {
+  MemTable table;
+  for (char c = 'a'; c <= 'j'; ++c) {
+    table.put(std::string(1, c), std::string(99, 'v'));
+  }
+
+  // Past half the target, a file is cut where keys cross "d".
+  auto ssts = table.flush_to_ssts([] { return SSTable::create(); }, 500, {"d"});
+  ASSERT_TRUE(ssts.has_value());
+  ASSERT_GE(ssts->size(), 2);
+  EXPECT_EQ((*ssts)[0].header().max_key, "d");
+  EXPECT_EQ((*ssts)[1].header().min_key, "e");
+  for (auto &sst : *ssts) {
+    std::filesystem::remove(sst.path());
+  }
+}
+
+TEST_F(MemTableFlushTest, FlushToSstsWithoutTargetWritesOneTable) {
+  MemTable table;
+  table.put("a", "1");
+  table.put("b", "2");
+
+  auto ssts = table.flush_to_ssts([] { return SSTable::create(); }, 0, {"a"});
+  ASSERT_TRUE(ssts.has_value());
+  ASSERT_EQ(ssts->size(), 1);
+  EXPECT_EQ((*ssts)[0].header().min_key, "a");
+  EXPECT_EQ((*ssts)[0].header().max_key, "b");
+  std::filesystem::remove((*ssts)[0].path());
+}
+
+// --- Merge operator tests ---
+
+/// Appends operands to the value, comma-separated.
+struct AppendOperator : MergeOperator {
+  std::string merge(std::string_view, std::optional<std::string_view> existing,
+                    std::string_view operand) const override {
+    return existing ? std::string{*existing} + "," + std::string{operand}
+                    : std::string{operand};
+  }
+};
+
+TEST_F(MemTableFlushTest, MergeOperandsFoldOnReadAndFlush) {
+  AppendOperator op;
+  MemTable table;
+  table.set_merge_operator(&op);
+  table.put("list", "a");
+  table.merge("list", "b");
+  table.merge("list", "c");
+  table.merge("no_base", "x");
+  table.merge("no_base", "y");
+
+  EXPECT_EQ(table.get("list"), "a,b,c");
+  // The base may live in an older table, so the operands stay a merge.
+  EXPECT_FALSE(table.get("no_base").has_value());
+  auto partial = table.lookup("no_base");
+  ASSERT_TRUE(partial.has_value());
+  EXPECT_EQ(partial->type, EntryType::Merge);
+  EXPECT_EQ(partial->value, "x,y");
+
+  auto sst = SSTable::create(test_path_);
+  ASSERT_TRUE(sst.has_value());
+  ASSERT_TRUE(table.flush_to_sst(*sst).has_value());
+
+  auto reopened = SSTable::open(test_path_);
+  ASSERT_TRUE(reopened.has_value());
+  auto list = reopened->lookup("list");
+  ASSERT_TRUE(list.has_value() && list->has_value());
+  EXPECT_EQ((*list)->type, EntryType::Put);
+  EXPECT_EQ((*list)->value, "a,b,c");
+  auto no_base = reopened->lookup("no_base");
+  ASSERT_TRUE(no_base.has_value() && no_base->has_value());
+  EXPECT_EQ((*no_base)->type, EntryType::Merge);
+  EXPECT_EQ((*no_base)->value, "x,y");
+}
@@ -0,0 +1,71 @@
+#include "RangeTombstones.h"
+#include <gtest/gtest.h>
+
+using namespace lsm_storage_engine;
+
+TEST(RangeTombstonesTest, AddMergesOverlappingAndTouchingRanges) {
+  RangeTombstoneList list;
+  list.add("m", "p");
+  list.add("a", "c");
+  list.add("c", "e"); // Touches [a, c)
+  list.add("n", "z"); // Overlaps [m, p)
+  list.add("x", "x"); // Empty
+
+  ASSERT_EQ(list.fragments().size(), 2);
+  EXPECT_EQ(list.fragments()[0].begin, "a");
+  EXPECT_EQ(list.fragments()[0].end, "e");
+  EXPECT_EQ(list.fragments()[1].begin, "m");
+  EXPECT_EQ(list.fragments()[1].end, "z");
+}
+
+TEST(RangeTombstonesTest, CoversIsHalfOpen) {
+  RangeTombstoneList list;
+  list.add("b", "d");
+
+  EXPECT_FALSE(list.covers("a"));
+  EXPECT_TRUE(list.covers("b"));
+  EXPECT_TRUE(list.covers("c"));
+  EXPECT_TRUE(list.covers("czzz"));
+  EXPECT_FALSE(list.covers("d"));
+
+  EXPECT_TRUE(list.covers("b", "c"));
+  EXPECT_FALSE(list.covers("b", "d"));
+  EXPECT_TRUE(list.overlaps("a", "b"));
+  EXPECT_FALSE(list.overlaps("d", "e"));
+}
+
+TEST(RangeTombstonesTest, ClipKeepsOnlyThePartInsideTheBounds) {
+  RangeTombstoneList list;
+  list.add("a", "c");
+  list.add("e", "h");
+
+  auto clipped = list.clip("b", "f");
+  ASSERT_EQ(clipped.fragments().size(), 2);
+  EXPECT_EQ(clipped.fragments()[0].begin, "b");
+  EXPECT_EQ(clipped.fragments()[0].end, "c");
+  EXPECT_EQ(clipped.fragments()[1].begin, "e");
+  EXPECT_EQ(clipped.fragments()[1].end, "f");
+
+  auto tail = list.clip("f", std::nullopt);
+  ASSERT_EQ(tail.fragments().size(), 1);
+  EXPECT_EQ(tail.fragments()[0].begin, "f");
+  EXPECT_EQ(tail.fragments()[0].end, "h");
+}
+
+TEST(RangeTombstonesTest, OverlapsWithDifferentSequencesAreSplit) {
+  RangeTombstoneList list;
+  list.add("a", "d", 5);
+  list.add("c", "f", 9);
+
+  ASSERT_EQ(list.fragments().size(), 3);
+  EXPECT_EQ(list.fragments()[1].begin, "c");
+  EXPECT_EQ(list.fragments()[1].end, "d");
+  EXPECT_EQ(list.fragments()[1].seqs, (std::vector<SequenceNumber>{9, 5}));
+
+  EXPECT_EQ(list.covering_seq("c"), 9);
+  EXPECT_EQ(list.covering_seq("c", 8), 5);
+  EXPECT_EQ(list.covering_seq("e", 8), std::nullopt);
+  EXPECT_TRUE(list.covers("a", "e"));
+  EXPECT_FALSE(list.covers("a", "e", 8));
+  EXPECT_EQ(list.max_sequence(), 9);
+}
@@ -0,0 +1,58 @@
+#include "RowCache.h"
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace lsm_storage_engine;
+
+TEST(RowCacheTest, ColdKeysCannotPushOutHotOnes) {
+  // Room for 8 of the hot keys, in a single shard.
+  constexpr size_t kRow = 128 + 2 + 2;
+  RowCache cache(8 * kRow, 1);
+  for (int i = 0; i < 8; ++i) {
+    auto key = "h" + std::to_string(i);
+    for (int read = 0; read < 10; ++read) {
+      if (!cache.lookup(key)) {
+        cache.insert(key, "v" + std::to_string(i), cache.generation());
+      }
+    }
+  }
+  // A scan reads each cold key once.
+  for (int i = 100; i < 200; ++i) {
+    auto key = "c" + std::to_string(i);
+    EXPECT_FALSE(cache.lookup(key).has_value());
+    cache.insert(key, "cold", cache.generation());
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(cache.lookup("h" + std::to_string(i)), "v" + std::to_string(i));
+  }
+  auto s = cache.stats();
+  EXPECT_EQ(s.rejected, 100);
+  EXPECT_LE(s.usage, 8 * kRow);
+}
+
+TEST(RowCacheTest, InvalidationWinsOverInFlightReads) {
+  RowCache cache(1 << 20);
+  cache.insert("a", "1", cache.generation());
+  EXPECT_EQ(cache.lookup("a"), "1");
+  cache.erase("a");
+  EXPECT_FALSE(cache.lookup("a").has_value());
+
+  // A read that started before the bump must not insert what it saw.
+  auto generation = cache.generation();
+  cache.bump_generation();
+  cache.insert("a", "stale", generation);
+  EXPECT_FALSE(cache.lookup("a").has_value());
+
+  cache.insert("b", "2", cache.generation());
+  cache.clear();
+  EXPECT_FALSE(cache.lookup("b").has_value());
+  EXPECT_EQ(cache.stats().usage, 0);
+}
+
+TEST(RowCacheTest, ZeroCapacityDisablesCaching) {
+  RowCache cache(0);
+  EXPECT_FALSE(cache.enabled());
+  cache.insert("a", "1", cache.generation());
+  EXPECT_FALSE(cache.lookup("a").has_value());
+}
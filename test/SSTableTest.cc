@@ -1,6 +1,8 @@
 #include "SSTable.h"
 #include "MemTable.h"
+#include "SSTableIterator.h"
 #include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 #include <print>
 
@@ -50,7 +52,7 @@ TEST_F(SSTableTest, ReadEntryMMap) {
 
   ASSERT_TRUE(result.has_value()) << "next() returned error";
   ASSERT_TRUE(result->has_value());
-  EXPECT_EQ(result->value().second, "value1");
+  EXPECT_EQ(result->value().second.value, "value1");
 }
 
 TEST_F(SSTableTest, GetReturnsNulloptForMissingKey) {
@@ -195,3 +197,180 @@ TEST_F(SSTableTest, ManyEntries) {
   ASSERT_TRUE(missing.has_value());
   EXPECT_FALSE(missing->has_value());
 }
+
+TEST_F(SSTableTest, ReadModesReadTheSameEntries) {
+  std::vector<std::pair<std::string, std::string>> entries;
+  for (int i = 0; i < 300; ++i) {
+    entries.emplace_back("key" + std::to_string(1000 + i),
+                         std::string(static_cast<size_t>(i), 'v'));
+  }
+  write_test_data(entries);
+
+  BlockCache cache(1UZ << 20, 1);
+  for (auto mode : {ReadMode::Mmap, ReadMode::Pread, ReadMode::Direct}) {
+    auto sst = SSTable::open(test_path_,
+                             {.read_mode = mode, .block_cache = &cache});
+    ASSERT_TRUE(sst.has_value());
+
+    for (int i : {0, 63, 64, 150, 299}) {
+      auto value = sst->get("key" + std::to_string(1000 + i));
+      ASSERT_TRUE(value.has_value() && value->has_value());
+      EXPECT_EQ(**value, std::string(static_cast<size_t>(i), 'v'));
+    }
+    std::vector<std::string_view> keys{"key1000", "key1100", "key1100",
+                                       "key1250", "key2000"};
+    auto found = sst->multi_lookup(keys);
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ((*found)[1]->value, std::string(100, 'v'));
+    EXPECT_EQ((*found)[2]->value, std::string(100, 'v'));
+    EXPECT_EQ((*found)[3]->value, std::string(250, 'v'));
+    EXPECT_FALSE((*found)[4].has_value());
+
+    size_t scanned = 0;
+    SSTableIterator it(*sst, std::nullopt, std::nullopt, 0);
+    for (it.seek_to_first(); it.valid(); it.next()) {
+      EXPECT_EQ(it.key(), entries[scanned++].first);
+    }
+    EXPECT_EQ(scanned, entries.size());
+
+    size_t streamed = 0;
+    while (true) {
+      auto entry = sst->next();
+      ASSERT_TRUE(entry.has_value());
+      if (!entry->has_value()) {
+        break;
+      }
+      EXPECT_EQ((*entry)->first, entries[streamed++].first);
+    }
+    EXPECT_EQ(streamed, entries.size());
+  }
+  // Only the unmapped modes go through the cache; their second reads of a
+  // block hit.
+  EXPECT_GT(cache.stats().hits, 0);
+  EXPECT_GT(cache.stats().usage, 0);
+}
+
+TEST_F(SSTableTest, AccessHintsDontChangeWhatIsRead) {
+  std::vector<std::pair<std::string, std::string>> entries;
+  for (int i = 0; i < 300; ++i) {
+    entries.emplace_back("key" + std::to_string(1000 + i), "value");
+  }
+  write_test_data(entries);
+
+  for (auto mode : {ReadMode::Mmap, ReadMode::Pread}) {
+    auto sst = SSTable::open(test_path_, {.read_mode = mode});
+    ASSERT_TRUE(sst.has_value());
+    sst->advise(SSTable::Access::Sequential);
+    size_t streamed = 0;
+    while (true) {
+      auto entry = sst->next();
+      ASSERT_TRUE(entry.has_value());
+      if (!entry->has_value()) {
+        break;
+      }
+      ++streamed;
+    }
+    EXPECT_EQ(streamed, entries.size());
+
+    // Released pages fault back in for readers still using the table.
+    sst->advise(SSTable::Access::Random);
+    sst->release(0, sst->file_size());
+    auto value = sst->get("key1150");
+    ASSERT_TRUE(value.has_value() && value->has_value());
+    EXPECT_EQ(**value, "value");
+  }
+}
+
+TEST_F(SSTableTest, OpenDefersFilterAndIndex) {
+  write_test_data({{"key1", "value1"}, {"key2", "value2"}});
+  size_t index_offset = SSTable::open(test_path_)->footer().index_offset;
+  {
+    // An index entry claiming a key longer than the file.
+    std::fstream file{test_path_,
+                      std::ios::in | std::ios::out | std::ios::binary};
+    file.seekp(static_cast<std::streamoff>(index_offset));
+    file.write("\xff\xff\xff\x7f", 4);
+  }
+
+  // Only the header and footer are read up front.
+  auto sst = SSTable::open(test_path_);
+  ASSERT_TRUE(sst.has_value());
+  EXPECT_EQ(sst->header().min_key, "key1");
+  EXPECT_EQ(sst->header().max_key, "key2");
+
+  // The first read loads the rest, and reports what's wrong with it.
+  EXPECT_FALSE(sst->load_metadata().has_value());
+  EXPECT_FALSE(sst->get("key1").has_value());
+  EXPECT_TRUE(sst->index().empty());
+}
+
+TEST_F(SSTableTest, TuningIsReadBackFromTheFile) {
+  {
+    auto sst = SSTable::create(test_path_);
+    ASSERT_TRUE(sst.has_value());
+    sst->set_options({.index_interval = 8, .bloom_bits_per_key = 4});
+    MemTable mem;
+    for (int i = 0; i < 100; ++i) {
+      mem.put("key" + std::to_string(1000 + i), std::to_string(i));
+    }
+    ASSERT_TRUE(mem.flush_to_sst(*sst).has_value());
+  }
+  auto sst = SSTable::open(test_path_);
+  ASSERT_TRUE(sst.has_value());
+  ASSERT_TRUE(sst->load_metadata().has_value());
+  EXPECT_EQ(sst->index().size(), 13);
+  // A reader assuming the default hash count would miss keys.
+  for (int i = 0; i < 100; ++i) {
+    auto key = "key" + std::to_string(1000 + i);
+    EXPECT_TRUE(sst->may_contain(key)) << key;
+    auto value = sst->get(key);
+    ASSERT_TRUE(value.has_value() && value->has_value());
+    EXPECT_EQ(**value, std::to_string(i));
+  }
+}
+
+// --- Tombstone tests ---
+
+TEST_F(SSTableTest, LookupReportsTombstones) {
+  {
+    auto sst = SSTable::create(test_path_);
+    ASSERT_TRUE(sst.has_value());
+    MemTable mem;
+    mem.put("alive", "value");
+    mem.remove("deleted");
+    ASSERT_TRUE(mem.flush_to_sst(sst.value()).has_value());
+  }
+  SSTable sst = SSTable::open(test_path_).value();
+
+  auto deleted = sst.lookup("deleted");
+  ASSERT_TRUE(deleted.has_value() && deleted->has_value());
+  EXPECT_TRUE((*deleted)->is_tombstone());
+  // get() treats a tombstone as a missing key.
+  auto value = sst.get("deleted");
+  ASSERT_TRUE(value.has_value());
+  EXPECT_FALSE(value->has_value());
+
+  auto alive = sst.lookup("alive");
+  ASSERT_TRUE(alive.has_value() && alive->has_value());
+  EXPECT_FALSE((*alive)->is_tombstone());
+  EXPECT_EQ((*alive)->value, "value");
+}
+
+// --- Lifetime tests ---
+
+TEST_F(SSTableTest, ObsoleteFileRemovedWhenLastOwnerReleases) {
+  write_test_data({{"key", "value"}});
+  auto sst = std::make_shared<SSTable>(SSTable::open(test_path_).value());
+  auto reader = sst;
+
+  sst->mark_obsolete();
+  sst.reset();
+  // A reader still holds the table: it stays readable and on disk.
+  EXPECT_TRUE(std::filesystem::exists(test_path_));
+  auto result = reader->get("key");
+  ASSERT_TRUE(result.has_value() && result->has_value());
+  EXPECT_EQ(**result, "value");
+
+  reader.reset();
+  EXPECT_FALSE(std::filesystem::exists(test_path_));
+}
@@ -0,0 +1,132 @@
+#include "ShardedLsm.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+class ShardedLsmTest : public ::testing::Test {
+protected:
+  std::filesystem::path dir_ = "sharded_lsm_test";
+
+  void SetUp() override { std::filesystem::remove_all(dir_); }
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  ShardedOptions hash_options(size_t shards = 4) {
+    ShardedOptions options;
+    options.shard_options.dir = dir_;
+    options.shard_options.memtable_bytes = 4096;
+    options.num_shards = shards;
+    return options;
+  }
+
+  ShardedOptions range_options() {
+    auto options = hash_options(3);
+    options.partitioning = Partitioning::Range;
+    options.split_keys = {"key3", "key6"};
+    return options;
+  }
+
+  static std::string key(int i) {
+    auto digits = std::to_string(i);
+    return "key" + std::string(3 - digits.size(), '0') + digits;
+  }
+};
+
+TEST_F(ShardedLsmTest, ScansMergeShardsInKeyOrder) {
+  ShardedLsm lsm{hash_options()};
+  for (int i = 0; i < 300; ++i) {
+    lsm.put(key(i), std::to_string(i));
+  }
+  lsm.rm(key(7));
+  std::vector<size_t> per_shard(lsm.num_shards());
+  for (int i = 0; i < 300; ++i) {
+    ++per_shard[lsm.shard_of(key(i))];
+  }
+  for (auto count : per_shard) {
+    EXPECT_GT(count, 0);
+  }
+
+  auto it = lsm.new_iterator();
+  int seen = 0;
+  std::string last;
+  for (it.seek_to_first(); it.valid(); it.next()) {
+    EXPECT_LT(last, it.key());
+    last = it.key();
+    ++seen;
+  }
+  EXPECT_EQ(seen, 299);
+
+  // Changing direction repositions the other shards around the key.
+  it.seek(key(100));
+  ASSERT_TRUE(it.valid());
+  it.next();
+  it.prev();
+  it.prev();
+  ASSERT_TRUE(it.valid());
+  EXPECT_EQ(it.key(), key(99));
+  it.next();
+  EXPECT_EQ(it.key(), key(100));
+  it.seek_for_prev(key(8));
+  EXPECT_EQ(it.key(), key(8));
+  it.prev();
+  EXPECT_EQ(it.key(), key(6));
+}
+
+TEST_F(ShardedLsmTest, RangeShardsOnlyTouchOverlappingShards) {
+  {
+    ShardedLsm lsm{range_options()};
+    for (int i = 0; i < 900; i += 3) {
+      lsm.put(key(i), "v");
+    }
+    EXPECT_EQ(lsm.shard_of("key2"), 0);
+    EXPECT_EQ(lsm.shard_of("key3"), 1);
+    EXPECT_EQ(lsm.shard_of("key9"), 2);
+    // Spans the boundary between the first two shards.
+    lsm.delete_range(key(250), key(350));
+
+    std::vector<std::string_view> keys{"key249", "key252", "key348",
+                                       "key351", "key900"};
+    auto found = lsm.multi_get(keys);
+    EXPECT_EQ(found[0], "v");
+    EXPECT_FALSE(found[1].has_value());
+    EXPECT_FALSE(found[2].has_value());
+    EXPECT_EQ(found[3], "v");
+    EXPECT_FALSE(found[4].has_value());
+
+    ReadOptions bounded;
+    bounded.lower_bound = key(600);
+    bounded.upper_bound = key(700);
+    auto it = lsm.new_iterator(bounded);
+    int seen = 0;
+    for (it.seek_to_first(); it.valid(); it.next()) {
+      ++seen;
+    }
+    EXPECT_EQ(seen, 34);
+  }
+  // The layout is fixed once written.
+  auto other = range_options();
+  other.split_keys = {"key2", "key6"};
+  EXPECT_THROW(ShardedLsm{other}, std::invalid_argument);
+  ShardedLsm reopened{range_options()};
+  EXPECT_EQ(reopened.get(key(351)), "v");
+}
+
+TEST_F(ShardedLsmTest, ConcurrentWritersLandInTheirShards) {
+  ShardedLsm lsm{hash_options()};
+  std::vector<std::jthread> writers;
+  for (int t = 0; t < 4; ++t) {
+    writers.emplace_back([&, t] {
+      for (int i = t; i < 400; i += 4) {
+        lsm.put(key(i), std::to_string(i));
+      }
+    });
+  }
+  writers.clear();
+  for (int i = 0; i < 400; ++i) {
+    ASSERT_EQ(lsm.get(key(i)), std::to_string(i));
+  }
+  EXPECT_EQ(&lsm.shard(0).block_cache(), &lsm.shard(1).block_cache());
+}
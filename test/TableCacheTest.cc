@@ -0,0 +1,69 @@
+#include "TableCache.h"
+#include "MemTable.h"
+#include "SSTable.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace lsm_storage_engine;
+
+class TableCacheTest : public ::testing::Test {
+protected:
+  std::vector<std::filesystem::path> paths_;
+
+  void SetUp() override {
+    for (int t = 0; t < 4; ++t) {
+      paths_.emplace_back("table_cache_test_" + std::to_string(t) + ".sst");
+      auto sst = SSTable::create(paths_.back());
+      ASSERT_TRUE(sst.has_value());
+      MemTable mem;
+      for (int i = 0; i < 100; ++i) {
+        mem.put("t" + std::to_string(t) + "_key" + std::to_string(i),
+                "value" + std::to_string(i));
+      }
+      ASSERT_TRUE(mem.flush_to_sst(*sst).has_value());
+    }
+  }
+
+  void TearDown() override {
+    for (const auto &path : paths_) {
+      std::filesystem::remove(path);
+    }
+  }
+};
+
+TEST_F(TableCacheTest, KeepsAtMostCapacityFilesOpen) {
+  for (auto mode : {ReadMode::Mmap, ReadMode::Pread}) {
+    TableCache cache(2);
+    std::vector<SSTable> tables;
+    for (const auto &path : paths_) {
+      auto sst = SSTable::open(path, {.read_mode = mode,
+                                      .table_cache = &cache});
+      ASSERT_TRUE(sst.has_value());
+      tables.push_back(std::move(*sst));
+    }
+    // Opening parses the metadata but leaves the file closed.
+    EXPECT_EQ(cache.stats().open_tables, 0);
+
+    for (int round = 0; round < 3; ++round) {
+      for (size_t t = 0; t < tables.size(); ++t) {
+        auto value = tables[t].get("t" + std::to_string(t) + "_key42");
+        ASSERT_TRUE(value.has_value() && value->has_value());
+        EXPECT_EQ(**value, "value42");
+        EXPECT_LE(cache.stats().open_tables, 2);
+      }
+    }
+    auto s = cache.stats();
+    EXPECT_GT(s.evictions, 0);
+    EXPECT_EQ(s.opens, s.evictions + s.open_tables);
+
+    // A pinned file stays usable after its table is closed.
+    auto pinned = tables[0].pin();
+    ASSERT_TRUE(pinned.has_value());
+    cache.set_capacity(1);
+    tables[1].get("t1_key0").value();
+    EXPECT_EQ(cache.stats().open_tables, 1);
+    EXPECT_NE((*pinned)->fd, -1);
+  }
+}
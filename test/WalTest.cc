@@ -1,4 +1,5 @@
 #include "Wal.h"
+#include "MemTable.h"
 #include <fstream>
 #include <gtest/gtest.h>
 #include <sstream>
@@ -23,3 +24,93 @@ TEST_F(WalTest, PathReturnsCorrectPath) {
   Wal wal(test_path_);
   EXPECT_EQ(wal.path(), test_path_);
 }
+
+TEST_F(WalTest, ReplayStopsCleanlyAtATornTail) {
+  {
+    Wal wal(test_path_);
+    for (int i = 0; i < 1000; ++i) {
+      Entry entry = Entry::put("value" + std::to_string(i));
+      entry.seq = static_cast<SequenceNumber>(i + 1);
+      ASSERT_TRUE(wal.write("key" + std::to_string(i), entry).has_value());
+    }
+  }
+  auto full_size = std::filesystem::file_size(test_path_);
+  // Lose the end of the last record, as a crash mid-write would.
+  std::filesystem::resize_file(test_path_, full_size - 3);
+
+  MemTable mem;
+  ASSERT_TRUE(mem.restore_from_wal(test_path_).has_value());
+  EXPECT_EQ(mem.get("key998"), "value998");
+  EXPECT_FALSE(mem.get("key999").has_value());
+  EXPECT_EQ(mem.max_sequence(), 999);
+  // The torn record is cut off, so new writes land right after key998.
+  EXPECT_LT(std::filesystem::file_size(test_path_), full_size - 3);
+  {
+    Wal wal(test_path_);
+    Entry entry = Entry::put("crash");
+    entry.seq = 1000;
+    ASSERT_TRUE(wal.write("after", entry).has_value());
+  }
+  MemTable replayed;
+  ASSERT_TRUE(replayed.restore_from_wal(test_path_).has_value());
+  EXPECT_EQ(replayed.get("after"), "crash");
+}
+
+TEST_F(WalTest, ReplayRejectsCorruptionBeforeTheTail) {
+  {
+    Wal wal(test_path_);
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(wal.write("key" + std::to_string(i), "value").has_value());
+    }
+  }
+  {
+    // Flip a byte in the first record's key.
+    std::fstream file{test_path_,
+                      std::ios::in | std::ios::out | std::ios::binary};
+    file.seekp(20);
+    file.put('!');
+  }
+  MemTable mem;
+  auto result = mem.restore_from_wal(test_path_);
+  ASSERT_FALSE(result.has_value());
+  EXPECT_EQ(result.error().kind, StorageError::Kind::Corruption);
+}
+
+TEST_F(WalTest, ReplayRejectsACorruptLengthBeforeTheTail) {
+  {
+    Wal wal(test_path_);
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(wal.write("key" + std::to_string(i), "value").has_value());
+    }
+  }
+  auto full_size = std::filesystem::file_size(test_path_);
+  {
+    // Make the first record's key length run past the end of the log.
+    std::fstream file{test_path_,
+                      std::ios::in | std::ios::out | std::ios::binary};
+    file.seekp(3);
+    file.put('\x7f');
+  }
+  MemTable mem;
+  auto result = mem.restore_from_wal(test_path_);
+  ASSERT_FALSE(result.has_value());
+  EXPECT_EQ(result.error().kind, StorageError::Kind::Corruption);
+  // Nothing was cut off as a torn tail.
+  EXPECT_EQ(std::filesystem::file_size(test_path_), full_size);
+}
+
+TEST_F(WalTest, TruncateDropsRecordsAppendedSince) {
+  Wal wal(test_path_);
+  ASSERT_TRUE(wal.write("kept", "value").has_value());
+  auto size = wal.size();
+  ASSERT_TRUE(size.has_value());
+  ASSERT_TRUE(wal.write("undone", "value").has_value());
+  ASSERT_TRUE(wal.truncate(*size).has_value());
+  ASSERT_TRUE(wal.write("after", "value").has_value());
+
+  MemTable mem;
+  ASSERT_TRUE(mem.restore_from_wal(test_path_).has_value());
+  EXPECT_EQ(mem.get("kept"), "value");
+  EXPECT_FALSE(mem.get("undone").has_value());
+  EXPECT_EQ(mem.get("after"), "value");
+}
@@ -0,0 +1,76 @@
+#include "WriteController.h"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace lsm_storage_engine;
+
+class WriteControllerTest : public ::testing::Test {
+protected:
+  WriteController controller_{WriteController::Limits{
+      .l0_slowdown = 4,
+      .l0_stop = 8,
+      .pending_bytes_slowdown = 1000,
+      .pending_bytes_stop = 2000,
+      .immutable_memtables_stop = 2,
+      .max_delay = std::chrono::microseconds(1000),
+  }};
+};
+
+TEST_F(WriteControllerTest, NormalBelowSoftLimits) {
+  controller_.update({.l0_files = 3,
+                      .pending_compaction_bytes = 999,
+                      .immutable_memtables = 1});
+  EXPECT_EQ(controller_.state(), WriteController::State::Normal);
+
+  controller_.delay_write();
+  controller_.wait_while_stopped([] { FAIL() << "writes aren't stopped"; });
+  auto s = controller_.stats();
+  EXPECT_EQ(s.delayed_writes, 0);
+  EXPECT_EQ(s.stopped_writes, 0);
+}
+
+TEST_F(WriteControllerTest, DelaysPastSoftLimit) {
+  controller_.update({.l0_files = 6,
+                      .pending_compaction_bytes = 0,
+                      .immutable_memtables = 0});
+  EXPECT_EQ(controller_.state(), WriteController::State::Delayed);
+
+  controller_.delay_write();
+  auto s = controller_.stats();
+  EXPECT_EQ(s.delayed_writes, 1);
+  EXPECT_GT(s.delay_time_us, 0);
+  // Part way to the stop limit, so less than the full delay.
+  EXPECT_LT(s.delay_time_us, 1000);
+  EXPECT_EQ(s.debt.l0_files, 6);
+}
+
+TEST_F(WriteControllerTest, StopsPastHardLimitUntilDebtIsPaid) {
+  controller_.update({.l0_files = 0,
+                      .pending_compaction_bytes = 2000,
+                      .immutable_memtables = 0});
+  EXPECT_EQ(controller_.state(), WriteController::State::Stopped);
+
+  std::thread compactor([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    controller_.update({.l0_files = 0,
+                        .pending_compaction_bytes = 0,
+                        .immutable_memtables = 0});
+  });
+  int progress_calls = 0;
+  controller_.wait_while_stopped([&] { ++progress_calls; });
+  compactor.join();
+
+  EXPECT_EQ(controller_.state(), WriteController::State::Normal);
+  EXPECT_GE(progress_calls, 1);
+  auto s = controller_.stats();
+  EXPECT_EQ(s.stopped_writes, 1);
+  EXPECT_GE(s.stop_time_us, 10000);
+}
+
+TEST_F(WriteControllerTest, TooManyImmutableMemTablesStopsWrites) {
+  controller_.update({.l0_files = 0,
+                      .pending_compaction_bytes = 0,
+                      .immutable_memtables = 2});
+  EXPECT_EQ(controller_.state(), WriteController::State::Stopped);
+}